@@ -0,0 +1,640 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "tfile.h"
+#include "tfile_shared.h"
+#include "t_histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Idle-connection benchmark. Holds a growing number of connections open
+// against the server that do nothing but send CMD_HEARTBEAT once every
+// HEARTBEAT_INTERVAL, as tfile_client does, and measures what each one costs
+// the server: CPU, memory, and the time spent in CMD_Heartbeat.
+//
+// The server runs in a forked child so its CPU time and resident memory are
+// its own. The parent holds the connections and asks the child for a report
+// through a pipe at the start and end of each measurement. A run with no
+// connections comes first and is the baseline the others are measured against.
+//
+//   TFileIdleBench [-n counts] [-r reactors] [-d seconds] [-p port] [-o file]
+//
+// Counts are connections, separated by commas. Each needs a descriptor in both
+// processes, so counts above the open file limit are skipped. Linux only.
+
+#define DEFAULT_COUNTS "1000,10000,100000"
+#define DEFAULT_REACTORS 1
+#define DEFAULT_SECONDS 10
+#define DEFAULT_PORT 27971
+#define DEFAULT_OUTPUT "bench_idle.json"
+#define MAX_COUNTS 16
+#define SPARE_DESCRIPTORS 64
+#define CONNECTIONS_PER_ADDRESS 20000 // Fewer than the ephemeral ports each address has.
+#define HEARTBEAT_INTERVAL 1000000000ULL // 1 second.
+#define SETTLE_TIME 2000000000ULL // 2 seconds.
+#define TICK_INTERVAL 10000 // 10 milliseconds, in microseconds.
+#define BENCH_STREAM 1
+
+typedef struct {
+	t_uint64 count;
+	double mean;
+	double p50;
+	double p99;
+	double p999;
+	double max;
+} bench_summary_t;
+
+// What the server child sends back when asked.
+typedef struct {
+	t_uint64 cpu; // User and system time, nanoseconds.
+	t_int64 rss;
+	t_int64 connection_bytes; // -1 without MALLOC_STATS.
+	bench_summary_t heartbeat;
+	bench_summary_t iteration;
+} bench_report_t;
+
+typedef struct {
+	t_int connections;
+	t_bool skipped;
+	t_int dropped;
+	double connect_seconds;
+	double seconds;
+	bench_report_t start;
+	bench_report_t end;
+} bench_run_t;
+
+static SOCKET *sockets;
+static t_int socket_count;
+static t_int dropped;
+static t_byte heartbeat[FRAME_HEADER_SIZE];
+static t_int heartbeat_cursor;
+static t_uint64 heartbeat_time;
+static pid_t server_pid;
+static t_int command_pipe;
+static t_int report_pipe;
+
+
+/*
+====================
+Summarize
+====================
+*/
+static void Summarize( bench_summary_t *const summary, const t_histogram_t *const histogram ) {
+	summary->count = T_HistogramCount( histogram );
+	summary->mean = T_HistogramMean( histogram );
+	summary->p50 = T_HistogramPercentile( histogram, 50.0 );
+	summary->p99 = T_HistogramPercentile( histogram, 99.0 );
+	summary->p999 = T_HistogramPercentile( histogram, 99.9 );
+	summary->max = ( double )T_HistogramMax( histogram );
+}
+
+
+/*
+====================
+ResidentBytes
+====================
+*/
+static t_int64 ResidentBytes( void ) {
+	FILE *const file = fopen( "/proc/self/statm", "r" );
+	long size = 0;
+	long resident = 0;
+
+	if ( !file ) {
+		return 0;
+	}
+	if ( fscanf( file, "%ld %ld", &size, &resident ) != 2 ) {
+		resident = 0;
+	}
+	fclose( file );
+	return ( t_int64 )resident * sysconf( _SC_PAGESIZE );
+}
+
+
+/*
+====================
+ServerReport
+
+Fills in a report and starts the stats over for the next one.
+====================
+*/
+static void ServerReport( bench_report_t *const report ) {
+	t_histogram_t *const histogram = T_CreateHistogram();
+	t_memoryStats_t memory;
+	struct rusage usage;
+
+	memset( report, 0, sizeof( bench_report_t ) );
+	if ( getrusage( RUSAGE_SELF, &usage ) == 0 ) {
+		report->cpu = ( t_uint64 )( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1000000000ULL +
+			( t_uint64 )( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1000ULL;
+	}
+	report->rss = ResidentBytes();
+	report->connection_bytes = T_GetMemoryStats( &memory ) ? memory.tagLiveBytes[T_TAG_CONNECTION] : -1;
+
+	TFile_ServerGetStats( TFILE_STAT_HEARTBEAT, histogram );
+	Summarize( &report->heartbeat, histogram );
+	T_HistogramReset( histogram );
+	TFile_ServerGetStats( TFILE_STAT_ITERATION, histogram );
+	Summarize( &report->iteration, histogram );
+	T_DestroyHistogram( histogram );
+
+	TFile_ServerResetStats();
+}
+
+
+/*
+====================
+ServerMain
+
+Runs the server until the parent closes the command pipe. Every byte read is a
+request for a report. The server's per-connection messages are dropped.
+====================
+*/
+static void ServerMain( const t_int port, const t_int reactors, const t_int commands, const t_int reports ) {
+	bench_report_t report;
+	t_char command;
+
+	if ( !freopen( "/dev/null", "w", stdout ) || !TFile_InitServerReactors( port, reactors ) ) {
+		_exit( 1 );
+	}
+	TFile_StartServer();
+	TFile_ServerEnableStats( t_true );
+
+	while ( read( commands, &command, 1 ) == 1 ) {
+		ServerReport( &report );
+		if ( write( reports, &report, sizeof( report ) ) != sizeof( report ) ) {
+			break;
+		}
+	}
+
+	TFile_ShutdownServer();
+	_exit( 0 );
+}
+
+
+/*
+====================
+StartServer
+====================
+*/
+static t_bool StartServer( const t_int port, const t_int reactors ) {
+	int commands[2];
+	int reports[2];
+
+	if ( pipe( commands ) != 0 || pipe( reports ) != 0 ) {
+		return t_false;
+	}
+	fflush( stdout );
+	if ( ( server_pid = fork() ) < 0 ) {
+		return t_false;
+	}
+	if ( server_pid == 0 ) {
+		close( commands[1] );
+		close( reports[0] );
+		ServerMain( port, reactors, commands[0], reports[1] );
+	}
+	close( commands[0] );
+	close( reports[1] );
+	command_pipe = commands[1];
+	report_pipe = reports[0];
+	return t_true;
+}
+
+
+/*
+====================
+RequestReport
+====================
+*/
+static t_bool RequestReport( bench_report_t *const report ) {
+	const t_char command = 'r';
+	t_byte *data = ( t_byte * )report;
+	size_t left = sizeof( bench_report_t );
+	ssize_t bytes;
+
+	if ( write( command_pipe, &command, 1 ) != 1 ) {
+		return t_false;
+	}
+	while ( left > 0 ) {
+		if ( ( bytes = read( report_pipe, data, left ) ) <= 0 ) {
+			return t_false;
+		}
+		data += bytes;
+		left -= ( size_t )bytes;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+StopServer
+====================
+*/
+static void StopServer( void ) {
+	int status;
+
+	close( command_pipe );
+	close( report_pipe );
+	waitpid( server_pid, &status, 0 );
+}
+
+
+/*
+====================
+SendHeartbeats
+
+Spreads the heartbeats over the interval, the share of the connections that
+has come due since the last call, so the server sees a steady trickle rather
+than everyone at once.
+====================
+*/
+static void SendHeartbeats( const t_uint64 now ) {
+	t_int64 due;
+
+	if ( socket_count == 0 || now <= heartbeat_time ) {
+		return;
+	}
+	due = ( t_int64 )( ( double )socket_count * ( double )( now - heartbeat_time ) / ( double )HEARTBEAT_INTERVAL );
+	if ( due == 0 ) {
+		return;
+	}
+	if ( due >= socket_count ) {
+		due = socket_count;
+		heartbeat_time = now;
+	} else {
+		heartbeat_time += ( t_uint64 )due * HEARTBEAT_INTERVAL / ( t_uint64 )socket_count;
+	}
+
+	while ( due-- > 0 ) {
+		const SOCKET socket = sockets[heartbeat_cursor];
+
+		if ( socket != INVALID_SOCKET && send( socket, ( const char * )heartbeat, FRAME_HEADER_SIZE, MSG_NOSIGNAL ) != FRAME_HEADER_SIZE ) {
+			TFile_TryCloseSocket( socket );
+			sockets[heartbeat_cursor] = INVALID_SOCKET;
+			++dropped;
+		}
+		heartbeat_cursor = ( heartbeat_cursor + 1 ) % socket_count;
+	}
+}
+
+
+/*
+====================
+Idle
+
+Keeps the heartbeats going for the given time.
+====================
+*/
+static void Idle( const t_uint64 duration ) {
+	const t_uint64 stop = T_Nanoseconds() + duration;
+	t_uint64 now;
+
+	while ( ( now = T_Nanoseconds() ) < stop ) {
+		SendHeartbeats( now );
+		usleep( TICK_INTERVAL );
+	}
+}
+
+
+/*
+====================
+ConnectClients
+
+Opens connections until there are count of them, each sending its first
+heartbeat straight away. Source addresses are spread over 127.0.0.0/8 so large
+counts do not run out of ephemeral ports. Returns the seconds it took.
+====================
+*/
+static double ConnectClients( const t_int port, const t_int count ) {
+	struct sockaddr_in address;
+	struct sockaddr_in source;
+	const t_uint64 start = T_Nanoseconds();
+
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( ( unsigned short )port );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	memset( &source, 0, sizeof( source ) );
+	source.sin_family = AF_INET;
+
+	while ( socket_count < count ) {
+		const SOCKET client = socket( AF_INET, SOCK_STREAM, 0 );
+
+		source.sin_addr.s_addr = htonl( INADDR_LOOPBACK + socket_count / CONNECTIONS_PER_ADDRESS );
+		if ( client == INVALID_SOCKET || bind( client, ( struct sockaddr * )&source, sizeof( source ) ) == SOCKET_ERROR ||
+			connect( client, ( struct sockaddr * )&address, sizeof( address ) ) == SOCKET_ERROR ) {
+			T_FatalError( "ConnectClients: Unable to connect" );
+		}
+		if ( send( client, ( const char * )heartbeat, FRAME_HEADER_SIZE, MSG_NOSIGNAL ) != FRAME_HEADER_SIZE ) {
+			T_FatalError( "ConnectClients: Unable to send heartbeat" );
+		}
+		sockets[socket_count++] = client;
+
+		if ( ( socket_count & 255 ) == 0 ) {
+			SendHeartbeats( T_Nanoseconds() );
+		}
+	}
+	return ( double )( T_Nanoseconds() - start ) / 1e9;
+}
+
+
+/*
+====================
+CountClosed
+
+Counts connections the server has closed. Idle connections never get data, so
+anything readable is the end of the stream.
+====================
+*/
+static t_int CountClosed( void ) {
+	t_byte data;
+	t_int closed = 0;
+	t_int i;
+
+	for ( i = 0; i < socket_count; ++i ) {
+		if ( sockets[i] != INVALID_SOCKET && recv( sockets[i], ( char * )&data, 1, MSG_DONTWAIT ) != SOCKET_ERROR ) {
+			TFile_TryCloseSocket( sockets[i] );
+			sockets[i] = INVALID_SOCKET;
+			++closed;
+		}
+	}
+	return closed;
+}
+
+
+/*
+====================
+Run
+
+Brings the connections up to count, lets the server settle, then measures it
+for the given time.
+====================
+*/
+static t_bool Run( bench_run_t *const run, const t_int port, const t_int seconds ) {
+	t_uint64 start;
+
+	run->connect_seconds = ConnectClients( port, run->connections );
+	Idle( SETTLE_TIME );
+
+	dropped = 0;
+	start = T_Nanoseconds();
+	if ( !RequestReport( &run->start ) ) {
+		return t_false;
+	}
+	Idle( ( t_uint64 )seconds * 1000000000ULL );
+	if ( !RequestReport( &run->end ) ) {
+		return t_false;
+	}
+	run->seconds = ( double )( T_Nanoseconds() - start ) / 1e9;
+	run->dropped = dropped + CountClosed();
+	return t_true;
+}
+
+
+/*
+====================
+ParseCounts
+====================
+*/
+static t_int ParseCounts( const t_char *list, t_int *const counts ) {
+	t_int count = 0;
+
+	while ( *list && count < MAX_COUNTS ) {
+		counts[count++] = atoi( list );
+		while ( *list && *list != ',' ) {
+			++list;
+		}
+		if ( *list == ',' ) {
+			++list;
+		}
+	}
+	return count;
+}
+
+
+/*
+====================
+CompareCounts
+====================
+*/
+static int CompareCounts( const void *a, const void *b ) {
+	return *( const t_int * )a - *( const t_int * )b;
+}
+
+
+/*
+====================
+RaiseDescriptorLimit
+
+Returns how many connections the limit leaves room for.
+====================
+*/
+static t_int RaiseDescriptorLimit( void ) {
+	struct rlimit limit;
+
+	if ( getrlimit( RLIMIT_NOFILE, &limit ) != 0 ) {
+		return 0;
+	}
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit( RLIMIT_NOFILE, &limit );
+	if ( getrlimit( RLIMIT_NOFILE, &limit ) != 0 || limit.rlim_cur <= SPARE_DESCRIPTORS ) {
+		return 0;
+	}
+	return limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur - SPARE_DESCRIPTORS > 0x7fffffff ? 0x7fffffff : ( t_int )( limit.rlim_cur - SPARE_DESCRIPTORS );
+}
+
+
+/*
+====================
+WriteSummary
+====================
+*/
+static void WriteSummary( FILE *const file, const t_char *const name, const bench_summary_t *const summary ) {
+	fprintf( file, "\"%s\": { \"count\": %llu, \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f }",
+		name, ( unsigned long long )summary->count, summary->mean, summary->p50, summary->p99, summary->p999, summary->max );
+}
+
+
+/*
+====================
+RunCPU
+
+Server CPU time over the run, as a fraction of one core.
+====================
+*/
+static double RunCPU( const bench_run_t *const run ) {
+	return ( double )( run->end.cpu - run->start.cpu ) / 1e9 / run->seconds;
+}
+
+
+/*
+====================
+WriteResults
+
+Per-connection figures are over the baseline run with no connections.
+====================
+*/
+static t_bool WriteResults( const t_char *const fileName, const t_int reactors, const t_int seconds, const bench_run_t *const runs, const t_int runCount ) {
+	FILE *const file = fopen( fileName, "w" );
+	const bench_run_t *const baseline = &runs[0];
+	t_int i;
+
+	if ( !file ) {
+		return t_false;
+	}
+
+	fprintf( file, "{\n\t\"reactors\": %d,\n\t\"seconds\": %d,\n\t\"heartbeat_interval_ms\": %llu,\n\t\"runs\": [\n",
+		reactors, seconds, ( unsigned long long )( HEARTBEAT_INTERVAL / 1000000ULL ) );
+	for ( i = 0; i < runCount; ++i ) {
+		const bench_run_t *const run = &runs[i];
+		const t_int connections = run->connections > 0 ? run->connections : 1;
+
+		if ( run->skipped ) {
+			fprintf( file, "\t\t{ \"connections\": %d, \"skipped\": true }%s\n", run->connections, i + 1 < runCount ? "," : "" );
+			continue;
+		}
+
+		fprintf( file, "\t\t{ \"connections\": %d, \"dropped\": %d, \"connect_seconds\": %.3f, \"server_cpu_percent\": %.3f,",
+			run->connections, run->dropped, run->connect_seconds, RunCPU( run ) * 100.0 );
+		if ( run->connections > 0 ) {
+			fprintf( file, " \"cpu_ns_per_connection_second\": %.1f, \"rss_bytes_per_connection\": %.1f,",
+				( RunCPU( run ) - RunCPU( baseline ) ) * 1e9 / connections, ( double )( run->end.rss - baseline->end.rss ) / connections );
+			if ( run->end.connection_bytes >= 0 ) {
+				fprintf( file, " \"heap_bytes_per_connection\": %.1f,", ( double )run->end.connection_bytes / connections );
+			} else {
+				fprintf( file, " \"heap_bytes_per_connection\": null," );
+			}
+		}
+		fprintf( file, " \"rss_bytes\": %lld,\n\t\t  ", ( long long )run->end.rss );
+		WriteSummary( file, "heartbeat_ns", &run->end.heartbeat );
+		fprintf( file, ",\n\t\t  " );
+		WriteSummary( file, "server_iteration_ns", &run->end.iteration );
+		fprintf( file, " }%s\n", i + 1 < runCount ? "," : "" );
+	}
+	fprintf( file, "\t]\n}\n" );
+	fclose( file );
+	return t_true;
+}
+
+
+/*
+====================
+main
+====================
+*/
+int main( int argc, char **argv ) {
+	const t_char *outputName = DEFAULT_OUTPUT;
+	const t_char *countList = DEFAULT_COUNTS;
+	t_int reactors = DEFAULT_REACTORS;
+	t_int seconds = DEFAULT_SECONDS;
+	t_int port = DEFAULT_PORT;
+	bench_run_t runs[MAX_COUNTS + 1];
+	t_int counts[MAX_COUNTS];
+	t_byteStream_t *frame;
+	t_bool failed = t_false;
+	t_int countCount;
+	t_int limit;
+	t_int i;
+
+	for ( i = 1; i + 1 < argc; i += 2 ) {
+		if ( strcmp( argv[i], "-n" ) == 0 ) {
+			countList = argv[i + 1];
+		} else if ( strcmp( argv[i], "-r" ) == 0 ) {
+			reactors = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-d" ) == 0 ) {
+			seconds = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-p" ) == 0 ) {
+			port = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-o" ) == 0 ) {
+			outputName = argv[i + 1];
+		} else {
+			break;
+		}
+	}
+	if ( i < argc || seconds <= 0 || ( countCount = ParseCounts( countList, counts ) ) == 0 ) {
+		fprintf( stderr, "usage: %s [-n counts] [-r reactors] [-d seconds] [-p port] [-o file]\n", argv[0] );
+		return 1;
+	}
+	qsort( counts, countCount, sizeof( t_int ), CompareCounts );
+
+	// Raised before the fork so the server gets the same limit.
+	limit = RaiseDescriptorLimit();
+	if ( !StartServer( port, reactors ) ) {
+		T_FatalError( "main: Unable to start server" );
+	}
+
+	frame = T_CreateByteStream( FRAME_HEADER_SIZE );
+	TFile_WriteFrameHeader( frame, CMD_HEARTBEAT, BENCH_STREAM, 0 );
+	memcpy( heartbeat, T_BSGetBuffer( frame ), FRAME_HEADER_SIZE );
+	T_DestroyByteStream( frame );
+
+	memset( runs, 0, sizeof( runs ) );
+	sockets = ( SOCKET * )T_Malloc( sizeof( SOCKET ) * ( counts[countCount - 1] > 0 ? counts[countCount - 1] : 1 ) );
+
+	// Give the child a moment to start listening.
+	Idle( SETTLE_TIME );
+	heartbeat_time = T_Nanoseconds();
+
+	for ( i = 0; i <= countCount && !failed; ++i ) {
+		bench_run_t *const run = &runs[i];
+
+		run->connections = i > 0 ? counts[i - 1] : 0;
+		if ( run->connections > limit ) {
+			run->skipped = t_true;
+			printf( "%7d connections: skipped, the open file limit allows %d.\n", run->connections, limit );
+			continue;
+		}
+		if ( !Run( run, port, seconds ) ) {
+			T_Error( "main: Lost the server.\n" );
+			failed = t_true;
+			break;
+		}
+
+		printf( "%7d connections: cpu %6.2f%%  rss %10lld B  heartbeat ns p50 %6.0f p99 %6.0f p999 %6.0f  dropped %d\n",
+			run->connections, RunCPU( run ) * 100.0, ( long long )run->end.rss, run->end.heartbeat.p50,
+			run->end.heartbeat.p99, run->end.heartbeat.p999, run->dropped );
+		failed = run->dropped > 0;
+	}
+
+	for ( i = 0; i < socket_count; ++i ) {
+		if ( sockets[i] != INVALID_SOCKET ) {
+			TFile_TryCloseSocket( sockets[i] );
+		}
+	}
+	T_Free( sockets );
+	StopServer();
+
+	if ( !failed && !WriteResults( outputName, reactors, seconds, runs, countCount + 1 ) ) {
+		T_Error( "main: Unable to write %s.\n", outputName );
+	}
+	return failed ? 1 : 0;
+}
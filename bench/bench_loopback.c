@@ -0,0 +1,657 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "tfile.h"
+#include "tfile_shared.h"
+#include "t_histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Headless loopback benchmark. Starts the server in-process and drives a set
+// of clients against it over the wire protocol, one download after another, so
+// every message is a full request and reply: CMD_DOWNLOAD, the chunk requests,
+// and the frames that come back. Results go to stdout and, as JSON, to a file.
+//
+// The clients are driven directly rather than through tfile_client, which is a
+// single client per process.
+//
+//   TFileBench [-c clients] [-r reactors] [-d seconds] [-s sizes] [-l stalled] [-p port] [-o file]
+//
+// Sizes are payload bytes, separated by commas. Stalled connections ask for a
+// whole window of a file and then never read, like a client that stopped
+// reading; the server has to keep serving the others around them, or the run
+// fails. POSIX only.
+
+#define DEFAULT_CLIENTS 64
+#define DEFAULT_REACTORS 1
+#define DEFAULT_SECONDS 5
+#define DEFAULT_PORT 27970
+#define DEFAULT_OUTPUT "bench.json"
+#define DEFAULT_SIZES "64,4096,65536,1048576"
+#define MAX_SIZES 16
+#define MAX_EVENTS 256
+#define READ_BUFFER_SIZE 262144
+#define DRAIN_TIMEOUT 5000000000ULL // 5 seconds, for the last replies of a run.
+#define HEARTBEAT_INTERVAL 1000000000ULL // 1 second.
+#define BENCH_STREAM 1
+#define STALL_FILE "stall.bin"
+#define STALL_FILE_SIZE ( FILE_CHUNK_SIZE * MAX_DOWNLOAD_WINDOW ) // More than the socket buffers hold.
+#define STALL_RECEIVE_BUFFER 4096
+#define STALL_LATENCY_LIMIT HEARTBEAT_INTERVAL // Any download this slow was held up by the stalled connections.
+
+typedef struct {
+	SOCKET socket;
+
+	// Incoming frame: header and the first field, then payload to skip.
+	t_byte header[FRAME_HEADER_SIZE + sizeof( t_int64 )];
+	t_int header_size;
+	t_int header_need;
+	t_int64 skip;
+
+	// Current download
+	t_bool busy;
+	t_int64 size;
+	t_int64 requested;
+	t_int64 received;
+	t_uint64 start;
+	t_uint64 heartbeat;
+} bench_client_t;
+
+typedef struct {
+	t_int payload;
+	t_uint64 messages;
+	t_uint64 bytes;
+	double seconds;
+	t_histogram_t *latency;
+	t_histogram_t *iteration;
+} bench_run_t;
+
+static bench_client_t *clients;
+static t_int client_count;
+static t_poll_t *bench_poll;
+static t_pollEvent_t events[MAX_EVENTS];
+static t_byte read_buffer[READ_BUFFER_SIZE];
+static t_byteStream_t *output;
+static t_bool accepting;
+static t_bool failed;
+static SOCKET *stalled;
+static t_int stalled_count;
+static t_uint64 stalled_heartbeat;
+
+
+/*
+====================
+Flush
+
+Requests are small and the server always reads, so a short send means the
+connection is gone.
+====================
+*/
+static void Flush( bench_client_t *const client ) {
+	const t_int size = T_BSGetSize( output );
+
+	if ( size > 0 && send( client->socket, ( const char * )T_BSGetBuffer( output ), size, 0 ) != size ) {
+		T_Error( "Flush: Unable to send request.\n" );
+		failed = t_true;
+	}
+	T_BSReset( output );
+}
+
+
+/*
+====================
+RequestChunks
+
+Keeps a window of chunk requests outstanding until the whole file is asked for.
+====================
+*/
+static void RequestChunks( bench_client_t *const client ) {
+	while ( client->requested < client->size && client->requested - client->received < ( t_int64 )FILE_CHUNK_SIZE * DEFAULT_DOWNLOAD_WINDOW ) {
+		const t_int64 left = client->size - client->requested;
+		const t_int size = left < FILE_CHUNK_SIZE ? ( t_int )left : FILE_CHUNK_SIZE;
+
+		TFile_WriteFrameHeader( output, CMD_FILE_CHUNK, BENCH_STREAM, sizeof( t_int64 ) + sizeof( t_int ) );
+		T_BSWrite( output, t_int64, client->requested );
+		T_BSWrite( output, t_int, size );
+		client->requested += size;
+	}
+	Flush( client );
+}
+
+
+/*
+====================
+StartMessage
+====================
+*/
+static void StartMessage( bench_client_t *const client, const t_char *const fileName, const t_uint64 now ) {
+	const t_uint length = ( t_uint )strlen( fileName );
+
+	if ( now - client->heartbeat >= HEARTBEAT_INTERVAL ) {
+		TFile_WriteFrameHeader( output, CMD_HEARTBEAT, BENCH_STREAM, 0 );
+		client->heartbeat = now;
+	}
+
+	TFile_WriteFrameHeader( output, CMD_DOWNLOAD, BENCH_STREAM, length );
+	T_BSWriteBuffer( output, ( const t_byte * )fileName, length );
+	Flush( client );
+
+	client->busy = t_true;
+	client->size = 0;
+	client->requested = 0;
+	client->received = 0;
+	client->start = now;
+}
+
+
+/*
+====================
+HandleEvent
+====================
+*/
+static void HandleEvent( bench_client_t *const client, const frame_header_t *const frame, const t_int64 field, bench_run_t *const run, const t_char *const fileName ) {
+	const t_uint64 now = T_Nanoseconds();
+
+	switch ( frame->type ) {
+	case EVT_DOWNLOAD_STARTED:
+		client->size = field;
+		RequestChunks( client );
+		break;
+	case EVT_FILE_CHUNK_READ:
+		client->received += frame->length - sizeof( t_int64 );
+		RequestChunks( client );
+		break;
+	case EVT_DOWNLOAD_FINISHED:
+		T_HistogramRecord( run->latency, now - client->start );
+		++run->messages;
+		run->bytes += client->size;
+		client->busy = t_false;
+		if ( accepting ) {
+			StartMessage( client, fileName, now );
+		}
+		break;
+	default:
+		T_Error( "HandleEvent: Download failed.\n" );
+		failed = t_true;
+		break;
+	}
+}
+
+
+/*
+====================
+Consume
+
+Splits what arrived into frames. Only the header and the first field of each
+frame are kept; chunk bytes are counted and dropped.
+====================
+*/
+static void Consume( bench_client_t *const client, const t_byte *data, t_int size, bench_run_t *const run, const t_char *const fileName ) {
+	frame_header_t frame;
+	t_int64 field;
+	t_int count;
+
+	while ( size > 0 ) {
+		if ( client->skip > 0 ) {
+			count = client->skip < size ? ( t_int )client->skip : size;
+			client->skip -= count;
+			data += count;
+			size -= count;
+			continue;
+		}
+
+		count = client->header_need - client->header_size;
+		count = count < size ? count : size;
+		memcpy( client->header + client->header_size, data, count );
+		client->header_size += count;
+		data += count;
+		size -= count;
+		if ( client->header_size < client->header_need ) {
+			return;
+		}
+
+		TFile_ReadFrameHeader( client->header, &frame );
+		if ( client->header_need == FRAME_HEADER_SIZE && ( frame.type == EVT_DOWNLOAD_STARTED || frame.type == EVT_FILE_CHUNK_READ ) ) {
+			client->header_need += sizeof( t_int64 );
+			continue;
+		}
+
+		field = 0;
+		if ( client->header_need > ( t_int )FRAME_HEADER_SIZE ) {
+			memcpy( &field, client->header + FRAME_HEADER_SIZE, sizeof( t_int64 ) );
+		}
+		client->skip = frame.length - ( client->header_need - FRAME_HEADER_SIZE );
+		client->header_size = 0;
+		client->header_need = FRAME_HEADER_SIZE;
+		HandleEvent( client, &frame, field, run, fileName );
+	}
+}
+
+
+/*
+====================
+ConnectClients
+
+Returns the seconds it took to connect every client.
+====================
+*/
+static double ConnectClients( const t_int port ) {
+	struct sockaddr_in address;
+	const t_uint64 start = T_Nanoseconds();
+	t_int i;
+
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( ( unsigned short )port );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	bench_poll = T_CreatePoll( T_POLL_DEFAULT, client_count );
+	for ( i = 0; i < client_count; ++i ) {
+		bench_client_t *const client = &clients[i];
+
+		memset( client, 0, sizeof( bench_client_t ) );
+		client->header_need = FRAME_HEADER_SIZE;
+		client->socket = socket( AF_INET, SOCK_STREAM, 0 );
+		if ( client->socket == INVALID_SOCKET || connect( client->socket, ( struct sockaddr * )&address, sizeof( address ) ) == SOCKET_ERROR ) {
+			T_FatalError( "ConnectClients: Unable to connect" );
+		}
+		T_SocketNoDelay( client->socket );
+		T_SocketNonBlocking( client->socket );
+		if ( !T_PollAdd( bench_poll, client->socket, ( t_uint64 )i ) ) {
+			T_FatalError( "ConnectClients: Unable to poll client" );
+		}
+	}
+	return ( double )( T_Nanoseconds() - start ) / 1e9;
+}
+
+
+/*
+====================
+StallClients
+
+Each stalled connection starts a download, asks for every chunk of it at once
+and reads nothing from then on. Every download is started before any chunk is
+asked for, so a server that blocks on the first cannot hang the others' start.
+====================
+*/
+static void StallClients( const t_int port ) {
+	struct sockaddr_in address;
+	const t_uint length = ( t_uint )strlen( STALL_FILE );
+	const int receiveBuffer = STALL_RECEIVE_BUFFER;
+	t_byte started[FRAME_HEADER_SIZE + sizeof( t_int64 )];
+	t_int64 offset;
+	t_int i;
+
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( ( unsigned short )port );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	TFile_WriteFrameHeader( output, CMD_DOWNLOAD, BENCH_STREAM, length );
+	T_BSWriteBuffer( output, ( const t_byte * )STALL_FILE, length );
+	for ( i = 0; i < stalled_count; ++i ) {
+		const SOCKET client = socket( AF_INET, SOCK_STREAM, 0 );
+
+		// Set before connecting, so the window stays small.
+		if ( client == INVALID_SOCKET || setsockopt( client, SOL_SOCKET, SO_RCVBUF, ( const char * )&receiveBuffer, sizeof( receiveBuffer ) ) == SOCKET_ERROR ||
+			connect( client, ( struct sockaddr * )&address, sizeof( address ) ) == SOCKET_ERROR ) {
+			T_FatalError( "StallClients: Unable to connect" );
+		}
+		stalled[i] = client;
+
+		if ( send( client, ( const char * )T_BSGetBuffer( output ), T_BSGetSize( output ), 0 ) != T_BSGetSize( output ) ||
+			recv( client, ( char * )started, sizeof( started ), MSG_WAITALL ) != sizeof( started ) || started[sizeof( t_uint )] != EVT_DOWNLOAD_STARTED ) {
+			T_FatalError( "StallClients: Unable to start download" );
+		}
+	}
+	T_BSReset( output );
+
+	for ( offset = 0; offset < STALL_FILE_SIZE; offset += FILE_CHUNK_SIZE ) {
+		TFile_WriteFrameHeader( output, CMD_FILE_CHUNK, BENCH_STREAM, sizeof( t_int64 ) + sizeof( t_int ) );
+		T_BSWrite( output, t_int64, offset );
+		T_BSWrite( output, t_int, FILE_CHUNK_SIZE );
+	}
+	for ( i = 0; i < stalled_count; ++i ) {
+		if ( send( stalled[i], ( const char * )T_BSGetBuffer( output ), T_BSGetSize( output ), 0 ) != T_BSGetSize( output ) ) {
+			T_FatalError( "StallClients: Unable to request chunks" );
+		}
+	}
+	T_BSReset( output );
+	stalled_heartbeat = T_Nanoseconds();
+}
+
+
+/*
+====================
+StalledHeartbeats
+
+Keeps the stalled connections from timing out. The server still reads them;
+it is only their replies that back up.
+====================
+*/
+static void StalledHeartbeats( const t_uint64 now ) {
+	t_byte heartbeat[FRAME_HEADER_SIZE];
+	t_int i;
+
+	if ( stalled_count == 0 || now - stalled_heartbeat < HEARTBEAT_INTERVAL ) {
+		return;
+	}
+	stalled_heartbeat = now;
+
+	TFile_WriteFrameHeader( output, CMD_HEARTBEAT, BENCH_STREAM, 0 );
+	memcpy( heartbeat, T_BSGetBuffer( output ), FRAME_HEADER_SIZE );
+	T_BSReset( output );
+
+	for ( i = 0; i < stalled_count; ++i ) {
+		if ( send( stalled[i], ( const char * )heartbeat, FRAME_HEADER_SIZE, MSG_NOSIGNAL ) != FRAME_HEADER_SIZE ) {
+			T_Error( "StalledHeartbeats: Stalled connection closed.\n" );
+			failed = t_true;
+			return;
+		}
+	}
+}
+
+
+/*
+====================
+Run
+
+Every client downloads the file over and over for the given time, then the
+last downloads are allowed to finish.
+====================
+*/
+static void Run( bench_run_t *const run, const t_char *const fileName, const t_int seconds ) {
+	const t_uint64 start = T_Nanoseconds();
+	const t_uint64 stop = start + ( t_uint64 )seconds * 1000000000ULL;
+
+	t_uint64 now = start;
+	t_int busy = client_count;
+	t_int count;
+	t_int bytes;
+	t_int i;
+
+	TFile_ServerResetStats();
+	accepting = t_true;
+	for ( i = 0; i < client_count; ++i ) {
+		StartMessage( &clients[i], fileName, now );
+	}
+
+	while ( busy > 0 && !failed && now < stop + DRAIN_TIMEOUT ) {
+		if ( ( count = T_PollWait( bench_poll, RECEIVE_TIMEOUT, events, MAX_EVENTS ) ) == SOCKET_ERROR ) {
+			T_FatalError( "Run: Poll error" );
+		}
+
+		for ( i = 0; i < count; ++i ) {
+			bench_client_t *const client = &clients[events[i].data];
+
+			bytes = recv( client->socket, ( char * )read_buffer, READ_BUFFER_SIZE, 0 );
+			if ( bytes == 0 || ( bytes == SOCKET_ERROR && !T_SocketWouldBlock() ) ) {
+				T_Error( "Run: Connection closed.\n" );
+				failed = t_true;
+				break;
+			}
+			if ( bytes > 0 ) {
+				Consume( client, read_buffer, bytes, run, fileName );
+			}
+		}
+
+		now = T_Nanoseconds();
+		StalledHeartbeats( now );
+		if ( accepting && now >= stop ) {
+			accepting = t_false;
+			run->seconds = ( double )( now - start ) / 1e9;
+		}
+		if ( !accepting ) {
+			for ( busy = 0, i = 0; i < client_count; ++i ) {
+				busy += clients[i].busy ? 1 : 0;
+			}
+		}
+	}
+
+	if ( busy > 0 ) {
+		T_Error( "Run: %d clients did not finish.\n", busy );
+		failed = t_true;
+	}
+	if ( stalled_count > 0 && T_HistogramMax( run->latency ) >= STALL_LATENCY_LIMIT ) {
+		T_Error( "Run: The stalled connections held up the others.\n" );
+		failed = t_true;
+	}
+	TFile_ServerGetStats( TFILE_STAT_ITERATION, run->iteration );
+}
+
+
+/*
+====================
+CreatePayload
+====================
+*/
+static t_bool CreatePayload( const t_char *const fileName, const t_int size ) {
+	FILE *const file = fopen( fileName, "wb" );
+	t_int i;
+
+	if ( !file ) {
+		return t_false;
+	}
+	for ( i = 0; i < size; ++i ) {
+		fputc( i & 0xff, file );
+	}
+	fclose( file );
+	return t_true;
+}
+
+
+/*
+====================
+ParseSizes
+====================
+*/
+static t_int ParseSizes( const t_char *list, t_int *const sizes ) {
+	t_int count = 0;
+
+	while ( *list && count < MAX_SIZES ) {
+		sizes[count++] = atoi( list );
+		while ( *list && *list != ',' ) {
+			++list;
+		}
+		if ( *list == ',' ) {
+			++list;
+		}
+	}
+	return count;
+}
+
+
+/*
+====================
+WriteHistogram
+====================
+*/
+static void WriteHistogram( FILE *const file, const t_char *const name, const t_histogram_t *const histogram ) {
+	fprintf( file, "\"%s\": { \"count\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f }",
+		name, ( unsigned long long )T_HistogramCount( histogram ), T_HistogramMean( histogram ) / 1000.0,
+		T_HistogramPercentile( histogram, 50.0 ) / 1000.0, T_HistogramPercentile( histogram, 99.0 ) / 1000.0,
+		T_HistogramPercentile( histogram, 99.9 ) / 1000.0, T_HistogramMax( histogram ) / 1000.0 );
+}
+
+
+/*
+====================
+WriteResults
+====================
+*/
+static t_bool WriteResults( const t_char *const fileName, const t_int reactors, const t_int seconds, const double connectSeconds, const bench_run_t *const runs, const t_int runCount ) {
+	FILE *const file = fopen( fileName, "w" );
+	t_int i;
+
+	if ( !file ) {
+		return t_false;
+	}
+
+	fprintf( file, "{\n\t\"clients\": %d,\n\t\"stalled\": %d,\n\t\"reactors\": %d,\n\t\"seconds\": %d,\n", client_count, stalled_count, reactors, seconds );
+	fprintf( file, "\t\"connect\": { \"connections\": %d, \"seconds\": %.6f, \"per_second\": %.1f },\n",
+		client_count, connectSeconds, connectSeconds > 0.0 ? client_count / connectSeconds : 0.0 );
+	fprintf( file, "\t\"runs\": [\n" );
+	for ( i = 0; i < runCount; ++i ) {
+		const bench_run_t *const run = &runs[i];
+
+		fprintf( file, "\t\t{ \"payload\": %d, \"messages\": %llu, \"messages_per_second\": %.1f, \"bytes_per_second\": %.1f,\n\t\t  ",
+			run->payload, ( unsigned long long )run->messages, run->messages / run->seconds, run->bytes / run->seconds );
+		WriteHistogram( file, "latency_us", run->latency );
+		fprintf( file, ",\n\t\t  " );
+		WriteHistogram( file, "server_iteration_us", run->iteration );
+		fprintf( file, " }%s\n", i + 1 < runCount ? "," : "" );
+	}
+	fprintf( file, "\t]\n}\n" );
+	fclose( file );
+	return t_true;
+}
+
+
+/*
+====================
+main
+====================
+*/
+int main( int argc, char **argv ) {
+	const t_char *outputName = DEFAULT_OUTPUT;
+	const t_char *sizeList = DEFAULT_SIZES;
+	t_int reactors = DEFAULT_REACTORS;
+	t_int seconds = DEFAULT_SECONDS;
+	t_int port = DEFAULT_PORT;
+	t_int sizes[MAX_SIZES];
+	bench_run_t runs[MAX_SIZES];
+	t_char fileName[MAX_FILE_NAME_SIZE];
+	t_char directory[] = "/tmp/tfile_bench_XXXXXX";
+	t_char original[1024];
+	double connectSeconds;
+	t_int sizeCount;
+	t_int i;
+
+	client_count = DEFAULT_CLIENTS;
+	for ( i = 1; i + 1 < argc; i += 2 ) {
+		if ( strcmp( argv[i], "-c" ) == 0 ) {
+			client_count = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-r" ) == 0 ) {
+			reactors = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-d" ) == 0 ) {
+			seconds = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-s" ) == 0 ) {
+			sizeList = argv[i + 1];
+		} else if ( strcmp( argv[i], "-l" ) == 0 ) {
+			stalled_count = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-p" ) == 0 ) {
+			port = atoi( argv[i + 1] );
+		} else if ( strcmp( argv[i], "-o" ) == 0 ) {
+			outputName = argv[i + 1];
+		} else {
+			break;
+		}
+	}
+	if ( i < argc || client_count <= 0 || stalled_count < 0 || seconds <= 0 || ( sizeCount = ParseSizes( sizeList, sizes ) ) == 0 ) {
+		fprintf( stderr, "usage: %s [-c clients] [-r reactors] [-d seconds] [-s sizes] [-l stalled] [-p port] [-o file]\n", argv[0] );
+		return 1;
+	}
+
+	memset( runs, 0, sizeof( runs ) );
+
+	// The server serves its working directory, so give it one with just the payloads.
+	if ( !getcwd( original, sizeof( original ) ) || !mkdtemp( directory ) || chdir( directory ) != 0 ) {
+		T_FatalError( "main: Unable to create payload directory" );
+	}
+	for ( i = 0; i < sizeCount; ++i ) {
+		sprintf( fileName, "payload_%d.bin", sizes[i] );
+		if ( !CreatePayload( fileName, sizes[i] ) ) {
+			T_FatalError( "main: Unable to create payload" );
+		}
+	}
+	if ( stalled_count > 0 && !CreatePayload( STALL_FILE, STALL_FILE_SIZE ) ) {
+		T_FatalError( "main: Unable to create payload" );
+	}
+
+	if ( !TFile_InitServerReactors( port, reactors ) ) {
+		return 1;
+	}
+	TFile_StartServer();
+	TFile_ServerEnableStats( t_true );
+
+	clients = ( bench_client_t * )T_Malloc( sizeof( bench_client_t ) * client_count );
+	output = T_CreateGrowableByteStream( MAX_PACKET_SIZE );
+	connectSeconds = ConnectClients( port );
+	stalled = ( SOCKET * )T_Malloc( sizeof( SOCKET ) * ( stalled_count > 0 ? stalled_count : 1 ) );
+	StallClients( port );
+
+	for ( i = 0; i < sizeCount && !failed; ++i ) {
+		runs[i].payload = sizes[i];
+		runs[i].latency = T_CreateHistogram();
+		runs[i].iteration = T_CreateHistogram();
+		sprintf( fileName, "payload_%d.bin", sizes[i] );
+		Run( &runs[i], fileName, seconds );
+
+		printf( "payload %9d B: %10.1f msg/s %14.1f B/s  latency us p50 %9.1f p99 %9.1f p999 %9.1f\n",
+			runs[i].payload, runs[i].messages / runs[i].seconds, runs[i].bytes / runs[i].seconds,
+			T_HistogramPercentile( runs[i].latency, 50.0 ) / 1000.0, T_HistogramPercentile( runs[i].latency, 99.0 ) / 1000.0,
+			T_HistogramPercentile( runs[i].latency, 99.9 ) / 1000.0 );
+	}
+	printf( "connect: %d clients in %.3f s, %.1f per second\n", client_count, connectSeconds, client_count / connectSeconds );
+	if ( stalled_count > 0 ) {
+		printf( "stalled: %d connections never read their replies\n", stalled_count );
+	}
+
+	for ( i = 0; i < client_count; ++i ) {
+		TFile_TryCloseSocket( clients[i].socket );
+	}
+	for ( i = 0; i < stalled_count; ++i ) {
+		TFile_TryCloseSocket( stalled[i] );
+	}
+	T_Free( stalled );
+	T_DestroyPoll( bench_poll );
+	T_DestroyByteStream( output );
+	T_Free( clients );
+	TFile_ShutdownServer();
+
+	for ( i = 0; i < sizeCount; ++i ) {
+		sprintf( fileName, "payload_%d.bin", sizes[i] );
+		remove( fileName );
+	}
+	remove( STALL_FILE );
+	if ( chdir( original ) == 0 ) {
+		remove( directory );
+	}
+
+	if ( !failed && !WriteResults( outputName, reactors, seconds, connectSeconds, runs, sizeCount ) ) {
+		T_Error( "main: Unable to write %s.\n", outputName );
+	}
+	for ( i = 0; i < sizeCount; ++i ) {
+		if ( runs[i].latency ) {
+			T_DestroyHistogram( runs[i].latency );
+			T_DestroyHistogram( runs[i].iteration );
+		}
+	}
+	return failed ? 1 : 0;
+}
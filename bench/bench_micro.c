@@ -0,0 +1,516 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "t_common.h"
+#include "t_pipe.h"
+#include "tinycthread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( _MSC_VER )
+#	include <intrin.h>
+#	define READ_CYCLES() __rdtsc()
+#	define HAVE_CYCLES 1
+#elif defined( __x86_64__ ) || defined( __i386__ )
+#	include <x86intrin.h>
+#	define READ_CYCLES() __rdtsc()
+#	define HAVE_CYCLES 1
+#else
+#	define READ_CYCLES() 0
+#	define HAVE_CYCLES 0
+#endif
+
+// Microbenchmarks for the primitives everything else is built on. Each one is
+// sized to run for at least MIN_RUN_TIME, repeated REPEATS times, and the
+// fastest repeat is reported: ns and cycles per operation, and allocations per
+// operation when built with MALLOC_STATS=1. Cycles are read from the time stamp
+// counter, so they tick at its reference rate, not the core clock.
+//
+//   TFileMicroBench [-o file] [-b baseline] [-t percent]
+//
+// With a baseline from an earlier -o, each result is compared against it and
+// the exit code is 2 if anything got slower by more than the threshold.
+
+#define MIN_RUN_TIME 50000000ULL // 50 milliseconds.
+#define REPEATS 5
+#define STREAM_SIZE 4096
+#define MAX_PRODUCERS 16
+#define MAX_BENCHMARKS 32
+#define MAX_NAME_SIZE 64
+#define DEFAULT_THRESHOLD 10.0
+
+typedef void ( *bench_func_t )( const t_uint64 operations );
+
+typedef struct {
+	t_char name[MAX_NAME_SIZE];
+	double nanoseconds;
+	double cycles;
+	double allocations; // Negative when not counted.
+	double baseline; // Nanoseconds per operation; zero when there is none.
+} bench_result_t;
+
+static bench_result_t results[MAX_BENCHMARKS];
+static t_int result_count;
+static t_byteStream_t *stream;
+static t_byte block[STREAM_SIZE];
+static volatile t_uint64 sink;
+
+static t_pipe_t *bench_pipe;
+static t_int producer_count;
+static t_uint64 producer_messages;
+static volatile t_bool producers_go;
+static t_uint64 received;
+
+
+/*
+============================================================================
+
+BYTE STREAMS
+
+============================================================================
+*/
+
+#define BENCH_STRING "benchmark-string"
+
+
+/*
+====================
+Refill
+
+Fills the stream so the reads below have something to consume.
+====================
+*/
+static void Refill( void ) {
+	T_BSReset( stream );
+	T_BSWriteBuffer( stream, block, STREAM_SIZE );
+}
+
+
+static void BS_WriteByte( const t_uint64 operations ) {
+	t_uint64 i;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( ( i & ( STREAM_SIZE - 1 ) ) == 0 ) {
+			T_BSReset( stream );
+		}
+		T_BSWriteByte( stream, ( t_byte )i );
+	}
+}
+
+
+static void BS_ReadByte( const t_uint64 operations ) {
+	t_uint64 total = 0;
+	t_uint64 i;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( ( i & ( STREAM_SIZE - 1 ) ) == 0 ) {
+			Refill();
+		}
+		total += T_BSReadByte( stream );
+	}
+	sink = total;
+}
+
+
+static void BS_WriteBuffer( const t_uint64 operations ) {
+	t_uint64 i;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( ( i & ( STREAM_SIZE / 64 - 1 ) ) == 0 ) {
+			T_BSReset( stream );
+		}
+		T_BSWriteBuffer( stream, block, 64 );
+	}
+}
+
+
+static void BS_WriteInt( const t_uint64 operations ) {
+	t_uint64 i;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( ( i & ( STREAM_SIZE / sizeof( t_int ) - 1 ) ) == 0 ) {
+			T_BSReset( stream );
+		}
+		T_BSWrite( stream, t_int, ( t_int )i );
+	}
+}
+
+
+static void BS_ReadInt( const t_uint64 operations ) {
+	t_uint64 total = 0;
+	t_uint64 i;
+	t_int value;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( ( i & ( STREAM_SIZE / sizeof( t_int ) - 1 ) ) == 0 ) {
+			Refill();
+		}
+		T_BSRead( stream, t_int, value );
+		total += value;
+	}
+	sink = total;
+}
+
+
+static void BS_WriteString( const t_uint64 operations ) {
+	t_uint64 i;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( ( i & ( STREAM_SIZE / sizeof( BENCH_STRING ) - 1 ) ) == 0 ) {
+			T_BSReset( stream );
+		}
+		T_BSWriteString( stream, BENCH_STRING );
+	}
+}
+
+
+static void BS_ReadString( const t_uint64 operations ) {
+	const t_int perStream = STREAM_SIZE / sizeof( BENCH_STRING );
+
+	t_char str[sizeof( BENCH_STRING )];
+	t_uint64 total = 0;
+	t_uint64 i;
+	t_int j;
+
+	for ( i = 0; i < operations; ++i ) {
+		if ( i % perStream == 0 ) {
+			T_BSReset( stream );
+			for ( j = 0; j < perStream; ++j ) {
+				T_BSWriteString( stream, BENCH_STRING );
+			}
+		}
+		T_BSReadString( stream, str, sizeof( str ) );
+		total += str[0];
+	}
+	sink = total;
+}
+
+
+/*
+============================================================================
+
+PIPES
+
+============================================================================
+*/
+
+
+/*
+====================
+Producer
+====================
+*/
+static t_int Producer( void *arg ) {
+	t_uint64 i;
+
+	while ( !producers_go );
+
+	for ( i = 0; i < producer_messages; ++i ) {
+		T_PipeSend( bench_pipe, arg );
+	}
+	return 0;
+}
+
+
+/*
+====================
+Receive
+====================
+*/
+static void Receive( void *const data ) {
+	++received;
+}
+
+
+/*
+====================
+Pipe_SendReceive
+
+Every producer sends its share of the messages while this thread receives.
+An operation is one message through the pipe.
+====================
+*/
+static void Pipe_SendReceive( const t_uint64 operations ) {
+	thrd_t threads[MAX_PRODUCERS];
+	t_int i;
+
+	producer_messages = operations / producer_count;
+	producers_go = t_false;
+	received = 0;
+
+	for ( i = 0; i < producer_count; ++i ) {
+		if ( thrd_create( &threads[i], Producer, &threads[i] ) != thrd_success ) {
+			T_FatalError( "Pipe_SendReceive: Unable to create thread" );
+		}
+	}
+
+	producers_go = t_true;
+	while ( received < producer_messages * producer_count ) {
+		T_PipeReceive( bench_pipe, Receive );
+	}
+
+	for ( i = 0; i < producer_count; ++i ) {
+		thrd_join( threads[i], NULL );
+	}
+}
+
+
+/*
+============================================================================
+
+INTEGER FORMATTING
+
+============================================================================
+*/
+
+static const t_int itoa_values[8] = { 0, 7, -42, 1234, -98765, 2147483647, -2147483647, 65536 };
+
+
+static void Itoa( const t_uint64 operations ) {
+	t_char buffer[16];
+	t_uint64 total = 0;
+	t_uint64 i;
+
+	for ( i = 0; i < operations; ++i ) {
+		T_itoa( itoa_values[i & 7], buffer, sizeof( buffer ) );
+		total += buffer[0];
+	}
+	sink = total;
+}
+
+
+/*
+============================================================================
+
+DRIVER
+
+============================================================================
+*/
+
+
+/*
+====================
+Allocations
+====================
+*/
+static double Allocations( void ) {
+	t_memoryStats_t stats;
+
+	return T_GetMemoryStats( &stats ) ? ( double )stats.allocations : -1.0;
+}
+
+
+/*
+====================
+Measure
+
+Grows the operation count until one run takes MIN_RUN_TIME, then keeps the
+fastest of REPEATS runs.
+====================
+*/
+static void Measure( const t_char *const name, const bench_func_t func ) {
+	bench_result_t *const result = &results[result_count++];
+
+	t_uint64 operations = 1024;
+	t_uint64 elapsed = 0;
+	t_uint64 start;
+	t_uint64 cycles;
+	double allocations;
+	t_int i;
+
+	while ( elapsed < MIN_RUN_TIME ) {
+		operations *= 2;
+		start = T_Nanoseconds();
+		func( operations );
+		elapsed = T_Nanoseconds() - start;
+	}
+
+	strncpy( result->name, name, MAX_NAME_SIZE - 1 );
+	result->nanoseconds = -1.0;
+	for ( i = 0; i < REPEATS; ++i ) {
+		allocations = Allocations();
+		cycles = READ_CYCLES();
+		start = T_Nanoseconds();
+		func( operations );
+		elapsed = T_Nanoseconds() - start;
+		cycles = READ_CYCLES() - cycles;
+
+		if ( result->nanoseconds < 0.0 || ( double )elapsed / operations < result->nanoseconds ) {
+			result->nanoseconds = ( double )elapsed / operations;
+			result->cycles = HAVE_CYCLES ? ( double )cycles / operations : 0.0;
+			result->allocations = allocations < 0.0 ? -1.0 : ( Allocations() - allocations ) / operations;
+		}
+	}
+}
+
+
+/*
+====================
+ReadBaseline
+
+Reads the results written by an earlier run, one benchmark per line.
+====================
+*/
+static t_bool ReadBaseline( const t_char *const fileName ) {
+	FILE *const file = fopen( fileName, "r" );
+	t_char line[256];
+	t_char name[MAX_NAME_SIZE];
+	double nanoseconds;
+	t_int i;
+
+	if ( !file ) {
+		return t_false;
+	}
+
+	while ( fgets( line, sizeof( line ), file ) ) {
+		if ( sscanf( line, " { \"name\": \"%63[^\"]\", \"ns_per_op\": %lf", name, &nanoseconds ) != 2 ) {
+			continue;
+		}
+		for ( i = 0; i < result_count; ++i ) {
+			if ( strcmp( results[i].name, name ) == 0 ) {
+				results[i].baseline = nanoseconds;
+			}
+		}
+	}
+	fclose( file );
+	return t_true;
+}
+
+
+/*
+====================
+WriteResults
+====================
+*/
+static t_bool WriteResults( const t_char *const fileName ) {
+	FILE *const file = fopen( fileName, "w" );
+	t_int i;
+
+	if ( !file ) {
+		return t_false;
+	}
+
+	fprintf( file, "{\n\t\"benchmarks\": [\n" );
+	for ( i = 0; i < result_count; ++i ) {
+		fprintf( file, "\t\t{ \"name\": \"%s\", \"ns_per_op\": %.3f, \"cycles_per_op\": %.3f, \"allocations_per_op\": ",
+			results[i].name, results[i].nanoseconds, results[i].cycles );
+		if ( results[i].allocations < 0.0 ) {
+			fprintf( file, "null" );
+		} else {
+			fprintf( file, "%.4f", results[i].allocations );
+		}
+		fprintf( file, " }%s\n", i + 1 < result_count ? "," : "" );
+	}
+	fprintf( file, "\t]\n}\n" );
+	fclose( file );
+	return t_true;
+}
+
+
+/*
+====================
+main
+====================
+*/
+int main( int argc, char **argv ) {
+	static const t_int producers[] = { 1, 2, 4, 8, 16 };
+
+	const t_char *outputName = NULL;
+	const t_char *baselineName = NULL;
+	double threshold = DEFAULT_THRESHOLD;
+	t_char name[MAX_NAME_SIZE];
+	t_int regressions = 0;
+	t_int i;
+
+	for ( i = 1; i + 1 < argc; i += 2 ) {
+		if ( strcmp( argv[i], "-o" ) == 0 ) {
+			outputName = argv[i + 1];
+		} else if ( strcmp( argv[i], "-b" ) == 0 ) {
+			baselineName = argv[i + 1];
+		} else if ( strcmp( argv[i], "-t" ) == 0 ) {
+			threshold = atof( argv[i + 1] );
+		} else {
+			break;
+		}
+	}
+	if ( i < argc ) {
+		fprintf( stderr, "usage: %s [-o file] [-b baseline] [-t percent]\n", argv[0] );
+		return 1;
+	}
+
+	stream = T_CreateByteStream( STREAM_SIZE );
+	for ( i = 0; i < STREAM_SIZE; ++i ) {
+		block[i] = ( t_byte )i;
+	}
+
+	Measure( "bs_write_byte", BS_WriteByte );
+	Measure( "bs_read_byte", BS_ReadByte );
+	Measure( "bs_write_buffer_64", BS_WriteBuffer );
+	Measure( "bs_write_int", BS_WriteInt );
+	Measure( "bs_read_int", BS_ReadInt );
+	Measure( "bs_write_string", BS_WriteString );
+	Measure( "bs_read_string", BS_ReadString );
+
+	bench_pipe = T_CreatePipe();
+	for ( i = 0; i < ( t_int )( sizeof( producers ) / sizeof( producers[0] ) ); ++i ) {
+		producer_count = producers[i];
+		sprintf( name, "pipe_%d_producers", producer_count );
+		Measure( name, Pipe_SendReceive );
+	}
+	T_DestroyPipe( bench_pipe );
+
+	Measure( "itoa", Itoa );
+	T_DestroyByteStream( stream );
+
+	if ( baselineName && !ReadBaseline( baselineName ) ) {
+		T_Error( "main: Unable to read %s.\n", baselineName );
+		return 1;
+	}
+
+	for ( i = 0; i < result_count; ++i ) {
+		const bench_result_t *const result = &results[i];
+
+		printf( "%-20s %10.2f ns/op %10.2f cycles/op", result->name, result->nanoseconds, result->cycles );
+		if ( result->allocations >= 0.0 ) {
+			printf( " %8.4f allocs/op", result->allocations );
+		}
+		if ( result->baseline > 0.0 ) {
+			const double change = ( result->nanoseconds - result->baseline ) / result->baseline * 100.0;
+
+			printf( " %+7.1f%% vs baseline%s", change, change > threshold ? "  REGRESSION" : "" );
+			regressions += change > threshold ? 1 : 0;
+		}
+		printf( "\n" );
+	}
+
+	if ( outputName && !WriteResults( outputName ) ) {
+		T_Error( "main: Unable to write %s.\n", outputName );
+		return 1;
+	}
+	return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,443 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "t_common.h"
+#include "tinycthread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Small blocks come from slabs carved into a single size per class, so what one
+// connection frees is reused by the next instead of fragmenting the heap. Slabs
+// are kept for the life of the process. Each thread has a short free list per
+// class and trades blocks with the shared lists in batches, so the common path
+// takes no lock. Build with T_SYSTEM_MALLOC to hand everything to malloc, for
+// tools that need to see each allocation.
+//
+// With T_MALLOC_STATS every block also records its tag, and the counters below
+// follow live bytes, the peak, and allocations per tag. They rely on the block
+// header, so they stay off with T_SYSTEM_MALLOC.
+
+#if defined( T_MALLOC_STATS ) && !defined( T_SYSTEM_MALLOC )
+#	define COUNT_MEMORY
+#endif
+
+static const t_char *const tag_names[T_TAG_COUNT] = {
+	"general",
+	"connection",
+	"pipe",
+	"transfer",
+	"cache"
+};
+
+#ifndef T_SYSTEM_MALLOC
+
+#if _WIN32
+#	include <windows.h>
+#	define SPIN_LOCK( lock ) while ( InterlockedExchange( ( LONG volatile * )( lock ), 1 ) ) {}
+#	define SPIN_UNLOCK( lock ) InterlockedExchange( ( LONG volatile * )( lock ), 0 )
+#	define ATOMIC_ADD64( target, value ) ( InterlockedExchangeAdd64( ( LONG64 volatile * )( target ), ( value ) ) + ( value ) )
+#	define ATOMIC_COMPARE_EXCHANGE64( target, expected, value ) \
+	( InterlockedCompareExchange64( ( LONG64 volatile * )( target ), ( value ), ( expected ) ) == ( expected ) )
+#else
+#	define SPIN_LOCK( lock ) while ( __sync_lock_test_and_set( ( lock ), 1 ) ) {}
+#	define SPIN_UNLOCK( lock ) __sync_lock_release( lock )
+#	define ATOMIC_ADD64( target, value ) __sync_add_and_fetch( ( target ), ( value ) )
+#	define ATOMIC_COMPARE_EXCHANGE64( target, expected, value ) __sync_bool_compare_and_swap( ( target ), ( expected ), ( value ) )
+#endif
+
+#define MIN_CLASS_SHIFT 4 // 16 bytes.
+#define SIZE_CLASSES 11 // Up to 16 KiB.
+#define MAX_CLASS_SIZE ( 1 << ( MIN_CLASS_SHIFT + SIZE_CLASSES - 1 ) )
+#define LARGE_CLASS -1
+#define MIN_SLAB_SIZE 65536
+#define MIN_SLAB_BLOCKS 8
+#define CACHE_SIZE 65536 // Bytes a thread may hold per class before giving some back.
+#define MIN_CACHE_BLOCKS 4
+
+// Sits in front of every block. Sixteen bytes, so the memory after it keeps
+// malloc's alignment.
+typedef struct {
+	t_int sizeClass;
+	t_uint size;
+	t_int tag;
+	t_int padding;
+} blockHeader_t;
+
+typedef struct block_s block_t;
+struct block_s {
+	block_t *next;
+};
+
+typedef struct {
+	block_t *free;
+	t_int count;
+} blockList_t;
+
+typedef struct {
+	volatile t_int lock;
+	blockList_t list;
+} sharedList_t;
+
+static sharedList_t shared_lists[SIZE_CLASSES];
+static T_THREAD_LOCAL blockList_t thread_lists[SIZE_CLASSES];
+
+#define BLOCK_SIZE( sizeClass ) ( sizeof( blockHeader_t ) + ( ( size_t )1 << ( MIN_CLASS_SHIFT + ( sizeClass ) ) ) )
+#define BLOCK_HEADER( memory ) ( ( blockHeader_t * )( memory ) - 1 )
+
+#ifdef COUNT_MEMORY
+static volatile t_memoryStats_t memory_stats;
+static T_THREAD_LOCAL t_memoryTag_t thread_tag;
+static T_THREAD_LOCAL t_uint64 thread_allocations;
+
+
+/*
+====================
+CountAllocation
+====================
+*/
+static void CountAllocation( const t_int tag, const t_uint size ) {
+	const t_int64 live = ATOMIC_ADD64( &memory_stats.liveBytes, ( t_int64 )size );
+
+	t_int64 peak;
+
+	ATOMIC_ADD64( &memory_stats.allocations, 1 );
+	ATOMIC_ADD64( &memory_stats.tagAllocations[tag], 1 );
+	ATOMIC_ADD64( &memory_stats.tagLiveBytes[tag], ( t_int64 )size );
+	++thread_allocations;
+
+	for ( peak = memory_stats.peakBytes; live > peak; peak = memory_stats.peakBytes ) {
+		if ( ATOMIC_COMPARE_EXCHANGE64( &memory_stats.peakBytes, peak, live ) ) {
+			break;
+		}
+	}
+}
+
+
+/*
+====================
+CountFree
+====================
+*/
+static void CountFree( const t_int tag, const t_uint size ) {
+	ATOMIC_ADD64( &memory_stats.liveBytes, -( t_int64 )size );
+	ATOMIC_ADD64( &memory_stats.frees, 1 );
+	ATOMIC_ADD64( &memory_stats.tagLiveBytes[tag], -( t_int64 )size );
+}
+#endif
+
+
+/*
+====================
+SizeClass
+====================
+*/
+static t_int SizeClass( const t_uint size ) {
+	t_int sizeClass = 0;
+
+	if ( size > MAX_CLASS_SIZE ) {
+		return LARGE_CLASS;
+	}
+
+	while ( ( ( t_uint )1 << ( MIN_CLASS_SHIFT + sizeClass ) ) < size ) {
+		++sizeClass;
+	}
+	return sizeClass;
+}
+
+
+/*
+====================
+CacheLimit
+
+How many blocks of a class a thread keeps before returning half.
+====================
+*/
+static t_int CacheLimit( const t_int sizeClass ) {
+	const t_int limit = ( t_int )( CACHE_SIZE / BLOCK_SIZE( sizeClass ) );
+
+	return limit > MIN_CACHE_BLOCKS ? limit : MIN_CACHE_BLOCKS;
+}
+
+
+/*
+====================
+CarveSlab
+
+Splits a new slab into blocks on the thread's list.
+====================
+*/
+static void CarveSlab( blockList_t *const list, const t_int sizeClass ) {
+	const size_t blockSize = BLOCK_SIZE( sizeClass );
+	const size_t count = blockSize * MIN_SLAB_BLOCKS > MIN_SLAB_SIZE ? MIN_SLAB_BLOCKS : MIN_SLAB_SIZE / blockSize;
+
+	t_byte *const slab = ( t_byte * )malloc( blockSize * count );
+	size_t i;
+
+	if ( !slab ) {
+		T_FatalError( "T_Malloc: Out of memory" );
+	}
+
+	for ( i = 0; i < count; ++i ) {
+		block_t *const block = ( block_t * )( slab + i * blockSize + sizeof( blockHeader_t ) );
+
+		block->next = list->free;
+		list->free = block;
+	}
+	list->count += ( t_int )count;
+}
+
+
+/*
+====================
+Refill
+
+Takes a batch of blocks from the shared list, or a new slab when it is empty.
+====================
+*/
+static void Refill( blockList_t *const list, const t_int sizeClass ) {
+	sharedList_t *const shared = &shared_lists[sizeClass];
+	const t_int batch = CacheLimit( sizeClass ) / 2;
+
+	SPIN_LOCK( &shared->lock );
+	while ( shared->list.free && list->count < batch ) {
+		block_t *const block = shared->list.free;
+
+		shared->list.free = block->next;
+		--shared->list.count;
+		block->next = list->free;
+		list->free = block;
+		++list->count;
+	}
+	SPIN_UNLOCK( &shared->lock );
+
+	if ( !list->free ) {
+		CarveSlab( list, sizeClass );
+	}
+}
+
+
+/*
+====================
+Release
+
+Moves count blocks from the thread's list to the shared list.
+====================
+*/
+static void Release( blockList_t *const list, const t_int sizeClass, const t_int count ) {
+	sharedList_t *const shared = &shared_lists[sizeClass];
+	block_t *const first = list->free;
+
+	block_t *last = first;
+	t_int i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	for ( i = 1; i < count; ++i ) {
+		last = last->next;
+	}
+	list->free = last->next;
+	list->count -= count;
+
+	SPIN_LOCK( &shared->lock );
+	last->next = shared->list.free;
+	shared->list.free = first;
+	shared->list.count += count;
+	SPIN_UNLOCK( &shared->lock );
+}
+
+
+/*
+====================
+T_Malloc
+====================
+*/
+void *T_Malloc( const t_uint size ) {
+	const t_int sizeClass = SizeClass( size );
+
+	blockHeader_t *header;
+
+	if ( sizeClass == LARGE_CLASS ) {
+		if ( !( header = ( blockHeader_t * )malloc( sizeof( blockHeader_t ) + size ) ) ) {
+			T_FatalError( "T_Malloc: Out of memory" );
+		}
+	} else {
+		blockList_t *const list = &thread_lists[sizeClass];
+
+		if ( !list->free ) {
+			Refill( list, sizeClass );
+		}
+		header = BLOCK_HEADER( list->free );
+		list->free = list->free->next;
+		--list->count;
+	}
+
+	header->sizeClass = sizeClass;
+	header->size = size;
+#ifdef COUNT_MEMORY
+	header->tag = thread_tag;
+	CountAllocation( header->tag, size );
+#endif
+	return header + 1;
+}
+
+
+/*
+====================
+T_Free
+====================
+*/
+void T_Free( void *const memory ) {
+	blockHeader_t *header;
+	blockList_t *list;
+	block_t *block;
+
+	if ( !memory ) {
+		return;
+	}
+
+	header = BLOCK_HEADER( memory );
+#ifdef COUNT_MEMORY
+	CountFree( header->tag, header->size );
+#endif
+	if ( header->sizeClass == LARGE_CLASS ) {
+		free( header );
+		return;
+	}
+
+	list = &thread_lists[header->sizeClass];
+	block = ( block_t * )memory;
+	block->next = list->free;
+	list->free = block;
+	if ( ++list->count > CacheLimit( header->sizeClass ) ) {
+		Release( list, header->sizeClass, list->count / 2 );
+	}
+}
+
+
+/*
+====================
+T_FlushThreadCache
+
+Hands the calling thread's cached blocks back to the shared lists. Threads
+call this before they exit so other threads can reuse what they freed.
+====================
+*/
+void T_FlushThreadCache( void ) {
+	t_int i;
+
+	for ( i = 0; i < SIZE_CLASSES; ++i ) {
+		Release( &thread_lists[i], i, thread_lists[i].count );
+	}
+}
+
+#else
+
+void *T_Malloc( const t_uint size ) { return malloc( size ); }
+void T_Free( void *const memory ) { free( memory ); }
+void T_FlushThreadCache( void ) {}
+
+#endif // T_SYSTEM_MALLOC
+
+
+/*
+====================
+T_Malloc0
+====================
+*/
+void *T_Malloc0( const t_uint size ) {
+	void *const memory = T_Malloc( size );
+	memset( memory, 0, size );
+	return memory;
+}
+
+
+/*
+====================
+T_SetMemoryTag
+
+Tags what the calling thread allocates from now on.
+Returns the previous tag, to be set back when the work is done.
+====================
+*/
+t_memoryTag_t T_SetMemoryTag( const t_memoryTag_t tag ) {
+#ifdef COUNT_MEMORY
+	const t_memoryTag_t previous = thread_tag;
+
+	thread_tag = tag;
+	return previous;
+#else
+	return T_TAG_GENERAL;
+#endif
+}
+
+
+/*
+====================
+T_GetMemoryStats
+
+Returns false when the counters were not built in.
+====================
+*/
+t_bool T_GetMemoryStats( t_memoryStats_t *const stats ) {
+#ifdef COUNT_MEMORY
+	// Each counter is read on its own, so a busy process may show a slightly
+	// torn snapshot.
+	memcpy( stats, ( const void * )&memory_stats, sizeof( t_memoryStats_t ) );
+	return t_true;
+#else
+	memset( stats, 0, sizeof( t_memoryStats_t ) );
+	return t_false;
+#endif
+}
+
+
+/*
+====================
+T_ThreadAllocations
+
+How many allocations the calling thread has made.
+====================
+*/
+t_uint64 T_ThreadAllocations( void ) {
+#ifdef COUNT_MEMORY
+	return thread_allocations;
+#else
+	return 0;
+#endif
+}
+
+
+/*
+====================
+T_MemoryTagName
+====================
+*/
+const t_char *T_MemoryTagName( const t_memoryTag_t tag ) {
+	return tag >= 0 && tag < T_TAG_COUNT ? tag_names[tag] : "unknown";
+}
@@ -38,6 +38,7 @@ struct t_byteStream_s {
 	int maxSize;
 	int readPosition;
 	int writePosition;
+	t_bool growable;
 	t_byte *buffer;
 };
 
@@ -89,51 +90,63 @@ void T_Print( const t_char *const format, ... ) {
 
 /*
 ====================
-T_Malloc
+T_CreateByteStream
 ====================
 */
-void *T_Malloc( const t_uint size ) {
-	return malloc( size );
-}
+t_byteStream_t *T_CreateByteStream( const t_int size ) {
+	t_byteStream_t *const byteStream = ( t_byteStream_t * )T_Malloc( sizeof( t_byteStream_t ) );
 
+	byteStream->size = 0;
+	byteStream->maxSize = size;
+	byteStream->readPosition = 0;
+	byteStream->writePosition = 0;
+	byteStream->growable = t_false;
+	byteStream->buffer = T_Malloc( size );
 
-/*
-====================
-T_Malloc0
-====================
-*/
-void *T_Malloc0( const t_uint size ) {
-	void *const memory = malloc( size );
-	memset( memory, 0, size );
-	return memory;
+	return byteStream;
 }
 
 
 /*
 ====================
-T_Free
+T_CreateGrowableByteStream
+
+Starts at size bytes and grows instead of refusing writes once full.
 ====================
 */
-void T_Free( void *const memory ) {
-	free( memory );
+t_byteStream_t *T_CreateGrowableByteStream( const t_int size ) {
+	t_byteStream_t *const byteStream = T_CreateByteStream( size );
+
+	byteStream->growable = t_true;
+	return byteStream;
 }
 
 
 /*
 ====================
-T_CreateByteStream
+T_BSReserve
+
+Makes room for at least size more bytes, whether or not the stream is growable.
 ====================
 */
-t_byteStream_t *T_CreateByteStream( const t_int size ) {
-	t_byteStream_t *const byteStream = ( t_byteStream_t * )T_Malloc( sizeof( t_byteStream_t ) );
+void T_BSReserve( t_byteStream_t *const byteStream, const t_int size ) {
+	t_int maxSize = byteStream->maxSize > 0 ? byteStream->maxSize : 1;
+	t_byte *buffer;
 
-	byteStream->size = 0;
-	byteStream->maxSize = size;
-	byteStream->readPosition = 0;
-	byteStream->writePosition = 0;
-	byteStream->buffer = T_Malloc( size );
+	if ( byteStream->size + size <= byteStream->maxSize ) {
+		return;
+	}
 
-	return byteStream;
+	while ( maxSize < byteStream->size + size ) {
+		maxSize *= 2;
+	}
+
+	buffer = ( t_byte * )T_Malloc( maxSize );
+	memcpy( buffer, byteStream->buffer, byteStream->size );
+	T_Free( byteStream->buffer );
+
+	byteStream->buffer = buffer;
+	byteStream->maxSize = maxSize;
 }
 
 
@@ -192,6 +205,10 @@ T_BSWriteByte
 ====================
 */
 void T_BSWriteByte( t_byteStream_t *const byteStream, const t_byte value ) {
+	if ( byteStream->growable ) {
+		T_BSReserve( byteStream, 1 );
+	}
+
 	if ( !T_BSCanWrite( byteStream ) ) {
 		T_Error( "T_BSWriteByte: Unable to write byte to stream.\n" );
 		return;
@@ -221,31 +238,45 @@ T_BSWriteBuffer
 ====================
 */
 void T_BSWriteBuffer( t_byteStream_t *const byteStream, const t_byte *const buffer, const t_int size ) {
-	int i;
+	if ( byteStream->growable ) {
+		T_BSReserve( byteStream, size );
+	}
 
-	for ( i = 0; i < size; ++i ) {
-		T_BSWriteByte( byteStream, buffer[i] );
+	if ( byteStream->size + size > byteStream->maxSize ) {
+		T_Error( "T_BSWriteBuffer: Unable to write buffer to stream.\n" );
+		return;
 	}
+
+	memcpy( byteStream->buffer + byteStream->writePosition, buffer, size );
+	byteStream->writePosition += size;
+	byteStream->size += size;
 }
 
 
 /*
 ====================
-T_BSWriteString
+T_BSReadBuffer
 ====================
 */
-void T_BSWriteString( t_byteStream_t *const byteStream, const t_char *const str ) {
-	int i = 0;
+void T_BSReadBuffer( t_byteStream_t *const byteStream, t_byte *const buffer, const t_int size ) {
+	if ( size > byteStream->size - byteStream->readPosition ) {
+		T_Error( "T_BSReadBuffer: Unable to read buffer from stream.\n" );
+		memset( buffer, 0, size );
+		return;
+	}
+
+	memcpy( buffer, byteStream->buffer + byteStream->readPosition, size );
+	byteStream->readPosition += size;
+}
 
-	do {
-		const t_char ch = str[i];
 
-		T_BSWriteByte( byteStream, ch );
-		if ( ch == '\0' ) {
-			break;
-		}
-		++i;
-	} while ( 1 );
+/*
+====================
+T_BSWriteString
+====================
+*/
+void T_BSWriteString( t_byteStream_t *const byteStream, const t_char *const str ) {
+	T_BSWriteBuffer( byteStream, ( const t_byte * )str, ( t_int )strlen( str ) + 1 );
 }
 
 
@@ -255,17 +286,25 @@ T_BSReadString
 ====================
 */
 void T_BSReadString( t_byteStream_t *const byteStream, t_char *const str, const t_int size ) {
-	int i = 0;
+	const t_byte *const start = byteStream->buffer + byteStream->readPosition;
+	const t_int left = byteStream->size - byteStream->readPosition;
+	const t_byte *const end = ( const t_byte * )memchr( start, '\0', left );
 
-	do {
-		const t_char ch = T_BSReadByte( byteStream );
+	t_int length = end ? ( t_int )( end - start ) : left;
 
-		if ( ( i >= size - 1 ) || ( ch == '\0' ) ) {
-			str[i] = '\0';
-			break;
-		}
-		str[i++] = ch;
-	} while ( 1 );
+	// Like the terminator, the byte that did not fit is consumed.
+	if ( length >= size ) {
+		length = size - 1;
+	}
+	memcpy( str, start, length );
+	str[length] = '\0';
+
+	if ( length < left ) {
+		byteStream->readPosition += length + 1;
+	} else {
+		T_Error( "T_BSReadString: Unable to read byte from stream.\n" );
+		byteStream->readPosition += length;
+	}
 }
 
 
@@ -289,6 +328,63 @@ t_int T_BSGetSize( const t_byteStream_t *const byteStream ) {
 }
 
 
+/*
+====================
+T_BSGetReadSize
+
+Bytes written but not read yet.
+====================
+*/
+t_int T_BSGetReadSize( const t_byteStream_t *const byteStream ) {
+	return byteStream->size - byteStream->readPosition;
+}
+
+
+/*
+====================
+T_BSGetReadBuffer
+
+The next unread byte, for looking ahead without reading.
+====================
+*/
+t_byte *T_BSGetReadBuffer( const t_byteStream_t *const byteStream ) {
+	return byteStream->buffer + byteStream->readPosition;
+}
+
+
+/*
+====================
+T_BSSkip
+====================
+*/
+void T_BSSkip( t_byteStream_t *const byteStream, const t_int size ) {
+	if ( size > T_BSGetReadSize( byteStream ) ) {
+		T_Error( "T_BSSkip: Unable to skip past the end of stream.\n" );
+		byteStream->readPosition = byteStream->size;
+		return;
+	}
+	byteStream->readPosition += size;
+}
+
+
+/*
+====================
+T_BSCompact
+
+Drops the bytes already read and moves the unread ones to the front, so a
+partial message can wait for the rest of its bytes.
+====================
+*/
+void T_BSCompact( t_byteStream_t *const byteStream ) {
+	const t_int size = T_BSGetReadSize( byteStream );
+
+	memmove( byteStream->buffer, byteStream->buffer + byteStream->readPosition, size );
+	byteStream->size = size;
+	byteStream->readPosition = 0;
+	byteStream->writePosition = size;
+}
+
+
 /*
 ====================
 _T_itoa_reverse
@@ -349,3 +445,40 @@ void T_itoa( const t_int value, t_char *const destination, const t_int size ) {
 	}
 	_T_itoa_convert( value, 0, destination, size );
 }
+
+
+/*
+====================
+T_HashString
+
+FNV-1a.
+====================
+*/
+t_uint T_HashString( const t_char *const string ) {
+	const t_char *c;
+	t_uint hash = 2166136261u;
+
+	for ( c = string; *c != '\0'; ++c ) {
+		hash = ( hash ^ ( t_byte )*c ) * 16777619u;
+	}
+	return hash;
+}
+
+
+/*
+====================
+T_HashBytes
+
+FNV-1a, like T_HashString, over size bytes.
+====================
+*/
+t_uint T_HashBytes( const void *const data, const t_int size ) {
+	const t_byte *const bytes = ( const t_byte * )data;
+	t_uint hash = 2166136261u;
+	t_int i;
+
+	for ( i = 0; i < size; ++i ) {
+		hash = ( hash ^ bytes[i] ) * 16777619u;
+	}
+	return hash;
+}
@@ -41,6 +41,17 @@ typedef unsigned __int32 t_uint;
 typedef __int64 t_int64;
 typedef unsigned __int64 t_uint64;
 #else
+typedef int t_int;
+typedef unsigned int t_uint;
+typedef long long t_int64;
+typedef unsigned long long t_uint64;
+#endif
+
+// Each thread has its own copy of a variable declared with this.
+#ifdef _WIN32
+#	define T_THREAD_LOCAL __declspec( thread )
+#else
+#	define T_THREAD_LOCAL __thread
 #endif
 
 typedef enum {
@@ -50,9 +61,32 @@ typedef enum {
 
 typedef struct t_byteStream_s t_byteStream_t;
 
+// What an allocation was for, set per thread with T_SetMemoryTag.
+typedef enum {
+	T_TAG_GENERAL,
+	T_TAG_CONNECTION,
+	T_TAG_PIPE,
+	T_TAG_TRANSFER,
+	T_TAG_CACHE,
+	T_TAG_COUNT
+} t_memoryTag_t;
+
+// Process-wide counters, kept when built with T_MALLOC_STATS. Bytes are what
+// callers asked for, not what the slabs hold.
+typedef struct {
+	t_int64 liveBytes;
+	t_int64 peakBytes;
+	t_int64 allocations;
+	t_int64 frees;
+	t_int64 tagAllocations[T_TAG_COUNT];
+	t_int64 tagLiveBytes[T_TAG_COUNT];
+} t_memoryStats_t;
+
 t_byteStream_t *T_CreateByteStream( const t_int size );
+t_byteStream_t *T_CreateGrowableByteStream( const t_int size );
 void T_DestroyByteStream( t_byteStream_t *const byteStream );
 void T_BSReset( t_byteStream_t *const byteStream );
+void T_BSReserve( t_byteStream_t *const byteStream, const t_int size );
 t_bool T_BSCanRead( const t_byteStream_t *const byteStream );
 t_bool T_BSCanWrite( const t_byteStream_t *const byteStream );
 void T_BSWriteByte( t_byteStream_t *const byteStream, const t_byte value );
@@ -60,42 +94,33 @@ t_byte T_BSReadByte( t_byteStream_t *const byteStream );
 t_byte *T_BSGetBuffer( const t_byteStream_t *const byteStream );
 t_int T_BSGetSize( const t_byteStream_t *const byteStream );
 void T_BSWriteBuffer( t_byteStream_t *const byteStream, const t_byte *const buffer, const t_int size );
+void T_BSReadBuffer( t_byteStream_t *const byteStream, t_byte *const buffer, const t_int size );
 void T_BSWriteString( t_byteStream_t *const byteStream, const t_char *const str );
 void T_BSReadString( t_byteStream_t *const byteStream, t_char *const str, const t_int size );
+t_int T_BSGetReadSize( const t_byteStream_t *const byteStream );
+t_byte *T_BSGetReadBuffer( const t_byteStream_t *const byteStream );
+void T_BSSkip( t_byteStream_t *const byteStream, const t_int size );
+void T_BSCompact( t_byteStream_t *const byteStream );
 
 #define T_BSWrite( byteStream, type, write ) \
 { \
-	const t_int __size = sizeof( type ); \
-	\
-	int __i; \
-	\
 	union { \
 		t_byte buffer[sizeof( type )]; \
 		type writeValue; \
 	} __pack; \
 	\
 	__pack.writeValue = write; \
-	\
-	for ( __i = 0; __i < __size; ++__i ) { \
-		T_BSWriteByte( byteStream, __pack.buffer[__i] ); \
-	} \
+	T_BSWriteBuffer( byteStream, __pack.buffer, sizeof( type ) ); \
 }
 
 #define T_BSRead( byteStream, type, read ) \
 { \
-	const t_int __size = sizeof( type ); \
-	\
-	int __i; \
-	\
 	union { \
 		t_byte buffer[sizeof( type )]; \
 		type readValue; \
 	} __unpack; \
 	\
-	for ( __i = 0; __i < __size; ++__i ) { \
-		__unpack.buffer[__i] = T_BSReadByte( byteStream ); \
-	} \
-	\
+	T_BSReadBuffer( byteStream, __unpack.buffer, sizeof( type ) ); \
 	read = __unpack.readValue; \
 }
 
@@ -105,9 +130,18 @@ void T_Print( const t_char *const format, ... );
 void *T_Malloc( const t_uint size );
 void *T_Malloc0( const t_uint size );
 void T_Free( void *const memory );
+void T_FlushThreadCache( void );
+t_memoryTag_t T_SetMemoryTag( const t_memoryTag_t tag );
+t_bool T_GetMemoryStats( t_memoryStats_t *const stats );
+t_uint64 T_ThreadAllocations( void );
+const t_char *T_MemoryTagName( const t_memoryTag_t tag );
 
 t_uint64 T_Milliseconds( t_uint64 *const baseTime, t_int *const initialized );
+t_uint64 T_Nanoseconds( void );
+t_int T_ProcessorCount( void );
 
 void T_itoa( const t_int value, t_char *const destination, const t_int size );
+t_uint T_HashString( const t_char *const string );
+t_uint T_HashBytes( const void *const data, const t_int size );
 
 #endif // _T_COMMON_H_
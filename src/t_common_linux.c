@@ -28,6 +28,7 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #include "t_common.h"
 
 #include <time.h>
+#include <unistd.h>
 
 
 /*
@@ -45,8 +46,35 @@ t_uint64 T_Milliseconds( t_uint64 *const baseTime, t_int *const initialized ) {
 
 	if ( !( *initialized ) ) {
 		*baseTime = CAST_MILLISECONDS( ts );
-		*initialized = _true;
+		*initialized = t_true;
 	}
 
 	return CAST_MILLISECONDS( ts ) - *baseTime;
 }
+
+
+/*
+====================
+T_Nanoseconds
+
+A monotonic clock for timing short spans. Only differences are meaningful.
+====================
+*/
+t_uint64 T_Nanoseconds( void ) {
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( t_uint64 )ts.tv_sec * 1000000000 + ( t_uint64 )ts.tv_nsec;
+}
+
+
+/*
+====================
+T_ProcessorCount
+====================
+*/
+t_int T_ProcessorCount( void ) {
+	const long count = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return count > 0 ? ( t_int )count : 1;
+}
@@ -62,3 +62,36 @@ t_uint64 T_Milliseconds( t_uint64 *const baseTime, t_int *const initialized ) {
 	return timeGetTime() - *baseTime;
 #endif
 }
+
+
+/*
+====================
+T_Nanoseconds
+
+A monotonic clock for timing short spans. Only differences are meaningful.
+====================
+*/
+t_uint64 T_Nanoseconds( void ) {
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &counter );
+
+	// Split the conversion so the multiply cannot overflow.
+	return ( t_uint64 )( counter.QuadPart / frequency.QuadPart ) * 1000000000 +
+		( t_uint64 )( counter.QuadPart % frequency.QuadPart ) * 1000000000 / frequency.QuadPart;
+}
+
+
+/*
+====================
+T_ProcessorCount
+====================
+*/
+t_int T_ProcessorCount( void ) {
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors > 0 ? ( t_int )info.dwNumberOfProcessors : 1;
+}
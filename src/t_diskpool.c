@@ -0,0 +1,413 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "t_diskpool.h"
+#include "t_pipe.h"
+#include "tinycthread.h"
+
+#include <string.h>
+
+// Workers take jobs from one shared list and block on the disk as long as it
+// takes. Each finished job goes back through the completion queue it was
+// submitted with, and the queue's event wakes whoever waits on it. The event
+// is only written when the queue goes from quiet to busy, so a reactor that is
+// already draining completions is not woken for every one.
+//
+// Jobs submitted with a key fly once: while one with the same key is queued or
+// running, later ones only wait on it, and when it finishes its job is shared
+// with each of theirs before all of them complete, the first one last.
+
+#if _WIN32
+#	include <windows.h>
+#	define ATOMIC_EXCHANGE( target, value ) InterlockedExchange( ( LONG volatile * )( target ), ( value ) )
+#	define ATOMIC_LOAD( target ) ( *( target ) )
+#	define ATOMIC_STORE( target, value ) InterlockedExchange( ( LONG volatile * )( target ), ( value ) )
+#else
+#	include <errno.h>
+#	include <unistd.h>
+#	define ATOMIC_EXCHANGE( target, value ) __atomic_exchange_n( ( target ), ( value ), __ATOMIC_SEQ_CST )
+#	define ATOMIC_LOAD( target ) __atomic_load_n( ( target ), __ATOMIC_SEQ_CST )
+#	define ATOMIC_STORE( target, value ) __atomic_store_n( ( target ), ( value ), __ATOMIC_SEQ_CST )
+#endif
+
+#if defined( __linux__ )
+#	include <sys/eventfd.h>
+#endif
+
+#define MAX_WORKERS 64
+#define FLIGHT_BUCKETS 256
+
+typedef struct diskTask_s diskTask_t;
+struct diskTask_s {
+	t_diskWork_t work;
+	void *job;
+	t_diskQueue_t *queue;
+	diskTask_t *next; // In the pool's list, or among a task's followers.
+
+	// Keyed tasks only.
+	t_diskShare_t share;
+	const t_byte *key; // Copied just after the task.
+	t_int key_size;
+	t_uint hash;
+	diskTask_t *same_hash; // Next in flight in the same bucket.
+	diskTask_t *followers; // Submitted with the same key while this one was in flight.
+};
+
+struct t_diskPool_s {
+	thrd_t workers[MAX_WORKERS];
+	t_int worker_count;
+	mtx_t mutex;
+	cnd_t condition;
+	diskTask_t *first;
+	diskTask_t *last;
+	diskTask_t *flights[FLIGHT_BUCKETS]; // Keyed tasks queued or running.
+	t_bool stopping;
+};
+
+struct t_diskQueue_s {
+	t_pipe_t *pipe;
+	t_int event; // -1 where there is nothing to wait on.
+	volatile t_int signalled;
+};
+
+
+/*
+====================
+Signal
+====================
+*/
+static void Signal( t_diskQueue_t *const queue ) {
+#if defined( __linux__ )
+	const t_uint64 one = 1;
+
+	if ( ATOMIC_EXCHANGE( &queue->signalled, 1 ) == 0 ) {
+		while ( write( queue->event, &one, sizeof( one ) ) < 0 && errno == EINTR ) {}
+	}
+#else
+	ATOMIC_STORE( &queue->signalled, 1 );
+#endif
+}
+
+
+/*
+====================
+Complete
+====================
+*/
+static void Complete( diskTask_t *const task ) {
+	T_PipeSend( task->queue->pipe, task->job );
+	Signal( task->queue );
+	T_Free( task );
+}
+
+
+/*
+====================
+Land
+
+Takes a finished keyed task out of flight, so later submissions are worked on
+afresh, and shares its job with everything that waited on it.
+====================
+*/
+static void Land( t_diskPool_t *const pool, diskTask_t *const task ) {
+	diskTask_t **link;
+	diskTask_t *follower;
+	diskTask_t *next;
+
+	mtx_lock( &pool->mutex );
+	for ( link = &pool->flights[task->hash % FLIGHT_BUCKETS]; *link != task; link = &( *link )->same_hash ) {}
+	*link = task->same_hash;
+	follower = task->followers;
+	mtx_unlock( &pool->mutex );
+
+	for ( ; follower; follower = next ) {
+		next = follower->next;
+		task->share( task->job, follower->job );
+		Complete( follower );
+	}
+}
+
+
+/*
+====================
+Worker
+====================
+*/
+static t_int Worker( void *arg ) {
+	t_diskPool_t *const pool = ( t_diskPool_t * )arg;
+
+	diskTask_t *task;
+
+	// Whatever the workers allocate is file data on its way out.
+	T_SetMemoryTag( T_TAG_TRANSFER );
+
+	while ( t_true ) {
+		mtx_lock( &pool->mutex );
+		while ( !pool->first && !pool->stopping ) {
+			cnd_wait( &pool->condition, &pool->mutex );
+		}
+		if ( !( task = pool->first ) ) {
+			mtx_unlock( &pool->mutex );
+			break;
+		}
+		if ( !( pool->first = task->next ) ) {
+			pool->last = NULL;
+		}
+		mtx_unlock( &pool->mutex );
+
+		task->work( task->job );
+		if ( task->key ) {
+			Land( pool, task );
+		}
+		Complete( task );
+	}
+
+	T_FlushThreadCache();
+	return 0;
+}
+
+
+/*
+====================
+T_CreateDiskPool
+
+Returns NULL when no worker could be started.
+====================
+*/
+t_diskPool_t *T_CreateDiskPool( const t_int workers ) {
+	t_diskPool_t *const pool = ( t_diskPool_t * )T_Malloc0( sizeof( t_diskPool_t ) );
+	const t_int count = workers < MAX_WORKERS ? workers : MAX_WORKERS;
+
+	mtx_init( &pool->mutex, mtx_plain );
+	cnd_init( &pool->condition );
+
+	while ( pool->worker_count < count && thrd_create( &pool->workers[pool->worker_count], Worker, pool ) == thrd_success ) {
+		++pool->worker_count;
+	}
+
+	if ( pool->worker_count == 0 ) {
+		T_DestroyDiskPool( pool );
+		return NULL;
+	}
+	return pool;
+}
+
+
+/*
+====================
+T_DestroyDiskPool
+
+Jobs already submitted still run and complete before the workers stop.
+====================
+*/
+void T_DestroyDiskPool( t_diskPool_t *const pool ) {
+	t_int i;
+
+	mtx_lock( &pool->mutex );
+	pool->stopping = t_true;
+	cnd_broadcast( &pool->condition );
+	mtx_unlock( &pool->mutex );
+
+	for ( i = 0; i < pool->worker_count; ++i ) {
+		thrd_join( pool->workers[i], NULL );
+	}
+
+	cnd_destroy( &pool->condition );
+	mtx_destroy( &pool->mutex );
+	T_Free( pool );
+}
+
+
+/*
+====================
+T_DiskSubmit
+
+Hands job to a worker, which calls work on it and then sends it to queue.
+Returns false once the pool is stopping.
+====================
+*/
+t_bool T_DiskSubmit( t_diskPool_t *const pool, t_diskQueue_t *const queue, const t_diskWork_t work, void *const job ) {
+	diskTask_t *const task = ( diskTask_t * )T_Malloc( sizeof( diskTask_t ) );
+
+	task->work = work;
+	task->job = job;
+	task->queue = queue;
+	task->next = NULL;
+	task->key = NULL;
+
+	mtx_lock( &pool->mutex );
+	if ( pool->stopping ) {
+		mtx_unlock( &pool->mutex );
+		T_Free( task );
+		return t_false;
+	}
+	if ( pool->last ) {
+		pool->last->next = task;
+	} else {
+		pool->first = task;
+	}
+	pool->last = task;
+	cnd_signal( &pool->condition );
+	mtx_unlock( &pool->mutex );
+	return t_true;
+}
+
+
+/*
+====================
+T_DiskSubmitOnce
+
+Like T_DiskSubmit, unless a job submitted with the same key is queued or
+running: then job is not worked on, but once the other is done, share is
+called with the other job and then this one, and this one is sent to queue.
+Keys are compared byte for byte.
+====================
+*/
+t_bool T_DiskSubmitOnce( t_diskPool_t *const pool, t_diskQueue_t *const queue, const void *const key, const t_int keySize, const t_diskWork_t work, const t_diskShare_t share, void *const job ) {
+	diskTask_t *const task = ( diskTask_t * )T_Malloc( sizeof( diskTask_t ) + keySize );
+	diskTask_t **bucket;
+	diskTask_t *flight;
+
+	task->work = work;
+	task->job = job;
+	task->queue = queue;
+	task->next = NULL;
+	task->share = share;
+	task->key = ( const t_byte * )( task + 1 );
+	task->key_size = keySize;
+	task->hash = T_HashBytes( key, keySize );
+	task->followers = NULL;
+	memcpy( task + 1, key, keySize );
+
+	mtx_lock( &pool->mutex );
+	if ( pool->stopping ) {
+		mtx_unlock( &pool->mutex );
+		T_Free( task );
+		return t_false;
+	}
+	bucket = &pool->flights[task->hash % FLIGHT_BUCKETS];
+	for ( flight = *bucket; flight; flight = flight->same_hash ) {
+		if ( flight->hash == task->hash && flight->key_size == keySize && memcmp( flight->key, key, keySize ) == 0 ) {
+			task->next = flight->followers;
+			flight->followers = task;
+			mtx_unlock( &pool->mutex );
+			return t_true;
+		}
+	}
+	task->same_hash = *bucket;
+	*bucket = task;
+	if ( pool->last ) {
+		pool->last->next = task;
+	} else {
+		pool->first = task;
+	}
+	pool->last = task;
+	cnd_signal( &pool->condition );
+	mtx_unlock( &pool->mutex );
+	return t_true;
+}
+
+
+/*
+====================
+T_CreateDiskQueue
+
+Jobs come back here once their work is done. Only one thread may receive.
+====================
+*/
+t_diskQueue_t *T_CreateDiskQueue( void ) {
+	t_diskQueue_t *const queue = ( t_diskQueue_t * )T_Malloc( sizeof( t_diskQueue_t ) );
+
+	queue->pipe = T_CreatePipe();
+	queue->signalled = 0;
+#if defined( __linux__ )
+	queue->event = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+#else
+	queue->event = -1;
+#endif
+	return queue;
+}
+
+
+/*
+====================
+T_DestroyDiskQueue
+
+Every job sent to the queue must have come back, and the pool that ran them
+must be destroyed first: a worker still signals the queue just after its last
+job can be received.
+====================
+*/
+void T_DestroyDiskQueue( t_diskQueue_t *const queue ) {
+#if defined( __linux__ )
+	if ( queue->event >= 0 ) {
+		close( queue->event );
+	}
+#endif
+	T_DestroyPipe( queue->pipe );
+	T_Free( queue );
+}
+
+
+/*
+====================
+T_DiskQueueGetEvent
+
+Readable while completed jobs are waiting. Returns -1 where there is no such
+descriptor; check back with T_DiskQueueReceive regularly instead.
+====================
+*/
+t_int T_DiskQueueGetEvent( const t_diskQueue_t *const queue ) {
+	return queue->event;
+}
+
+
+/*
+====================
+T_DiskQueueReceive
+
+Hands every completed job to iterate, in the order they completed. Costs
+nothing when none have.
+====================
+*/
+void T_DiskQueueReceive( t_diskQueue_t *const queue, void ( *iterate )( void * ) ) {
+#if defined( __linux__ )
+	t_uint64 count;
+#endif
+
+	if ( ATOMIC_LOAD( &queue->signalled ) == 0 ) {
+		return;
+	}
+
+	// Reset the event before the flag, so a job that finds the flag clear
+	// always leaves the event set behind it.
+#if defined( __linux__ )
+	while ( read( queue->event, &count, sizeof( count ) ) < 0 && errno == EINTR ) {}
+#endif
+	ATOMIC_STORE( &queue->signalled, 0 );
+	T_PipeReceive( queue->pipe, iterate );
+}
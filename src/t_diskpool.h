@@ -0,0 +1,51 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_DISKPOOL_H_
+#define _T_DISKPOOL_H_
+
+#include "t_common.h"
+
+typedef struct t_diskPool_s t_diskPool_t;
+typedef struct t_diskQueue_s t_diskQueue_t;
+
+// Runs on a worker thread, and may block as long as the disk takes.
+typedef void ( *t_diskWork_t )( void *const job );
+// Also on a worker thread: hands what job's work produced to follower.
+typedef void ( *t_diskShare_t )( void *const job, void *const follower );
+
+t_diskPool_t *T_CreateDiskPool( const t_int workers );
+void T_DestroyDiskPool( t_diskPool_t *const pool );
+t_bool T_DiskSubmit( t_diskPool_t *const pool, t_diskQueue_t *const queue, const t_diskWork_t work, void *const job );
+t_bool T_DiskSubmitOnce( t_diskPool_t *const pool, t_diskQueue_t *const queue, const void *const key, const t_int keySize, const t_diskWork_t work, const t_diskShare_t share, void *const job );
+
+// Completions
+t_diskQueue_t *T_CreateDiskQueue( void );
+void T_DestroyDiskQueue( t_diskQueue_t *const queue );
+t_int T_DiskQueueGetEvent( const t_diskQueue_t *const queue );
+void T_DiskQueueReceive( t_diskQueue_t *const queue, void ( *iterate )( void * ) );
+
+#endif // _T_DISKPOOL_H_
@@ -0,0 +1,437 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "t_fdcache.h"
+#include "tinycthread.h"
+
+#include <string.h>
+
+#if _WIN32
+#	include <io.h>
+#	include <fcntl.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+// Files opened read-only by path, kept open for many threads at once, along
+// with what a stat of the path said. For statTimeout after that, the path is
+// taken to still be the same file without asking the filesystem again; later
+// it is checked, and a file that changed is opened anew. Whoever still holds
+// the old descriptor keeps it until released.
+//
+// Files nobody holds are closed, least recently used first, to stay within
+// capacity. When every cached file is held, a new one is opened for its caller
+// alone and closed on release.
+//
+// The open and stat calls are made without the lock, since each may wait on a
+// slow filesystem. Two threads may then open the same file at once; the
+// second to finish uses the first one's descriptor.
+
+#define FD_CACHE_BUCKETS 1024
+
+struct t_cachedFd_s {
+	t_fdCache_t *cache;
+	t_char *path;
+	t_uint hash;
+	t_int descriptor;
+	t_fileKey_t key;
+	t_uint64 checked; // Nanoseconds, when the path was last seen to be this file.
+	t_int references; // One for the cache while listed, and one per holder.
+	t_cachedFd_t *next; // Same bucket.
+	t_cachedFd_t *newer;
+	t_cachedFd_t *older;
+};
+
+struct t_fdCache_s {
+	mtx_t mutex;
+	t_int capacity;
+	t_int count;
+	t_uint64 timeout;
+	t_cachedFd_t *buckets[FD_CACHE_BUCKETS];
+	t_cachedFd_t *newest;
+	t_cachedFd_t *oldest;
+};
+
+
+/*
+====================
+CloseDescriptor
+====================
+*/
+static void CloseDescriptor( const t_int descriptor ) {
+#if _WIN32
+	_close( descriptor );
+#else
+	close( descriptor );
+#endif
+}
+
+
+/*
+====================
+OpenDescriptor
+
+Returns the descriptor of the regular file at path, or -1.
+====================
+*/
+static t_int OpenDescriptor( const t_char *const path, t_fileKey_t *const key ) {
+#if _WIN32
+	const t_int descriptor = _open( path, _O_RDONLY | _O_BINARY );
+#else
+	const t_int descriptor = open( path, O_RDONLY );
+#endif
+
+	if ( descriptor < 0 ) {
+		return -1;
+	}
+	if ( !T_FileKeyFromDescriptor( descriptor, key ) ) {
+		CloseDescriptor( descriptor );
+		return -1;
+	}
+
+#if defined( POSIX_FADV_SEQUENTIAL )
+	// Files are read front to back, so let the kernel read further ahead.
+	posix_fadvise( descriptor, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+	return descriptor;
+}
+
+
+/*
+====================
+SameKey
+====================
+*/
+static t_bool SameKey( const t_fileKey_t *const a, const t_fileKey_t *const b ) {
+	return a->device == b->device && a->inode == b->inode && a->modified == b->modified && a->size == b->size ? t_true : t_false;
+}
+
+
+/*
+====================
+Drop
+
+Lets go of one reference, and closes the file with the last one.
+Called with the mutex held.
+====================
+*/
+static void Drop( t_cachedFd_t *const file ) {
+	if ( --file->references == 0 ) {
+		CloseDescriptor( file->descriptor );
+		T_Free( file );
+	}
+}
+
+
+/*
+====================
+Unlink
+
+Takes a file out of the cache.
+Called with the mutex held.
+====================
+*/
+static void Unlink( t_fdCache_t *const cache, t_cachedFd_t *const file ) {
+	t_cachedFd_t **link;
+
+	for ( link = &cache->buckets[file->hash % FD_CACHE_BUCKETS]; *link != file; link = &( *link )->next ) {}
+	*link = file->next;
+
+	if ( file->newer ) {
+		file->newer->older = file->older;
+	} else {
+		cache->newest = file->older;
+	}
+	if ( file->older ) {
+		file->older->newer = file->newer;
+	} else {
+		cache->oldest = file->newer;
+	}
+
+	--cache->count;
+	Drop( file );
+}
+
+
+/*
+====================
+Find
+
+Called with the mutex held.
+====================
+*/
+static t_cachedFd_t *Find( t_fdCache_t *const cache, const t_char *const path, const t_uint hash ) {
+	t_cachedFd_t *file;
+
+	for ( file = cache->buckets[hash % FD_CACHE_BUCKETS]; file; file = file->next ) {
+		if ( file->hash == hash && strcmp( file->path, path ) == 0 ) {
+			return file;
+		}
+	}
+	return NULL;
+}
+
+
+/*
+====================
+Lookup
+
+Returns the file at path held for the caller, or NULL.
+Called with the mutex held.
+====================
+*/
+static t_cachedFd_t *Lookup( t_fdCache_t *const cache, const t_char *const path, const t_uint hash ) {
+	t_cachedFd_t *const file = Find( cache, path, hash );
+
+	if ( !file ) {
+		return NULL;
+	}
+
+	// Most recently used.
+	if ( cache->newest != file ) {
+		file->newer->older = file->older;
+		if ( file->older ) {
+			file->older->newer = file->newer;
+		} else {
+			cache->oldest = file->newer;
+		}
+		file->newer = NULL;
+		file->older = cache->newest;
+		cache->newest->newer = file;
+		cache->newest = file;
+	}
+
+	++file->references;
+	return file;
+}
+
+
+/*
+====================
+MakeRoom
+
+Closes the least recently used files nobody holds until one more fits.
+Returns false when it does not.
+Called with the mutex held.
+====================
+*/
+static t_bool MakeRoom( t_fdCache_t *const cache ) {
+	t_cachedFd_t *file;
+	t_cachedFd_t *newer;
+
+	for ( file = cache->oldest; file && cache->count >= cache->capacity; file = newer ) {
+		newer = file->newer;
+		if ( file->references == 1 ) {
+			Unlink( cache, file );
+		}
+	}
+	return cache->count < cache->capacity ? t_true : t_false;
+}
+
+
+/*
+====================
+Insert
+
+Caches a file the caller just opened, or hands back the one another thread
+opened first.
+Called with the mutex held.
+====================
+*/
+static t_cachedFd_t *Insert( t_fdCache_t *const cache, const t_char *const path, const t_uint hash, const t_int descriptor, const t_fileKey_t *const key, const t_uint64 now ) {
+	const size_t pathSize = strlen( path ) + 1;
+
+	t_cachedFd_t *file;
+
+	if ( ( file = Find( cache, path, hash ) ) ) {
+		if ( SameKey( &file->key, key ) ) {
+			CloseDescriptor( descriptor );
+			file->checked = now;
+			return Lookup( cache, path, hash );
+		}
+		Unlink( cache, file );
+	}
+
+	file = ( t_cachedFd_t * )T_Malloc( ( t_uint )( sizeof( t_cachedFd_t ) + pathSize ) );
+	file->cache = cache;
+	file->path = ( t_char * )( file + 1 );
+	memcpy( file->path, path, pathSize );
+	file->hash = hash;
+	file->descriptor = descriptor;
+	file->key = *key;
+	file->checked = now;
+	file->next = NULL;
+	file->newer = NULL;
+	file->older = NULL;
+
+	if ( !MakeRoom( cache ) ) {
+		file->references = 1;
+		return file;
+	}
+
+	file->references = 2;
+	file->next = cache->buckets[hash % FD_CACHE_BUCKETS];
+	cache->buckets[hash % FD_CACHE_BUCKETS] = file;
+	file->older = cache->newest;
+	if ( cache->newest ) {
+		cache->newest->newer = file;
+	} else {
+		cache->oldest = file;
+	}
+	cache->newest = file;
+	++cache->count;
+	return file;
+}
+
+
+/*
+====================
+T_CreateFdCache
+
+Keeps up to capacity files open, and trusts what a stat of their paths said
+for statTimeout milliseconds.
+====================
+*/
+t_fdCache_t *T_CreateFdCache( const t_int capacity, const t_int statTimeout ) {
+	t_fdCache_t *const cache = ( t_fdCache_t * )T_Malloc0( sizeof( t_fdCache_t ) );
+
+	if ( mtx_init( &cache->mutex, mtx_plain ) != thrd_success ) {
+		T_Free( cache );
+		return NULL;
+	}
+	cache->capacity = capacity;
+	cache->timeout = ( t_uint64 )statTimeout * 1000000;
+	return cache;
+}
+
+
+/*
+====================
+T_DestroyFdCache
+
+Every file opened must have been released by now.
+====================
+*/
+void T_DestroyFdCache( t_fdCache_t *const cache ) {
+	while ( cache->oldest ) {
+		Unlink( cache, cache->oldest );
+	}
+	mtx_destroy( &cache->mutex );
+	T_Free( cache );
+}
+
+
+/*
+====================
+T_FdCacheOpen
+
+Returns the regular file at path, held for the caller, or NULL.
+====================
+*/
+t_cachedFd_t *T_FdCacheOpen( t_fdCache_t *const cache, const t_char *const path ) {
+	const t_uint hash = T_HashString( path );
+
+	t_cachedFd_t *file;
+	t_fileKey_t key;
+	t_uint64 now;
+	t_int descriptor;
+
+	mtx_lock( &cache->mutex );
+	file = Lookup( cache, path, hash );
+	now = T_Nanoseconds();
+	if ( file && now - file->checked < cache->timeout ) {
+		mtx_unlock( &cache->mutex );
+		return file;
+	}
+	mtx_unlock( &cache->mutex );
+
+	// Time to ask the filesystem whether the path is still the same file.
+	if ( file ) {
+		const t_bool same = T_FileKeyFromPath( path, &key ) && SameKey( &file->key, &key ) ? t_true : t_false;
+
+		mtx_lock( &cache->mutex );
+		if ( same ) {
+			file->checked = now;
+			mtx_unlock( &cache->mutex );
+			return file;
+		}
+
+		// A file that is gone or replaced is closed as soon as nobody holds it.
+		if ( Find( cache, path, hash ) == file ) {
+			Unlink( cache, file );
+		}
+		Drop( file );
+		mtx_unlock( &cache->mutex );
+	}
+
+	if ( ( descriptor = OpenDescriptor( path, &key ) ) < 0 ) {
+		return NULL;
+	}
+
+	mtx_lock( &cache->mutex );
+	file = Insert( cache, path, hash, descriptor, &key, now );
+	mtx_unlock( &cache->mutex );
+	return file;
+}
+
+
+/*
+====================
+T_FdCacheRelease
+====================
+*/
+void T_FdCacheRelease( t_cachedFd_t *const file ) {
+	t_fdCache_t *const cache = file->cache;
+
+	mtx_lock( &cache->mutex );
+	Drop( file );
+	mtx_unlock( &cache->mutex );
+}
+
+
+/*
+====================
+T_CachedFdGet
+
+The descriptor stays open while the file is held. Read it with pread, since
+other holders share its file position.
+====================
+*/
+t_int T_CachedFdGet( const t_cachedFd_t *const file ) {
+	return file->descriptor;
+}
+
+
+/*
+====================
+T_CachedFdKey
+====================
+*/
+const t_fileKey_t *T_CachedFdKey( const t_cachedFd_t *const file ) {
+	return &file->key;
+}
@@ -0,0 +1,42 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_FDCACHE_H_
+#define _T_FDCACHE_H_
+
+#include "t_filecache.h"
+
+typedef struct t_fdCache_s t_fdCache_t;
+typedef struct t_cachedFd_s t_cachedFd_t;
+
+t_fdCache_t *T_CreateFdCache( const t_int capacity, const t_int statTimeout );
+void T_DestroyFdCache( t_fdCache_t *const cache );
+t_cachedFd_t *T_FdCacheOpen( t_fdCache_t *const cache, const t_char *const path );
+void T_FdCacheRelease( t_cachedFd_t *const file );
+t_int T_CachedFdGet( const t_cachedFd_t *const file );
+const t_fileKey_t *T_CachedFdKey( const t_cachedFd_t *const file );
+
+#endif // _T_FDCACHE_H_
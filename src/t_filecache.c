@@ -0,0 +1,411 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "t_filecache.h"
+#include "tinycthread.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#if _WIN32
+typedef struct _stati64 fileInfo_t;
+#else
+typedef struct stat fileInfo_t;
+#endif
+
+// Whole files by path, for many threads at once. Every file is counted against
+// the budget until its memory is freed, including one that was dropped from the
+// cache while still being sent. The least recently used files that nobody holds
+// make room for new ones; when nothing can go, the new file is not cached.
+
+#define FILE_CACHE_BUCKETS 4096
+
+struct t_cachedFile_s {
+	t_fileCache_t *cache;
+	t_char *path;
+	t_uint hash;
+	t_fileKey_t key;
+	t_byte *data;
+	t_int64 bytes; // Charged against the budget.
+	t_int references; // One for the cache while listed, and one per holder.
+	t_cachedFile_t *next; // Same bucket.
+	t_cachedFile_t *newer;
+	t_cachedFile_t *older;
+};
+
+struct t_fileCache_s {
+	mtx_t mutex;
+	t_int64 budget;
+	t_int64 bytes;
+	t_cachedFile_t *buckets[FILE_CACHE_BUCKETS];
+	t_cachedFile_t *newest;
+	t_cachedFile_t *oldest;
+};
+
+
+/*
+====================
+SameKey
+====================
+*/
+static t_bool SameKey( const t_fileKey_t *const a, const t_fileKey_t *const b ) {
+	return a->device == b->device && a->inode == b->inode && a->modified == b->modified && a->size == b->size ? t_true : t_false;
+}
+
+
+/*
+====================
+Drop
+
+Lets go of one reference, and of the file's memory with the last one.
+Called with the mutex held.
+====================
+*/
+static void Drop( t_fileCache_t *const cache, t_cachedFile_t *const file ) {
+	if ( --file->references == 0 ) {
+		cache->bytes -= file->bytes;
+		T_Free( file->data );
+		T_Free( file );
+	}
+}
+
+
+/*
+====================
+Unlink
+
+Takes a file out of the cache. Whoever still holds it keeps it until released.
+Called with the mutex held.
+====================
+*/
+static void Unlink( t_fileCache_t *const cache, t_cachedFile_t *const file ) {
+	t_cachedFile_t **link;
+
+	for ( link = &cache->buckets[file->hash % FILE_CACHE_BUCKETS]; *link != file; link = &( *link )->next ) {}
+	*link = file->next;
+
+	if ( file->newer ) {
+		file->newer->older = file->older;
+	} else {
+		cache->newest = file->older;
+	}
+	if ( file->older ) {
+		file->older->newer = file->newer;
+	} else {
+		cache->oldest = file->newer;
+	}
+
+	Drop( cache, file );
+}
+
+
+/*
+====================
+Lookup
+
+Called with the mutex held.
+====================
+*/
+static t_cachedFile_t *Lookup( t_fileCache_t *const cache, const t_char *const path, const t_uint hash ) {
+	t_cachedFile_t *file;
+
+	for ( file = cache->buckets[hash % FILE_CACHE_BUCKETS]; file; file = file->next ) {
+		if ( file->hash == hash && strcmp( file->path, path ) == 0 ) {
+			return file;
+		}
+	}
+	return NULL;
+}
+
+
+/*
+====================
+Touch
+
+Marks a file as the most recently used.
+Called with the mutex held.
+====================
+*/
+static void Touch( t_fileCache_t *const cache, t_cachedFile_t *const file ) {
+	if ( cache->newest == file ) {
+		return;
+	}
+
+	// Out of its place, which is never the newest.
+	file->newer->older = file->older;
+	if ( file->older ) {
+		file->older->newer = file->newer;
+	} else {
+		cache->oldest = file->newer;
+	}
+
+	file->newer = NULL;
+	file->older = cache->newest;
+	cache->newest->newer = file;
+	cache->newest = file;
+}
+
+
+/*
+====================
+MakeRoom
+
+Drops the least recently used files nobody holds until bytes more fit.
+Returns false when they cannot.
+Called with the mutex held.
+====================
+*/
+static t_bool MakeRoom( t_fileCache_t *const cache, const t_int64 bytes ) {
+	t_cachedFile_t *file;
+	t_cachedFile_t *newer;
+
+	for ( file = cache->oldest; file && cache->bytes + bytes > cache->budget; file = newer ) {
+		newer = file->newer;
+		if ( file->references == 1 ) {
+			Unlink( cache, file );
+		}
+	}
+	return cache->bytes + bytes <= cache->budget ? t_true : t_false;
+}
+
+
+/*
+====================
+FileKey
+====================
+*/
+static void FileKey( const fileInfo_t *const info, t_fileKey_t *const key ) {
+	key->device = ( t_uint64 )info->st_dev;
+	key->inode = ( t_uint64 )info->st_ino;
+#if defined( __linux__ )
+	key->modified = ( t_int64 )info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+#else
+	key->modified = ( t_int64 )info->st_mtime * 1000000000;
+#endif
+	key->size = ( t_int64 )info->st_size;
+}
+
+
+/*
+====================
+T_FileKeyFromPath
+
+Returns false when there is no regular file at path.
+====================
+*/
+t_bool T_FileKeyFromPath( const t_char *const path, t_fileKey_t *const key ) {
+	fileInfo_t info;
+
+#if _WIN32
+	if ( _stati64( path, &info ) != 0 || !( info.st_mode & _S_IFREG ) ) {
+		return t_false;
+	}
+#else
+	if ( stat( path, &info ) != 0 || !S_ISREG( info.st_mode ) ) {
+		return t_false;
+	}
+#endif
+	FileKey( &info, key );
+	return t_true;
+}
+
+
+/*
+====================
+T_FileKeyFromDescriptor
+
+Returns false when descriptor is not a regular file.
+====================
+*/
+t_bool T_FileKeyFromDescriptor( const t_int descriptor, t_fileKey_t *const key ) {
+	fileInfo_t info;
+
+#if _WIN32
+	if ( _fstati64( descriptor, &info ) != 0 || !( info.st_mode & _S_IFREG ) ) {
+		return t_false;
+	}
+#else
+	if ( fstat( descriptor, &info ) != 0 || !S_ISREG( info.st_mode ) ) {
+		return t_false;
+	}
+#endif
+	FileKey( &info, key );
+	return t_true;
+}
+
+
+/*
+====================
+T_CreateFileCache
+
+Keeps whole files in memory, up to budget bytes in all.
+====================
+*/
+t_fileCache_t *T_CreateFileCache( const t_int64 budget ) {
+	t_fileCache_t *const cache = ( t_fileCache_t * )T_Malloc0( sizeof( t_fileCache_t ) );
+
+	if ( mtx_init( &cache->mutex, mtx_plain ) != thrd_success ) {
+		T_Free( cache );
+		return NULL;
+	}
+	cache->budget = budget;
+	return cache;
+}
+
+
+/*
+====================
+T_DestroyFileCache
+
+Every file found or inserted must have been released by now.
+====================
+*/
+void T_DestroyFileCache( t_fileCache_t *const cache ) {
+	while ( cache->oldest ) {
+		Unlink( cache, cache->oldest );
+	}
+	mtx_destroy( &cache->mutex );
+	T_Free( cache );
+}
+
+
+/*
+====================
+T_FileCacheFind
+
+Returns the cached file at path, held for the caller, or NULL. A cached copy
+that no longer matches key is dropped.
+====================
+*/
+t_cachedFile_t *T_FileCacheFind( t_fileCache_t *const cache, const t_char *const path, const t_fileKey_t *const key ) {
+	const t_uint hash = T_HashString( path );
+
+	t_cachedFile_t *file;
+
+	mtx_lock( &cache->mutex );
+	if ( ( file = Lookup( cache, path, hash ) ) ) {
+		if ( SameKey( &file->key, key ) ) {
+			Touch( cache, file );
+			++file->references;
+		} else {
+			Unlink( cache, file );
+			file = NULL;
+		}
+	}
+	mtx_unlock( &cache->mutex );
+	return file;
+}
+
+
+/*
+====================
+T_FileCacheInsert
+
+Caches key->size bytes of data from T_Malloc as the file at path. The cache
+owns data from here on, even when it is not kept. Another thread may have
+cached the same file first, in which case that copy is used.
+Returns the cached file, held for the caller, or NULL when it does not fit.
+====================
+*/
+t_cachedFile_t *T_FileCacheInsert( t_fileCache_t *const cache, const t_char *const path, const t_fileKey_t *const key, t_byte *const data ) {
+	const t_uint hash = T_HashString( path );
+	const size_t pathSize = strlen( path ) + 1;
+	const t_int64 bytes = ( t_int64 )( sizeof( t_cachedFile_t ) + pathSize ) + key->size;
+
+	t_cachedFile_t *file;
+	t_memoryTag_t tag;
+
+	mtx_lock( &cache->mutex );
+	if ( ( file = Lookup( cache, path, hash ) ) ) {
+		if ( SameKey( &file->key, key ) ) {
+			Touch( cache, file );
+			++file->references;
+			mtx_unlock( &cache->mutex );
+			T_Free( data );
+			return file;
+		}
+		Unlink( cache, file );
+	}
+
+	if ( !MakeRoom( cache, bytes ) ) {
+		mtx_unlock( &cache->mutex );
+		T_Free( data );
+		return NULL;
+	}
+
+	tag = T_SetMemoryTag( T_TAG_CACHE );
+	file = ( t_cachedFile_t * )T_Malloc( ( t_uint )( sizeof( t_cachedFile_t ) + pathSize ) );
+	T_SetMemoryTag( tag );
+
+	file->cache = cache;
+	file->path = ( t_char * )( file + 1 );
+	memcpy( file->path, path, pathSize );
+	file->hash = hash;
+	file->key = *key;
+	file->data = data;
+	file->bytes = bytes;
+	file->references = 2;
+
+	file->next = cache->buckets[hash % FILE_CACHE_BUCKETS];
+	cache->buckets[hash % FILE_CACHE_BUCKETS] = file;
+	file->newer = NULL;
+	file->older = cache->newest;
+	if ( cache->newest ) {
+		cache->newest->newer = file;
+	} else {
+		cache->oldest = file;
+	}
+	cache->newest = file;
+	cache->bytes += bytes;
+
+	mtx_unlock( &cache->mutex );
+	return file;
+}
+
+
+/*
+====================
+T_FileCacheRelease
+====================
+*/
+void T_FileCacheRelease( t_cachedFile_t *const file ) {
+	t_fileCache_t *const cache = file->cache;
+
+	mtx_lock( &cache->mutex );
+	Drop( cache, file );
+	mtx_unlock( &cache->mutex );
+}
+
+
+/*
+====================
+T_CachedFileData
+====================
+*/
+const t_byte *T_CachedFileData( const t_cachedFile_t *const file ) {
+	return file->data;
+}
@@ -0,0 +1,54 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_FILECACHE_H_
+#define _T_FILECACHE_H_
+
+#include "t_common.h"
+
+typedef struct t_fileCache_s t_fileCache_t;
+typedef struct t_cachedFile_s t_cachedFile_t;
+
+// What a file was when it was read. A path whose file no longer matches is
+// read again.
+typedef struct {
+	t_uint64 device;
+	t_uint64 inode;
+	t_int64 modified; // Nanoseconds where the platform has them.
+	t_int64 size;
+} t_fileKey_t;
+
+t_bool T_FileKeyFromPath( const t_char *const path, t_fileKey_t *const key );
+t_bool T_FileKeyFromDescriptor( const t_int descriptor, t_fileKey_t *const key );
+
+t_fileCache_t *T_CreateFileCache( const t_int64 budget );
+void T_DestroyFileCache( t_fileCache_t *const cache );
+t_cachedFile_t *T_FileCacheFind( t_fileCache_t *const cache, const t_char *const path, const t_fileKey_t *const key );
+t_cachedFile_t *T_FileCacheInsert( t_fileCache_t *const cache, const t_char *const path, const t_fileKey_t *const key, t_byte *const data );
+void T_FileCacheRelease( t_cachedFile_t *const file );
+const t_byte *T_CachedFileData( const t_cachedFile_t *const file );
+
+#endif // _T_FILECACHE_H_
@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "t_histogram.h"
+
+#include <string.h>
+
+#if _WIN32
+#	include <intrin.h>
+#endif
+
+// Log-linear buckets, in the manner of HDR histograms: every power of two is
+// split into SUB_BUCKETS equal buckets, so any value is known to within one
+// part in SUB_BUCKETS from a few kilobytes of counters, from nanoseconds to
+// centuries. Values below SUB_BUCKETS are counted exactly.
+//
+// Recording is a handful of instructions and never allocates. One thread
+// records; another may read at any time and will at worst see a value that
+// is still being counted.
+
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS ( 1 << SUB_BUCKET_BITS )
+#define BUCKET_COUNT ( ( 64 - SUB_BUCKET_BITS + 1 ) * SUB_BUCKETS )
+
+struct t_histogram_s {
+	volatile t_uint64 counts[BUCKET_COUNT];
+	volatile t_uint64 count;
+	volatile t_uint64 total;
+	volatile t_uint64 max;
+};
+
+
+/*
+====================
+HighestBit
+====================
+*/
+static t_int HighestBit( const t_uint64 value ) {
+#if _WIN32
+	unsigned long index;
+
+	_BitScanReverse64( &index, value );
+	return ( t_int )index;
+#else
+	return 63 - __builtin_clzll( value );
+#endif
+}
+
+
+/*
+====================
+BucketIndex
+====================
+*/
+static t_int BucketIndex( const t_uint64 value ) {
+	t_int shift;
+
+	if ( value < SUB_BUCKETS ) {
+		return ( t_int )value;
+	}
+
+	shift = HighestBit( value ) - SUB_BUCKET_BITS;
+	return ( shift + 1 ) * SUB_BUCKETS + ( t_int )( ( value >> shift ) - SUB_BUCKETS );
+}
+
+
+/*
+====================
+BucketLimit
+
+The largest value that lands in the bucket.
+====================
+*/
+static t_uint64 BucketLimit( const t_int index ) {
+	t_int shift;
+
+	if ( index < SUB_BUCKETS ) {
+		return ( t_uint64 )index;
+	}
+
+	shift = index / SUB_BUCKETS - 1;
+	return ( ( ( t_uint64 )( index % SUB_BUCKETS + SUB_BUCKETS + 1 ) ) << shift ) - 1;
+}
+
+
+/*
+====================
+T_CreateHistogram
+====================
+*/
+t_histogram_t *T_CreateHistogram( void ) {
+	return ( t_histogram_t * )T_Malloc0( sizeof( t_histogram_t ) );
+}
+
+
+/*
+====================
+T_DestroyHistogram
+====================
+*/
+void T_DestroyHistogram( t_histogram_t *const histogram ) {
+	T_Free( histogram );
+}
+
+
+/*
+====================
+T_HistogramRecord
+====================
+*/
+void T_HistogramRecord( t_histogram_t *const histogram, const t_uint64 value ) {
+	++histogram->counts[BucketIndex( value )];
+	++histogram->count;
+	histogram->total += value;
+	if ( value > histogram->max ) {
+		histogram->max = value;
+	}
+}
+
+
+/*
+====================
+T_HistogramReset
+====================
+*/
+void T_HistogramReset( t_histogram_t *const histogram ) {
+	memset( ( void * )histogram, 0, sizeof( t_histogram_t ) );
+}
+
+
+/*
+====================
+T_HistogramAdd
+
+Adds the values recorded in other, such as another thread's histogram.
+====================
+*/
+void T_HistogramAdd( t_histogram_t *const histogram, const t_histogram_t *const other ) {
+	t_int i;
+
+	for ( i = 0; i < BUCKET_COUNT; ++i ) {
+		histogram->counts[i] += other->counts[i];
+	}
+	histogram->count += other->count;
+	histogram->total += other->total;
+	if ( other->max > histogram->max ) {
+		histogram->max = other->max;
+	}
+}
+
+
+/*
+====================
+T_HistogramCount
+====================
+*/
+t_uint64 T_HistogramCount( const t_histogram_t *const histogram ) {
+	return histogram->count;
+}
+
+
+/*
+====================
+T_HistogramMax
+====================
+*/
+t_uint64 T_HistogramMax( const t_histogram_t *const histogram ) {
+	return histogram->max;
+}
+
+
+/*
+====================
+T_HistogramMean
+====================
+*/
+double T_HistogramMean( const t_histogram_t *const histogram ) {
+	return histogram->count > 0 ? ( double )histogram->total / ( double )histogram->count : 0.0;
+}
+
+
+/*
+====================
+T_HistogramPercentile
+
+The value at or below which percentile percent of the recorded values fall,
+rounded up to the top of its bucket. Zero when nothing was recorded.
+====================
+*/
+t_uint64 T_HistogramPercentile( const t_histogram_t *const histogram, const double percentile ) {
+	const t_uint64 count = histogram->count;
+
+	t_uint64 rank;
+	t_uint64 seen = 0;
+	t_uint64 limit;
+	t_int i;
+
+	if ( count == 0 ) {
+		return 0;
+	}
+
+	rank = ( t_uint64 )( percentile / 100.0 * ( double )count + 0.5 );
+	if ( rank < 1 ) {
+		rank = 1;
+	}
+
+	for ( i = 0; i < BUCKET_COUNT; ++i ) {
+		seen += histogram->counts[i];
+		if ( seen >= rank ) {
+			limit = BucketLimit( i );
+			return limit < histogram->max ? limit : histogram->max;
+		}
+	}
+	return histogram->max;
+}
@@ -0,0 +1,44 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_HISTOGRAM_H_
+#define _T_HISTOGRAM_H_
+
+#include "t_common.h"
+
+typedef struct t_histogram_s t_histogram_t;
+
+t_histogram_t *T_CreateHistogram( void );
+void T_DestroyHistogram( t_histogram_t *const histogram );
+void T_HistogramRecord( t_histogram_t *const histogram, const t_uint64 value );
+void T_HistogramReset( t_histogram_t *const histogram );
+void T_HistogramAdd( t_histogram_t *const histogram, const t_histogram_t *const other );
+t_uint64 T_HistogramCount( const t_histogram_t *const histogram );
+t_uint64 T_HistogramMax( const t_histogram_t *const histogram );
+double T_HistogramMean( const t_histogram_t *const histogram );
+t_uint64 T_HistogramPercentile( const t_histogram_t *const histogram, const double percentile );
+
+#endif // _T_HISTOGRAM_H_
@@ -27,156 +27,208 @@ THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "t_pipe.h"
 
-#include "tinycthread.h"
-
 #include <stdlib.h>
 
-typedef struct __linked_pipe_data_s __linked_pipe_data_t;
-typedef struct __linked_pipe_data_s {
+// Any number of threads may send; only one thread may receive.
+// Senders never lock: they swap themselves in as the newest node, then link
+// the previous newest to it. Nodes are pooled, so a busy pipe stops allocating
+// once it reaches its largest backlog.
+
+#if _WIN32
+#	include <windows.h>
+#	define ATOMIC_EXCHANGE( target, value ) InterlockedExchangePointer( ( PVOID volatile * )( target ), ( value ) )
+#	define ATOMIC_COMPARE_EXCHANGE( target, expected, value ) \
+	( InterlockedCompareExchangePointer( ( PVOID volatile * )( target ), ( value ), ( expected ) ) == ( expected ) )
+#	define ATOMIC_LOAD( target ) ( *( target ) )
+#	define ATOMIC_STORE( target, value ) ( *( target ) = ( value ) )
+#else
+#	define ATOMIC_EXCHANGE( target, value ) __atomic_exchange_n( ( target ), ( value ), __ATOMIC_ACQ_REL )
+#	define ATOMIC_COMPARE_EXCHANGE( target, expected, value ) \
+	__sync_bool_compare_and_swap( ( target ), ( expected ), ( value ) )
+#	define ATOMIC_LOAD( target ) __atomic_load_n( ( target ), __ATOMIC_ACQUIRE )
+#	define ATOMIC_STORE( target, value ) __atomic_store_n( ( target ), ( value ), __ATOMIC_RELEASE )
+#endif
+
+typedef struct t_pipeNode_s t_pipeNode_t;
+typedef struct t_pipeNode_s {
+	t_pipeNode_t *volatile next;
 	void *data;
-	__linked_pipe_data_t *next;
-} __linked_pipe_data_t;
+} t_pipeNode_t;
 
 struct t_pipe_s {
-	void *data;
-	mtx_t mutex;
-	mtx_t mutexBuffer;
-	__linked_pipe_data_t *linked;
-	__linked_pipe_data_t *linkedBuffer;
-	__linked_pipe_data_t *last;
-	__linked_pipe_data_t *lastBuffer;
-};
+	// Newest node, where senders append.
+	t_pipeNode_t *volatile head;
 
+	// Oldest node, owned by the receiver.
+	t_pipeNode_t *tail;
+
+	// Always in the queue when it would otherwise be empty.
+	t_pipeNode_t stub;
+
+	// Nodes ready for reuse.
+	t_pipeNode_t *volatile free;
+};
 
 
 /*
 ====================
-T_PipeInit
+T_CreatePipe
 ====================
 */
 t_pipe_t *T_CreatePipe( void ) {
-	t_pipe_t *pipe = ( t_pipe_t * )T_Malloc( sizeof( t_pipe_t ) );
+	t_pipe_t *const pipe = ( t_pipe_t * )T_Malloc( sizeof( t_pipe_t ) );
 
-	if ( mtx_init( &pipe->mutex, mtx_try ) != thrd_success ) {
-		return NULL;
-	}
-	if ( mtx_init( &pipe->mutexBuffer, mtx_try ) != thrd_success ) {
-		return NULL;
-	}
-
-	pipe->data = pipe;
-	pipe->linked = NULL;
-	pipe->linkedBuffer = NULL;
-	pipe->last = NULL;
-	pipe->lastBuffer = NULL;
+	pipe->stub.next = NULL;
+	pipe->stub.data = NULL;
+	pipe->head = &pipe->stub;
+	pipe->tail = &pipe->stub;
+	pipe->free = NULL;
 	return pipe;
 }
 
 
 /*
 ====================
-SendBuffer
+AllocNode
+
+Takes the whole free list at once, which cannot be fooled by a node that was
+reused in between, keeps the first node and puts the rest back.
 ====================
 */
-static void SendBuffer( t_pipe_t *const pipe, void *const message ) {
-	if ( pipe->linkedBuffer ) {
-		pipe->lastBuffer->next = T_Malloc( sizeof( __linked_pipe_data_t ) );
-		pipe->lastBuffer = pipe->lastBuffer->next;
-	} else {
-		pipe->linkedBuffer = T_Malloc( sizeof( __linked_pipe_data_t ) );
-		pipe->lastBuffer = pipe->linkedBuffer;
+static t_pipeNode_t *AllocNode( t_pipe_t *const pipe ) {
+	t_pipeNode_t *const node = ( t_pipeNode_t * )ATOMIC_EXCHANGE( &pipe->free, NULL );
+
+	t_pipeNode_t *rest;
+	t_pipeNode_t *last;
+	t_pipeNode_t *top;
+
+	if ( !node ) {
+		const t_memoryTag_t tag = T_SetMemoryTag( T_TAG_PIPE );
+
+		top = ( t_pipeNode_t * )T_Malloc( sizeof( t_pipeNode_t ) );
+		T_SetMemoryTag( tag );
+		return top;
 	}
-	pipe->lastBuffer->data = message;
-	pipe->lastBuffer->next = NULL;
+
+	rest = node->next;
+	if ( rest && !ATOMIC_COMPARE_EXCHANGE( &pipe->free, NULL, rest ) ) {
+		// Nodes were freed meanwhile; chain them after ours.
+		for ( last = rest; last->next; last = last->next );
+		do {
+			top = ATOMIC_LOAD( &pipe->free );
+			last->next = top;
+		} while ( !ATOMIC_COMPARE_EXCHANGE( &pipe->free, top, rest ) );
+	}
+	return node;
 }
 
 
 /*
 ====================
-Send
+FreeNode
 ====================
 */
-static void Send( t_pipe_t *const pipe, void *const message ) {
-	if ( pipe->linked ) {
-		pipe->last->next = T_Malloc( sizeof( __linked_pipe_data_t ) );
-		pipe->last = pipe->last->next;
-	} else {
-		pipe->linked = T_Malloc( sizeof( __linked_pipe_data_t ) );
-		pipe->last = pipe->linked;
-	}
-	pipe->last->data = message;
-	pipe->last->next = NULL;
+static void FreeNode( t_pipe_t *const pipe, t_pipeNode_t *const node ) {
+	t_pipeNode_t *top;
+
+	do {
+		top = ATOMIC_LOAD( &pipe->free );
+		node->next = top;
+	} while ( !ATOMIC_COMPARE_EXCHANGE( &pipe->free, top, node ) );
 }
 
 
 /*
 ====================
-T_PipeSend
+Push
 ====================
 */
-t_bool T_PipeSend( t_pipe_t *const pipe, void *const message ) {
-	if ( mtx_trylock( &pipe->mutex ) != thrd_success ) {
-		mtx_lock( &pipe->mutexBuffer );
-		SendBuffer( pipe, message );
-		mtx_unlock( &pipe->mutexBuffer );
-		return t_false;
-	}
+static void Push( t_pipe_t *const pipe, t_pipeNode_t *const node ) {
+	t_pipeNode_t *previous;
 
-	Send( pipe, message );
-	mtx_unlock( &pipe->mutex );
-	return t_true;
+	node->next = NULL;
+	previous = ( t_pipeNode_t * )ATOMIC_EXCHANGE( &pipe->head, node );
+
+	// Until this store the receiver sees the queue end at previous.
+	ATOMIC_STORE( &previous->next, node );
 }
 
 
 /*
 ====================
-ReceiveBuffer
+Pop
+
+Returns the oldest node, or NULL when the pipe is empty or the next sender
+has not finished linking its node yet.
 ====================
 */
-static void ReceiveBuffer( t_pipe_t *const pipe ) {
-	if ( pipe->linkedBuffer ) {
-		pipe->lastBuffer->next = pipe->linked;
-		pipe->linked = pipe->linkedBuffer;
-		pipe->linkedBuffer = NULL;
-		pipe->lastBuffer = NULL;
+static t_pipeNode_t *Pop( t_pipe_t *const pipe ) {
+	t_pipeNode_t *tail = pipe->tail;
+	t_pipeNode_t *next = ATOMIC_LOAD( &tail->next );
+
+	if ( tail == &pipe->stub ) {
+		if ( !next ) {
+			return NULL;
+		}
+		pipe->tail = next;
+		tail = next;
+		next = ATOMIC_LOAD( &tail->next );
+	}
+
+	if ( next ) {
+		pipe->tail = next;
+		return tail;
+	}
+
+	if ( tail != ATOMIC_LOAD( &pipe->head ) ) {
+		return NULL;
 	}
+
+	// tail is the last node; queue the stub behind it so it can be taken.
+	Push( pipe, &pipe->stub );
+
+	next = ATOMIC_LOAD( &tail->next );
+	if ( next ) {
+		pipe->tail = next;
+		return tail;
+	}
+	return NULL;
 }
 
 
 /*
 ====================
-__T_PipeReceive_iterate
+T_PipeSend
+
+Never blocks. Always returns true.
 ====================
 */
-static void __T_PipeReceive_iterate( __linked_pipe_data_t *linked, void ( *iterate )( void * ) ) {
-	if ( !linked ) {
-		return;
-	}
+t_bool T_PipeSend( t_pipe_t *const pipe, void *const message ) {
+	t_pipeNode_t *const node = AllocNode( pipe );
 
-	iterate( linked->data );
-	__T_PipeReceive_iterate( linked->next, iterate );
-	T_Free( linked );
+	node->data = message;
+	Push( pipe, node );
+	return t_true;
 }
 
 
 /*
 ====================
 T_PipeReceive
+
+Hands every waiting message to iterate, oldest first. Only one thread may
+receive from a pipe.
 ====================
 */
 t_bool T_PipeReceive( t_pipe_t *const pipe, void ( *iterate )( void * ) ) {
-	if ( mtx_trylock( &pipe->mutex ) != thrd_success ) {
-		return t_false;
-	}
-
-	mtx_lock( &pipe->mutexBuffer );
-	ReceiveBuffer( pipe );
-	mtx_unlock( &pipe->mutexBuffer );
-
-	__T_PipeReceive_iterate( pipe->linked, iterate );
-	pipe->linked = NULL;
+	t_pipeNode_t *node;
+	void *data;
 
-	mtx_unlock( &pipe->mutex );
+	while ( ( node = Pop( pipe ) ) ) {
+		data = node->data;
+		FreeNode( pipe, node );
+		iterate( data );
+	}
 	return t_true;
 }
 
@@ -185,11 +237,20 @@ t_bool T_PipeReceive( t_pipe_t *const pipe, void ( *iterate )( void * ) ) {
 ====================
 T_DestroyPipe
 
-TODO: free linked list
+Messages still in the pipe are dropped; their memory belongs to the caller.
 ====================
 */
 void T_DestroyPipe( t_pipe_t *const pipe ) {
-	mtx_destroy( &pipe->mutex );
-	mtx_destroy( &pipe->mutexBuffer );
+	t_pipeNode_t *node;
+	t_pipeNode_t *next;
+
+	while ( ( node = Pop( pipe ) ) ) {
+		T_Free( node );
+	}
+
+	for ( node = pipe->free; node; node = next ) {
+		next = node->next;
+		T_Free( node );
+	}
 	T_Free( pipe );
 }
@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "t_ring.h"
+
+#include <string.h>
+
+// Bytes live between the read and write counters. The counters only grow and
+// are masked into the buffer, so a full ring and an empty one never look alike.
+struct t_ring_s {
+	t_byte *buffer;
+	t_uint capacity;
+	t_uint mask;
+	t_uint read;
+	t_uint write;
+};
+
+
+/*
+====================
+T_CreateRing
+
+The capacity is size rounded up to a power of two.
+====================
+*/
+t_ring_t *T_CreateRing( const t_int size ) {
+	t_ring_t *const ring = ( t_ring_t * )T_Malloc( sizeof( t_ring_t ) );
+
+	t_uint capacity = 1;
+
+	while ( capacity < ( t_uint )size ) {
+		capacity <<= 1;
+	}
+
+	ring->buffer = ( t_byte * )T_Malloc( capacity );
+	ring->capacity = capacity;
+	ring->mask = capacity - 1;
+	ring->read = 0;
+	ring->write = 0;
+	return ring;
+}
+
+
+/*
+====================
+T_DestroyRing
+====================
+*/
+void T_DestroyRing( t_ring_t *const ring ) {
+	T_Free( ring->buffer );
+	T_Free( ring );
+}
+
+
+/*
+====================
+T_RingGetSize
+
+Bytes waiting to be read.
+====================
+*/
+t_int T_RingGetSize( const t_ring_t *const ring ) {
+	return ( t_int )( ring->write - ring->read );
+}
+
+
+/*
+====================
+T_RingGetSpace
+====================
+*/
+t_int T_RingGetSpace( const t_ring_t *const ring ) {
+	return ( t_int )( ring->capacity - ( ring->write - ring->read ) );
+}
+
+
+/*
+====================
+T_RingGetWriteBuffer
+
+The free bytes that follow the write position without wrapping, so a socket
+can receive straight into the ring. Call T_RingCommit with what was written.
+====================
+*/
+t_byte *T_RingGetWriteBuffer( t_ring_t *const ring, t_int *const size ) {
+	const t_uint position = ring->write & ring->mask;
+	const t_uint space = ring->capacity - ( ring->write - ring->read );
+	const t_uint contiguous = ring->capacity - position;
+
+	*size = ( t_int )( space < contiguous ? space : contiguous );
+	return ring->buffer + position;
+}
+
+
+/*
+====================
+T_RingCommit
+====================
+*/
+void T_RingCommit( t_ring_t *const ring, const t_int size ) {
+	ring->write += size;
+}
+
+
+/*
+====================
+T_RingWrite
+
+Returns false, and writes nothing, when there is not room for all of it.
+====================
+*/
+t_bool T_RingWrite( t_ring_t *const ring, const t_byte *const buffer, const t_int size ) {
+	const t_uint position = ring->write & ring->mask;
+	const t_uint first = ring->capacity - position < ( t_uint )size ? ring->capacity - position : ( t_uint )size;
+
+	if ( size > T_RingGetSpace( ring ) ) {
+		return t_false;
+	}
+
+	memcpy( ring->buffer + position, buffer, first );
+	memcpy( ring->buffer, buffer + first, size - first );
+	ring->write += size;
+	return t_true;
+}
+
+
+/*
+====================
+T_RingPeek
+
+Points at size bytes starting offset bytes past the read position. They are
+read in place, unless they wrap around the end of the ring; then they are
+copied into scratch, which must hold size bytes.
+====================
+*/
+const t_byte *T_RingPeek( const t_ring_t *const ring, const t_int offset, const t_int size, t_byte *const scratch ) {
+	const t_uint position = ( ring->read + offset ) & ring->mask;
+	const t_uint first = ring->capacity - position;
+
+	if ( ( t_uint )size <= first ) {
+		return ring->buffer + position;
+	}
+
+	memcpy( scratch, ring->buffer + position, first );
+	memcpy( scratch + first, ring->buffer, size - first );
+	return scratch;
+}
+
+
+/*
+====================
+T_RingSkip
+====================
+*/
+void T_RingSkip( t_ring_t *const ring, const t_int size ) {
+	ring->read += size;
+}
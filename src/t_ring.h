@@ -0,0 +1,44 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_RING_H_
+#define _T_RING_H_
+
+#include "t_common.h"
+
+typedef struct t_ring_s t_ring_t;
+
+t_ring_t *T_CreateRing( const t_int size );
+void T_DestroyRing( t_ring_t *const ring );
+t_int T_RingGetSize( const t_ring_t *const ring );
+t_int T_RingGetSpace( const t_ring_t *const ring );
+t_byte *T_RingGetWriteBuffer( t_ring_t *const ring, t_int *const size );
+void T_RingCommit( t_ring_t *const ring, const t_int size );
+t_bool T_RingWrite( t_ring_t *const ring, const t_byte *const buffer, const t_int size );
+const t_byte *T_RingPeek( const t_ring_t *const ring, const t_int offset, const t_int size, t_byte *const scratch );
+void T_RingSkip( t_ring_t *const ring, const t_int size );
+
+#endif // _T_RING_H_
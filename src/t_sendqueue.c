@@ -0,0 +1,515 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "t_sendqueue.h"
+
+#include <string.h>
+
+#if _WIN32
+#	include <io.h>
+#endif
+
+#define FILE_ENDED ( SOCKET_ERROR - 1 ) // A file segment's file is shorter than what was queued.
+
+typedef enum {
+	SEGMENT_INLINE,
+	SEGMENT_HEAP,
+	SEGMENT_SHARED,
+	SEGMENT_FILE,
+	SEGMENT_DESCRIPTOR
+} segmentKind_t;
+
+// A file segment is sent from offset; a memory segment from position. A
+// descriptor segment is inline bytes that carry an open descriptor; once its
+// first byte is out it is plain inline bytes. A shared segment is memory the
+// queue does not own, handed back through release once it has left.
+typedef struct {
+	segmentKind_t kind;
+	t_int size;
+	t_int position;
+	t_int file;
+	t_int64 offset;
+	t_byte *heap;
+	const t_byte *shared;
+	t_sendRelease_t release;
+	void *context;
+	t_byte data[T_SEND_INLINE_SIZE];
+} segment_t;
+
+// Segments wait in a fixed ring in the order they go out. The byte counters
+// only grow, so a caller can remember where something was queued and later
+// tell whether it has left, without a callback.
+struct t_sendQueue_s {
+	segment_t *segments;
+	t_int capacity;
+	t_int first;
+	t_int count;
+	t_uint64 queued;
+	t_uint64 sent;
+};
+
+
+/*
+====================
+T_CreateSendQueue
+====================
+*/
+t_sendQueue_t *T_CreateSendQueue( const t_int segments ) {
+	t_sendQueue_t *const queue = ( t_sendQueue_t * )T_Malloc( sizeof( t_sendQueue_t ) );
+
+	queue->segments = ( segment_t * )T_Malloc( sizeof( segment_t ) * segments );
+	queue->capacity = segments;
+	queue->first = 0;
+	queue->count = 0;
+	queue->queued = 0;
+	queue->sent = 0;
+	return queue;
+}
+
+
+/*
+====================
+CloseDescriptor
+====================
+*/
+static void CloseDescriptor( const t_int descriptor ) {
+#if _WIN32
+	_close( descriptor );
+#else
+	close( descriptor );
+#endif
+}
+
+
+/*
+====================
+T_DestroySendQueue
+====================
+*/
+void T_DestroySendQueue( t_sendQueue_t *const queue ) {
+	t_int i;
+
+	for ( i = 0; i < queue->count; ++i ) {
+		segment_t *const segment = &queue->segments[( queue->first + i ) % queue->capacity];
+
+		if ( segment->kind == SEGMENT_HEAP ) {
+			T_Free( segment->heap );
+		} else if ( segment->kind == SEGMENT_SHARED ) {
+			segment->release( segment->context );
+		} else if ( segment->kind == SEGMENT_DESCRIPTOR ) {
+			CloseDescriptor( segment->file );
+		}
+	}
+	T_Free( queue->segments );
+	T_Free( queue );
+}
+
+
+/*
+====================
+PushSegment
+
+Empty segments are never queued, since sending nothing looks like a closed socket.
+====================
+*/
+static segment_t *PushSegment( t_sendQueue_t *const queue, const segmentKind_t kind, const t_int size ) {
+	segment_t *segment;
+
+	if ( queue->count == queue->capacity ) {
+		return NULL;
+	}
+
+	segment = &queue->segments[( queue->first + queue->count ) % queue->capacity];
+	segment->kind = kind;
+	segment->size = size;
+	segment->position = 0;
+	++queue->count;
+	queue->queued += size;
+	return segment;
+}
+
+
+/*
+====================
+SegmentMemory
+
+Where a memory segment's bytes are.
+====================
+*/
+static const t_byte *SegmentMemory( const segment_t *const segment ) {
+	switch ( segment->kind ) {
+	case SEGMENT_HEAP:
+		return segment->heap;
+	case SEGMENT_SHARED:
+		return segment->shared;
+	default:
+		return segment->data;
+	}
+}
+
+
+/*
+====================
+PopSegment
+====================
+*/
+static void PopSegment( t_sendQueue_t *const queue ) {
+	segment_t *const segment = &queue->segments[queue->first];
+
+	if ( segment->kind == SEGMENT_HEAP ) {
+		T_Free( segment->heap );
+	} else if ( segment->kind == SEGMENT_SHARED ) {
+		segment->release( segment->context );
+	}
+	queue->first = ( queue->first + 1 ) % queue->capacity;
+	--queue->count;
+}
+
+
+/*
+====================
+T_SendQueueBuffer
+
+Copies the bytes, so the caller's buffer can be reused right away.
+Returns false when the queue is full.
+====================
+*/
+t_bool T_SendQueueBuffer( t_sendQueue_t *const queue, const t_byte *const buffer, const t_int size ) {
+	segment_t *segment;
+
+	if ( size == 0 ) {
+		return t_true;
+	}
+	if ( !( segment = PushSegment( queue, size > T_SEND_INLINE_SIZE ? SEGMENT_HEAP : SEGMENT_INLINE, size ) ) ) {
+		return t_false;
+	}
+
+	if ( segment->kind == SEGMENT_HEAP ) {
+		segment->heap = ( t_byte * )T_Malloc( size );
+		memcpy( segment->heap, buffer, size );
+	} else {
+		memcpy( segment->data, buffer, size );
+	}
+	return t_true;
+}
+
+
+/*
+====================
+T_SendQueueShared
+
+Queues bytes owned by someone else, such as a buffer several queues send at
+once, without copying them. The bytes must stay put until release( context )
+is called, once they have been sent or the queue is destroyed. When the queue
+is full, release is called right away.
+Returns false when the queue is full.
+====================
+*/
+t_bool T_SendQueueShared( t_sendQueue_t *const queue, const t_byte *const buffer, const t_int size, const t_sendRelease_t release, void *const context ) {
+	segment_t *segment;
+
+	if ( size == 0 || !( segment = PushSegment( queue, SEGMENT_SHARED, size ) ) ) {
+		release( context );
+		return size == 0 ? t_true : t_false;
+	}
+
+	segment->shared = buffer;
+	segment->release = release;
+	segment->context = context;
+	return t_true;
+}
+
+
+/*
+====================
+T_SendQueueFile
+
+Queues size bytes of an open file from offset. The file is read when the
+segment goes out, so it must stay open until then.
+Returns false when the queue is full.
+====================
+*/
+t_bool T_SendQueueFile( t_sendQueue_t *const queue, const t_int file, const t_int64 offset, const t_int size ) {
+	segment_t *segment;
+
+	if ( size == 0 ) {
+		return t_true;
+	}
+	if ( !( segment = PushSegment( queue, SEGMENT_FILE, size ) ) ) {
+		return t_false;
+	}
+
+	segment->file = file;
+	segment->offset = offset;
+	return t_true;
+}
+
+
+/*
+====================
+T_SendQueueDescriptor
+
+Queues bytes, at most T_SEND_INLINE_SIZE, that go out with descriptor attached.
+The queue owns the descriptor from here on and closes it once it has been sent.
+Returns false when the queue is full; the descriptor is left to the caller.
+====================
+*/
+t_bool T_SendQueueDescriptor( t_sendQueue_t *const queue, const t_byte *const buffer, const t_int size, const t_int descriptor ) {
+	segment_t *segment;
+
+	if ( size <= 0 || size > T_SEND_INLINE_SIZE || !( segment = PushSegment( queue, SEGMENT_DESCRIPTOR, size ) ) ) {
+		return t_false;
+	}
+
+	memcpy( segment->data, buffer, size );
+	segment->file = descriptor;
+	return t_true;
+}
+
+
+/*
+====================
+SendDescriptorSegment
+====================
+*/
+static t_int SendDescriptorSegment( t_sendQueue_t *const queue, const SOCKET socket, t_bool *const partial ) {
+	segment_t *const segment = &queue->segments[queue->first];
+	const t_int sent = T_SendDescriptors( socket, segment->data, segment->size, &segment->file, 1 );
+
+	if ( sent <= 0 ) {
+		return sent;
+	}
+
+	// The receiver has the descriptor now; any bytes left are ordinary.
+	CloseDescriptor( segment->file );
+	segment->kind = SEGMENT_INLINE;
+	segment->position = sent;
+	if ( segment->position == segment->size ) {
+		PopSegment( queue );
+	} else {
+		*partial = t_true;
+	}
+	return sent;
+}
+
+
+/*
+====================
+SendFileSegment
+
+Returns FILE_ENDED when the file has no more bytes to send.
+====================
+*/
+static t_int SendFileSegment( t_sendQueue_t *const queue, const SOCKET socket ) {
+	segment_t *const segment = &queue->segments[queue->first];
+	const t_int sent = T_SendFile( socket, segment->file, &segment->offset, segment->size );
+
+	if ( sent <= 0 ) {
+		// Nothing at all means the file is shorter than what was queued.
+		return sent == 0 ? FILE_ENDED : sent;
+	}
+
+	segment->size -= sent;
+	if ( segment->size == 0 ) {
+		PopSegment( queue );
+	}
+	return sent;
+}
+
+
+/*
+====================
+SendMemorySegments
+
+Gathers the memory segments at the front of the queue into a single send.
+====================
+*/
+static t_int SendMemorySegments( t_sendQueue_t *const queue, const SOCKET socket, t_bool *const partial ) {
+	t_sendBuffer_t buffers[T_MAX_SEND_BUFFERS];
+	t_bool more = t_false;
+	t_int total = 0;
+	t_int count = 0;
+	t_int sent;
+	t_int left;
+
+	while ( count < queue->count && count < T_MAX_SEND_BUFFERS ) {
+		const segment_t *const segment = &queue->segments[( queue->first + count ) % queue->capacity];
+
+		if ( segment->kind == SEGMENT_FILE ) {
+			more = t_true;
+			break;
+		}
+		if ( segment->kind == SEGMENT_DESCRIPTOR ) {
+			break;
+		}
+
+		buffers[count].buffer = SegmentMemory( segment ) + segment->position;
+		buffers[count].size = segment->size - segment->position;
+		total += buffers[count].size;
+		++count;
+	}
+
+	if ( ( sent = T_SendVector( socket, buffers, count, more ) ) <= 0 ) {
+		return sent;
+	}
+
+	for ( left = sent; left > 0; ) {
+		segment_t *const segment = &queue->segments[queue->first];
+		const t_int remaining = segment->size - segment->position;
+
+		if ( left < remaining ) {
+			segment->position += left;
+			break;
+		}
+		left -= remaining;
+		PopSegment( queue );
+	}
+
+	*partial = sent < total ? t_true : t_false;
+	return sent;
+}
+
+
+/*
+====================
+T_SendQueueFlush
+
+Sends as much as the socket will take. Whatever is left stays queued; wait
+until the socket is writable and flush again.
+Returns false on a hard socket error, or when a queued file range runs past
+the end of its file.
+====================
+*/
+t_bool T_SendQueueFlush( t_sendQueue_t *const queue, const SOCKET socket ) {
+	while ( queue->count > 0 ) {
+		t_bool partial = t_false;
+		t_int sent;
+
+		if ( queue->segments[queue->first].kind == SEGMENT_FILE ) {
+			sent = SendFileSegment( queue, socket );
+		} else if ( queue->segments[queue->first].kind == SEGMENT_DESCRIPTOR ) {
+			sent = SendDescriptorSegment( queue, socket, &partial );
+		} else {
+			sent = SendMemorySegments( queue, socket, &partial );
+		}
+
+		if ( sent == FILE_ENDED ) {
+			return t_false;
+		}
+		if ( sent == SOCKET_ERROR ) {
+			return T_SocketWouldBlock();
+		}
+		if ( sent == 0 ) {
+			return t_false;
+		}
+
+		queue->sent += sent;
+		if ( partial ) {
+			// The socket buffer is full; trying again now would only fail.
+			break;
+		}
+	}
+	return t_true;
+}
+
+
+/*
+====================
+T_SendQueueFlushShared
+
+Moves as much as fits into a shared ring instead of a socket. File segments
+are read straight into the ring. Descriptors cannot travel this way.
+Returns false when a file could not be read or a descriptor was queued.
+====================
+*/
+t_bool T_SendQueueFlushShared( t_sendQueue_t *const queue, t_shmRing_t *const ring ) {
+	while ( queue->count > 0 ) {
+		segment_t *const segment = &queue->segments[queue->first];
+
+		t_int written;
+
+		if ( segment->kind == SEGMENT_DESCRIPTOR ) {
+			return t_false;
+		}
+
+		if ( segment->kind == SEGMENT_FILE ) {
+			if ( ( written = T_ShmRingWriteFile( ring, segment->file, segment->offset, segment->size ) ) < 0 ) {
+				return t_false;
+			}
+			segment->offset += written;
+			segment->size -= written;
+		} else {
+			written = T_ShmRingWrite( ring, SegmentMemory( segment ) + segment->position, segment->size - segment->position );
+			segment->position += written;
+		}
+
+		if ( written == 0 ) {
+			// The ring is full.
+			break;
+		}
+
+		queue->sent += written;
+		if ( ( segment->kind == SEGMENT_FILE && segment->size == 0 ) || ( segment->kind != SEGMENT_FILE && segment->position == segment->size ) ) {
+			PopSegment( queue );
+		}
+	}
+	return t_true;
+}
+
+
+/*
+====================
+T_SendQueueIsEmpty
+====================
+*/
+t_bool T_SendQueueIsEmpty( const t_sendQueue_t *const queue ) {
+	return queue->count == 0 ? t_true : t_false;
+}
+
+
+/*
+====================
+T_SendQueueGetQueued
+
+Total bytes ever queued.
+====================
+*/
+t_uint64 T_SendQueueGetQueued( const t_sendQueue_t *const queue ) {
+	return queue->queued;
+}
+
+
+/*
+====================
+T_SendQueueGetSent
+
+Total bytes ever sent. Everything queued before GetQueued returned n has left
+once this reaches n.
+====================
+*/
+t_uint64 T_SendQueueGetSent( const t_sendQueue_t *const queue ) {
+	return queue->sent;
+}
@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_SENDQUEUE_H_
+#define _T_SENDQUEUE_H_
+
+#include "t_socket.h"
+#include "t_shmring.h"
+
+// Memory segments up to this size are copied into the queue itself.
+#define T_SEND_INLINE_SIZE 32
+
+typedef struct t_sendQueue_s t_sendQueue_t;
+
+// Hands shared bytes back once the queue is done with them.
+typedef void ( *t_sendRelease_t )( void *const context );
+
+t_sendQueue_t *T_CreateSendQueue( const t_int segments );
+void T_DestroySendQueue( t_sendQueue_t *const queue );
+t_bool T_SendQueueBuffer( t_sendQueue_t *const queue, const t_byte *const buffer, const t_int size );
+t_bool T_SendQueueShared( t_sendQueue_t *const queue, const t_byte *const buffer, const t_int size, const t_sendRelease_t release, void *const context );
+t_bool T_SendQueueFile( t_sendQueue_t *const queue, const t_int file, const t_int64 offset, const t_int size );
+t_bool T_SendQueueDescriptor( t_sendQueue_t *const queue, const t_byte *const buffer, const t_int size, const t_int descriptor );
+t_bool T_SendQueueFlush( t_sendQueue_t *const queue, const SOCKET socket );
+t_bool T_SendQueueFlushShared( t_sendQueue_t *const queue, t_shmRing_t *const ring );
+t_bool T_SendQueueIsEmpty( const t_sendQueue_t *const queue );
+t_uint64 T_SendQueueGetQueued( const t_sendQueue_t *const queue );
+t_uint64 T_SendQueueGetSent( const t_sendQueue_t *const queue );
+
+#endif // _T_SENDQUEUE_H_
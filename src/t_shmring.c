@@ -0,0 +1,481 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "t_shmring.h"
+
+#if defined( __linux__ )
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define SHMRING_MAGIC 0x544d5253 // "SRMT"
+#define HEADER_SIZE 4096 // One page, so the data starts page aligned.
+#define MIN_SIZE 4096
+#define MAX_SIZE ( 1 << 30 )
+#define CACHE_LINE 64
+
+#define ATOMIC_LOAD( target ) __atomic_load_n( ( target ), __ATOMIC_ACQUIRE )
+#define ATOMIC_STORE( target, value ) __atomic_store_n( ( target ), ( value ), __ATOMIC_RELEASE )
+#define ATOMIC_FENCE() __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
+// Lives at the start of the shared memory. The producer only writes tail and
+// the consumer only writes head; each keeps to its own cache line. A side
+// about to sleep raises its waiting flag, and the other side clears it and
+// signals the matching eventfd, so wakeups cost nothing while both are busy.
+typedef struct {
+	t_uint magic;
+	t_uint size;
+	t_byte pad0[CACHE_LINE - 2 * sizeof( t_uint )];
+	t_uint64 head;
+	t_byte pad1[CACHE_LINE - sizeof( t_uint64 )];
+	t_uint64 tail;
+	t_byte pad2[CACHE_LINE - sizeof( t_uint64 )];
+	t_uint consumer_waiting;
+	t_byte pad3[CACHE_LINE - sizeof( t_uint )];
+	t_uint producer_waiting;
+} shmHeader_t;
+
+struct t_shmRing_s {
+	shmHeader_t *header;
+	t_byte *data;
+	t_uint size;
+	t_uint mask;
+	size_t mapping_size;
+	t_int memory;
+	t_int data_event;
+	t_int space_event;
+};
+
+
+/*
+====================
+CloseDescriptors
+====================
+*/
+static void CloseDescriptors( const t_int *const descriptors, const t_int count ) {
+	t_int i;
+
+	for ( i = 0; i < count; ++i ) {
+		if ( descriptors[i] >= 0 ) {
+			close( descriptors[i] );
+		}
+	}
+}
+
+
+/*
+====================
+MapRing
+
+Takes ownership of the descriptors, and closes them on failure.
+====================
+*/
+static t_shmRing_t *MapRing( const t_int *const descriptors, const t_uint size ) {
+	const size_t mappingSize = HEADER_SIZE + ( size_t )size;
+
+	t_shmRing_t *ring;
+	void *mapping;
+
+	if ( ( mapping = mmap( NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptors[0], 0 ) ) == MAP_FAILED ) {
+		CloseDescriptors( descriptors, T_SHMRING_DESCRIPTORS );
+		return NULL;
+	}
+
+	ring = ( t_shmRing_t * )T_Malloc( sizeof( t_shmRing_t ) );
+	ring->header = ( shmHeader_t * )mapping;
+	ring->data = ( t_byte * )mapping + HEADER_SIZE;
+	ring->size = size;
+	ring->mask = size - 1;
+	ring->mapping_size = mappingSize;
+	ring->memory = descriptors[0];
+	ring->data_event = descriptors[1];
+	ring->space_event = descriptors[2];
+	return ring;
+}
+
+
+/*
+====================
+T_CreateShmRing
+
+Creates the shared memory and both wakeups for the producer side. The size is
+rounded up to a power of two. Returns NULL when the system will not allow it.
+====================
+*/
+t_shmRing_t *T_CreateShmRing( const t_int size ) {
+	t_int descriptors[T_SHMRING_DESCRIPTORS] = { -1, -1, -1 };
+	t_shmRing_t *ring;
+	t_uint capacity = MIN_SIZE;
+
+	while ( capacity < ( t_uint )size && capacity < MAX_SIZE ) {
+		capacity <<= 1;
+	}
+
+	descriptors[0] = ( t_int )syscall( __NR_memfd_create, "tfile-ring", 1 ); // MFD_CLOEXEC
+	descriptors[1] = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	descriptors[2] = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if ( descriptors[0] < 0 || descriptors[1] < 0 || descriptors[2] < 0 || ftruncate( descriptors[0], HEADER_SIZE + ( off_t )capacity ) != 0 ) {
+		CloseDescriptors( descriptors, T_SHMRING_DESCRIPTORS );
+		return NULL;
+	}
+
+	if ( !( ring = MapRing( descriptors, capacity ) ) ) {
+		return NULL;
+	}
+
+	// The memory starts zeroed: empty, with nobody waiting.
+	ring->header->size = capacity;
+	ATOMIC_STORE( &ring->header->magic, SHMRING_MAGIC );
+	return ring;
+}
+
+
+/*
+====================
+T_AttachShmRing
+
+Maps a ring created by the other process, for the consumer side. Takes
+ownership of the T_SHMRING_DESCRIPTORS descriptors, even on failure.
+====================
+*/
+t_shmRing_t *T_AttachShmRing( const t_int *const descriptors ) {
+	struct stat info;
+	shmHeader_t header;
+	t_shmRing_t *ring;
+
+	if ( fstat( descriptors[0], &info ) != 0 || info.st_size < HEADER_SIZE + MIN_SIZE || info.st_size > HEADER_SIZE + ( off_t )MAX_SIZE ||
+		pread( descriptors[0], &header, sizeof( header ), 0 ) != sizeof( header ) ) {
+		CloseDescriptors( descriptors, T_SHMRING_DESCRIPTORS );
+		return NULL;
+	}
+
+	// Only trust a size that matches the memory behind it.
+	if ( header.magic != SHMRING_MAGIC || header.size & ( header.size - 1 ) || HEADER_SIZE + ( off_t )header.size != info.st_size ) {
+		CloseDescriptors( descriptors, T_SHMRING_DESCRIPTORS );
+		return NULL;
+	}
+	ring = MapRing( descriptors, header.size );
+	return ring;
+}
+
+
+/*
+====================
+T_DestroyShmRing
+
+The other side keeps its own mapping; the memory goes once both are done.
+====================
+*/
+void T_DestroyShmRing( t_shmRing_t *const ring ) {
+	munmap( ring->header, ring->mapping_size );
+	close( ring->memory );
+	close( ring->data_event );
+	close( ring->space_event );
+	T_Free( ring );
+}
+
+
+/*
+====================
+T_ShmRingGetDescriptors
+
+Fills in T_SHMRING_DESCRIPTORS descriptors to pass to the other process. They
+stay owned by the ring.
+====================
+*/
+void T_ShmRingGetDescriptors( const t_shmRing_t *const ring, t_int *const descriptors ) {
+	descriptors[0] = ring->memory;
+	descriptors[1] = ring->data_event;
+	descriptors[2] = ring->space_event;
+}
+
+
+/*
+====================
+T_ShmRingGetSize
+====================
+*/
+t_int T_ShmRingGetSize( const t_shmRing_t *const ring ) {
+	return ( t_int )ring->size;
+}
+
+
+/*
+====================
+T_ShmRingGetDataEvent
+
+Readable when the producer has woken a waiting consumer.
+====================
+*/
+t_int T_ShmRingGetDataEvent( const t_shmRing_t *const ring ) {
+	return ring->data_event;
+}
+
+
+/*
+====================
+T_ShmRingGetSpaceEvent
+
+Readable when the consumer has woken a waiting producer.
+====================
+*/
+t_int T_ShmRingGetSpaceEvent( const t_shmRing_t *const ring ) {
+	return ring->space_event;
+}
+
+
+/*
+====================
+T_ShmRingDrainEvent
+
+Resets a wakeup after it fired, so a level-triggered poll stops reporting it.
+====================
+*/
+void T_ShmRingDrainEvent( const t_int event ) {
+	t_uint64 count;
+
+	while ( read( event, &count, sizeof( count ) ) < 0 && errno == EINTR ) {}
+}
+
+
+/*
+====================
+Signal
+====================
+*/
+static void Signal( const t_int event ) {
+	const t_uint64 one = 1;
+
+	while ( write( event, &one, sizeof( one ) ) < 0 && errno == EINTR ) {}
+}
+
+
+/*
+====================
+Used
+
+Bytes between head and tail. Anything impossible, from a confused or hostile
+other side, is treated as a full ring.
+====================
+*/
+static t_uint Used( const t_shmRing_t *const ring, const t_uint64 head, const t_uint64 tail ) {
+	return tail - head > ring->size ? ring->size : ( t_uint )( tail - head );
+}
+
+
+/*
+====================
+Publish
+
+Makes bytes up to tail visible, and wakes the consumer if it is about to sleep.
+====================
+*/
+static void Publish( t_shmRing_t *const ring, const t_uint64 tail ) {
+	shmHeader_t *const header = ring->header;
+
+	ATOMIC_STORE( &header->tail, tail );
+	ATOMIC_FENCE();
+	if ( ATOMIC_LOAD( &header->consumer_waiting ) ) {
+		ATOMIC_STORE( &header->consumer_waiting, 0 );
+		Signal( ring->data_event );
+	}
+}
+
+
+/*
+====================
+T_ShmRingWrite
+
+Copies as much of buffer as fits.
+Returns the number of bytes written; zero when the ring is full.
+====================
+*/
+t_int T_ShmRingWrite( t_shmRing_t *const ring, const t_byte *const buffer, const t_int size ) {
+	const t_uint64 tail = ring->header->tail;
+	const t_uint space = ring->size - Used( ring, ATOMIC_LOAD( &ring->header->head ), tail );
+	const t_uint count = ( t_uint )size < space ? ( t_uint )size : space;
+	const t_uint position = ( t_uint )tail & ring->mask;
+	const t_uint first = count < ring->size - position ? count : ring->size - position;
+
+	if ( count == 0 ) {
+		return 0;
+	}
+
+	memcpy( ring->data + position, buffer, first );
+	memcpy( ring->data, buffer + first, count - first );
+	Publish( ring, tail + count );
+	return ( t_int )count;
+}
+
+
+/*
+====================
+T_ShmRingWriteFile
+
+Reads up to size bytes of a file at offset straight into the ring.
+Returns the number of bytes written, zero when the ring is full, or -1 when
+the file could not be read.
+====================
+*/
+t_int T_ShmRingWriteFile( t_shmRing_t *const ring, const t_int file, const t_int64 offset, const t_int size ) {
+	const t_uint64 tail = ring->header->tail;
+	const t_uint space = ring->size - Used( ring, ATOMIC_LOAD( &ring->header->head ), tail );
+	const t_uint count = ( t_uint )size < space ? ( t_uint )size : space;
+	const t_uint position = ( t_uint )tail & ring->mask;
+	const t_uint first = count < ring->size - position ? count : ring->size - position;
+
+	ssize_t total;
+	ssize_t more;
+
+	if ( count == 0 ) {
+		return 0;
+	}
+
+	// Up to the end of the memory, then on from the start.
+	if ( ( total = pread( file, ring->data + position, first, ( off_t )offset ) ) <= 0 ) {
+		return -1;
+	}
+	if ( ( t_uint )total == first && count > first && ( more = pread( file, ring->data, count - first, ( off_t )offset + first ) ) > 0 ) {
+		total += more;
+	}
+
+	Publish( ring, tail + ( t_uint64 )total );
+	return ( t_int )total;
+}
+
+
+/*
+====================
+T_ShmRingWaitSpace
+
+Call when the ring is full, before waiting on the space event.
+Returns false when space turned up meanwhile; write again instead of waiting.
+====================
+*/
+t_bool T_ShmRingWaitSpace( t_shmRing_t *const ring ) {
+	shmHeader_t *const header = ring->header;
+
+	ATOMIC_STORE( &header->producer_waiting, 1 );
+	ATOMIC_FENCE();
+	if ( Used( ring, ATOMIC_LOAD( &header->head ), header->tail ) < ring->size ) {
+		ATOMIC_STORE( &header->producer_waiting, 0 );
+		return t_false;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+T_ShmRingPeek
+
+Returns the readable bytes that follow on from each other in memory. When they
+wrap, consume these and peek again for the rest.
+====================
+*/
+const t_byte *T_ShmRingPeek( t_shmRing_t *const ring, t_int *const size ) {
+	const t_uint64 head = ring->header->head;
+	const t_uint used = Used( ring, head, ATOMIC_LOAD( &ring->header->tail ) );
+	const t_uint position = ( t_uint )head & ring->mask;
+
+	*size = ( t_int )( used < ring->size - position ? used : ring->size - position );
+	return ring->data + position;
+}
+
+
+/*
+====================
+T_ShmRingConsume
+
+Frees bytes returned by T_ShmRingPeek, and wakes the producer if it is waiting
+for space.
+====================
+*/
+void T_ShmRingConsume( t_shmRing_t *const ring, const t_int size ) {
+	shmHeader_t *const header = ring->header;
+
+	ATOMIC_STORE( &header->head, header->head + ( t_uint64 )size );
+	ATOMIC_FENCE();
+	if ( ATOMIC_LOAD( &header->producer_waiting ) ) {
+		ATOMIC_STORE( &header->producer_waiting, 0 );
+		Signal( ring->space_event );
+	}
+}
+
+
+/*
+====================
+T_ShmRingWaitData
+
+Call when the ring is empty, before waiting on the data event.
+Returns false when data turned up meanwhile; read again instead of waiting.
+====================
+*/
+t_bool T_ShmRingWaitData( t_shmRing_t *const ring ) {
+	shmHeader_t *const header = ring->header;
+
+	ATOMIC_STORE( &header->consumer_waiting, 1 );
+	ATOMIC_FENCE();
+	if ( Used( ring, header->head, ATOMIC_LOAD( &header->tail ) ) > 0 ) {
+		ATOMIC_STORE( &header->consumer_waiting, 0 );
+		return t_false;
+	}
+	return t_true;
+}
+
+#else
+
+/*
+====================
+T_CreateShmRing
+
+Shared rings need memfd and eventfd, which only Linux has.
+====================
+*/
+t_shmRing_t *T_CreateShmRing( const t_int size ) {
+	return NULL;
+}
+
+t_shmRing_t *T_AttachShmRing( const t_int *const descriptors ) { return NULL; }
+void T_DestroyShmRing( t_shmRing_t *const ring ) {}
+void T_ShmRingGetDescriptors( const t_shmRing_t *const ring, t_int *const descriptors ) {}
+t_int T_ShmRingGetSize( const t_shmRing_t *const ring ) { return 0; }
+t_int T_ShmRingGetDataEvent( const t_shmRing_t *const ring ) { return -1; }
+t_int T_ShmRingGetSpaceEvent( const t_shmRing_t *const ring ) { return -1; }
+void T_ShmRingDrainEvent( const t_int event ) {}
+t_int T_ShmRingWrite( t_shmRing_t *const ring, const t_byte *const buffer, const t_int size ) { return 0; }
+t_int T_ShmRingWriteFile( t_shmRing_t *const ring, const t_int file, const t_int64 offset, const t_int size ) { return -1; }
+t_bool T_ShmRingWaitSpace( t_shmRing_t *const ring ) { return t_true; }
+const t_byte *T_ShmRingPeek( t_shmRing_t *const ring, t_int *const size ) { *size = 0; return NULL; }
+void T_ShmRingConsume( t_shmRing_t *const ring, const t_int size ) {}
+t_bool T_ShmRingWaitData( t_shmRing_t *const ring ) { return t_true; }
+
+#endif
@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _T_SHMRING_H_
+#define _T_SHMRING_H_
+
+#include "t_common.h"
+
+// Descriptors that make up a shared ring: the memory, then the data and space
+// wakeups, in the order T_AttachShmRing takes them.
+#define T_SHMRING_DESCRIPTORS 3
+
+typedef struct t_shmRing_s t_shmRing_t;
+
+t_shmRing_t *T_CreateShmRing( const t_int size );
+t_shmRing_t *T_AttachShmRing( const t_int *const descriptors );
+void T_DestroyShmRing( t_shmRing_t *const ring );
+void T_ShmRingGetDescriptors( const t_shmRing_t *const ring, t_int *const descriptors );
+t_int T_ShmRingGetSize( const t_shmRing_t *const ring );
+t_int T_ShmRingGetDataEvent( const t_shmRing_t *const ring );
+t_int T_ShmRingGetSpaceEvent( const t_shmRing_t *const ring );
+void T_ShmRingDrainEvent( const t_int event );
+
+// Producer
+t_int T_ShmRingWrite( t_shmRing_t *const ring, const t_byte *const buffer, const t_int size );
+t_int T_ShmRingWriteFile( t_shmRing_t *const ring, const t_int file, const t_int64 offset, const t_int size );
+t_bool T_ShmRingWaitSpace( t_shmRing_t *const ring );
+
+// Consumer
+const t_byte *T_ShmRingPeek( t_shmRing_t *const ring, t_int *const size );
+void T_ShmRingConsume( t_shmRing_t *const ring, const t_int size );
+t_bool T_ShmRingWaitData( t_shmRing_t *const ring );
+
+#endif // _T_SHMRING_H_
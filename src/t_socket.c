@@ -27,6 +27,19 @@ THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "t_socket.h"
 
+#if defined( __linux__ )
+#	define T_HAVE_EPOLL
+#	define T_HAVE_SENDFILE
+#	include <sys/epoll.h>
+#	include <sys/sendfile.h>
+#endif
+
+#if _WIN32
+#	include <io.h>
+#endif
+
+#define SEND_FILE_BUFFER_SIZE 16384
+
 
 /*
 ====================
@@ -98,6 +111,37 @@ int T_SocketReuseAddress( const SOCKET socket ) {
 }
 
 
+/*
+====================
+T_SocketReusePort
+
+Lets several sockets bind the same port. Not available on every platform.
+====================
+*/
+int T_SocketReusePort( const SOCKET socket ) {
+#ifdef SO_REUSEPORT
+	int optval = 1;
+	return setsockopt( socket, SOL_SOCKET, SO_REUSEPORT, ( char * )&optval, sizeof( optval ) );
+#else
+	return SOCKET_ERROR;
+#endif
+}
+
+
+/*
+====================
+T_SocketNoDelay
+
+Sends small requests right away instead of holding them back for Nagle's
+algorithm.
+====================
+*/
+int T_SocketNoDelay( const SOCKET socket ) {
+	int optval = 1;
+	return setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, ( char * )&optval, sizeof( optval ) );
+}
+
+
 /*
 ====================
 T_SocketNonBlocking
@@ -113,6 +157,283 @@ int T_SocketNonBlocking( const SOCKET socket ) {
 }
 
 
+/*
+====================
+T_SocketWouldBlock
+
+True when the last socket call failed only because it would have blocked.
+====================
+*/
+t_bool T_SocketWouldBlock( void ) {
+#if _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK ? t_true : t_false;
+#else
+	return ( errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR ) ? t_true : t_false;
+#endif
+}
+
+
+/*
+====================
+T_SendMore
+
+Sends a header that is about to be followed by more data, such as file content
+from T_SendFile, so the two can leave in the same segment.
+====================
+*/
+int T_SendMore( const SOCKET socket, const t_byte *const buffer, const t_int size ) {
+#ifdef MSG_MORE
+	return send( socket, ( const char * )buffer, size, MSG_MORE );
+#else
+	return send( socket, ( const char * )buffer, size, 0 );
+#endif
+}
+
+
+/*
+====================
+T_SendFile
+
+Sends up to size bytes of an open file starting at offset, and advances offset
+by what was sent. Where sendfile exists the bytes go from the page cache to the
+socket without passing through user space.
+Returns the number of bytes sent, or SOCKET_ERROR.
+====================
+*/
+t_int T_SendFile( const SOCKET socket, const t_int file, t_int64 *const offset, const t_int size ) {
+#ifdef T_HAVE_SENDFILE
+	off_t position = ( off_t )*offset;
+	const ssize_t sent = sendfile( socket, file, &position, ( size_t )size );
+
+	if ( sent < 0 ) {
+		return SOCKET_ERROR;
+	}
+	*offset = position;
+	return ( t_int )sent;
+#else
+	t_byte buffer[SEND_FILE_BUFFER_SIZE];
+	const t_int count = size < SEND_FILE_BUFFER_SIZE ? size : SEND_FILE_BUFFER_SIZE;
+
+	t_int read;
+	t_int sent;
+#if _WIN32
+	OVERLAPPED overlapped;
+	DWORD bytes;
+#endif
+
+#if _WIN32
+	// Read at offset without moving the file position, which other threads
+	// sending the same open file rely on too.
+	memset( &overlapped, 0, sizeof( overlapped ) );
+	overlapped.Offset = ( DWORD )*offset;
+	overlapped.OffsetHigh = ( DWORD )( *offset >> 32 );
+	if ( ReadFile( ( HANDLE )_get_osfhandle( file ), buffer, count, &bytes, &overlapped ) ) {
+		read = ( t_int )bytes;
+	} else {
+		read = GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+	}
+#else
+	read = ( t_int )pread( file, buffer, count, ( off_t )*offset );
+#endif
+	if ( read <= 0 ) {
+		return read < 0 ? SOCKET_ERROR : 0;
+	}
+
+	sent = send( socket, ( const char * )buffer, read, 0 );
+	if ( sent > 0 ) {
+		*offset += sent;
+	}
+	return sent;
+#endif
+}
+
+
+/*
+====================
+T_SendVector
+
+Sends several buffers with one call. With more set, the kernel is told that
+more data follows, as with T_SendMore.
+Returns the number of bytes sent, or SOCKET_ERROR.
+====================
+*/
+t_int T_SendVector( const SOCKET socket, const t_sendBuffer_t *const buffers, const t_int count, const t_bool more ) {
+#if _WIN32
+	WSABUF wsaBuffers[T_MAX_SEND_BUFFERS];
+	DWORD sent = 0;
+	t_int i;
+
+	for ( i = 0; i < count && i < T_MAX_SEND_BUFFERS; ++i ) {
+		wsaBuffers[i].buf = ( char * )buffers[i].buffer;
+		wsaBuffers[i].len = buffers[i].size;
+	}
+
+	if ( WSASend( socket, wsaBuffers, i, &sent, 0, NULL, NULL ) == SOCKET_ERROR ) {
+		return SOCKET_ERROR;
+	}
+	return ( t_int )sent;
+#else
+	struct iovec vectors[T_MAX_SEND_BUFFERS];
+	struct msghdr message;
+	int flags = 0;
+	t_int i;
+
+	for ( i = 0; i < count && i < T_MAX_SEND_BUFFERS; ++i ) {
+		vectors[i].iov_base = ( void * )buffers[i].buffer;
+		vectors[i].iov_len = buffers[i].size;
+	}
+
+	memset( &message, 0, sizeof( message ) );
+	message.msg_iov = vectors;
+	message.msg_iovlen = i;
+
+#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+#endif
+#ifdef MSG_MORE
+	if ( more ) {
+		flags |= MSG_MORE;
+	}
+#endif
+	return ( t_int )sendmsg( socket, &message, flags );
+#endif
+}
+
+
+/*
+====================
+T_SendDescriptors
+
+Sends bytes with open descriptors attached, at most T_MAX_DESCRIPTORS, for a
+local socket. The receiver gets its own descriptors for the same open files
+along with the first byte.
+Returns the number of bytes sent, or SOCKET_ERROR.
+====================
+*/
+t_int T_SendDescriptors( const SOCKET socket, const t_byte *const buffer, const t_int size, const t_int *const descriptors, const t_int count ) {
+#if _WIN32
+	WSASetLastError( WSAEOPNOTSUPP );
+	return SOCKET_ERROR;
+#else
+	union {
+		struct cmsghdr header;
+		t_byte data[CMSG_SPACE( sizeof( int ) * T_MAX_DESCRIPTORS )];
+	} control;
+	struct cmsghdr *header;
+	struct iovec vector;
+	struct msghdr message;
+	int flags = 0;
+
+	if ( count < 1 || count > T_MAX_DESCRIPTORS ) {
+		errno = EINVAL;
+		return SOCKET_ERROR;
+	}
+
+	vector.iov_base = ( void * )buffer;
+	vector.iov_len = size;
+
+	memset( &control, 0, sizeof( control ) );
+	memset( &message, 0, sizeof( message ) );
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.data;
+	message.msg_controllen = CMSG_SPACE( sizeof( int ) * count );
+
+	header = CMSG_FIRSTHDR( &message );
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN( sizeof( int ) * count );
+	memcpy( CMSG_DATA( header ), descriptors, sizeof( int ) * count );
+
+#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+#endif
+	return ( t_int )sendmsg( socket, &message, flags );
+#endif
+}
+
+
+/*
+====================
+T_ReceiveDescriptors
+
+Receives like recv, and picks up descriptors sent with T_SendDescriptors.
+descriptors has room for T_MAX_DESCRIPTORS; count is zero when none came with
+these bytes.
+Returns the number of bytes received, or SOCKET_ERROR.
+====================
+*/
+t_int T_ReceiveDescriptors( const SOCKET socket, t_byte *const buffer, const t_int size, t_int *const descriptors, t_int *const count ) {
+#if _WIN32
+	*count = 0;
+	return recv( socket, ( char * )buffer, size, 0 );
+#else
+	union {
+		struct cmsghdr header;
+		t_byte data[CMSG_SPACE( sizeof( int ) * T_MAX_DESCRIPTORS )];
+	} control;
+	struct cmsghdr *header;
+	struct iovec vector;
+	struct msghdr message;
+	int flags = 0;
+	ssize_t received;
+
+	*count = 0;
+	vector.iov_base = buffer;
+	vector.iov_len = size;
+
+	memset( &message, 0, sizeof( message ) );
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.data;
+	message.msg_controllen = sizeof( control.data );
+
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif
+	if ( ( received = recvmsg( socket, &message, flags ) ) < 0 ) {
+		return SOCKET_ERROR;
+	}
+
+	for ( header = CMSG_FIRSTHDR( &message ); header; header = CMSG_NXTHDR( &message, header ) ) {
+		if ( header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS && header->cmsg_len >= CMSG_LEN( 0 ) ) {
+			const t_int found = ( t_int )( ( header->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int ) );
+
+			*count = found < T_MAX_DESCRIPTORS ? found : T_MAX_DESCRIPTORS;
+			memcpy( descriptors, CMSG_DATA( header ), sizeof( int ) * *count );
+		}
+	}
+	return ( t_int )received;
+#endif
+}
+
+
+/*
+====================
+T_LocalAddress
+
+Fills in a local (Unix domain) socket address for path.
+Returns false when local sockets are not available or the path is too long.
+====================
+*/
+t_bool T_LocalAddress( const t_char *const path, struct sockaddr_storage *const address, t_int *const length ) {
+#if _WIN32
+	return t_false;
+#else
+	struct sockaddr_un *const local = ( struct sockaddr_un * )address;
+
+	if ( strlen( path ) >= sizeof( local->sun_path ) ) {
+		return t_false;
+	}
+
+	memset( address, 0, sizeof( struct sockaddr_storage ) );
+	local->sun_family = AF_UNIX;
+	strcpy( local->sun_path, path );
+	*length = ( t_int )sizeof( struct sockaddr_un );
+	return t_true;
+#endif
+}
+
 /*
 ====================
 T_Select
@@ -174,3 +495,441 @@ struct addrinfo T_CreateHints( const t_int family, const t_int socketType, const
 	hints.ai_flags = flags;
 	return hints;
 }
+
+
+/*
+============================================================================
+
+POLL
+
+Readiness demultiplexer for the server loop. Sockets are registered once and
+stay registered until removed, so waiting does not rebuild any sets.
+Select is the portable fallback; epoll is used on Linux when available.
+
+============================================================================
+*/
+
+typedef struct {
+	t_bool ( *add )( t_poll_t *const poll, const SOCKET socket, const t_uint64 data );
+	t_bool ( *remove )( t_poll_t *const poll, const SOCKET socket );
+	t_bool ( *watchWrite )( t_poll_t *const poll, const SOCKET socket, const t_bool watch );
+	t_int ( *wait )( t_poll_t *const poll, const t_int usec, t_pollEvent_t *const events, const t_int maxEvents );
+	void ( *destroy )( t_poll_t *const poll );
+} t_pollFuncs_t;
+
+struct t_poll_s {
+	t_pollBackend_t backend;
+	const t_pollFuncs_t *funcs;
+	t_int maxSockets;
+	t_int count;
+
+	// Select
+	SOCKET *sockets;
+	t_uint64 *data;
+	fd_set readSet;
+	fd_set writeSet;
+	t_int writers;
+	SOCKET max;
+
+#ifdef T_HAVE_EPOLL
+	// Epoll
+	int epoll;
+	t_uint64 *fdData;
+	t_int fdDataSize;
+	struct epoll_event *epollEvents;
+#endif
+};
+
+
+/*
+====================
+SelectAdd
+====================
+*/
+static t_bool SelectAdd( t_poll_t *const poll, const SOCKET socket, const t_uint64 data ) {
+	if ( poll->count >= poll->maxSockets ) {
+		T_Error( "SelectAdd: Too many sockets.\n" );
+		return t_false;
+	}
+#if !_WIN32
+	// A POSIX fd_set is a bitmap indexed by descriptor, FD_SETSIZE bits long.
+	if ( socket >= FD_SETSIZE ) {
+		T_Error( "SelectAdd: Socket number too large for select.\n" );
+		return t_false;
+	}
+#endif
+
+	poll->sockets[poll->count] = socket;
+	poll->data[poll->count] = data;
+	++poll->count;
+
+	FD_SET( socket, &poll->readSet );
+	if ( socket > poll->max ) {
+		poll->max = socket;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+SelectRemove
+====================
+*/
+static t_bool SelectRemove( t_poll_t *const poll, const SOCKET socket ) {
+	t_int i;
+
+	for ( i = 0; i < poll->count; ++i ) {
+		if ( poll->sockets[i] == socket )
+			break;
+	}
+
+	if ( i == poll->count ) {
+		return t_false;
+	}
+
+	// Order does not matter, move the last socket into the hole.
+	--poll->count;
+	poll->sockets[i] = poll->sockets[poll->count];
+	poll->data[i] = poll->data[poll->count];
+
+	FD_CLR( socket, &poll->readSet );
+	if ( FD_ISSET( socket, &poll->writeSet ) ) {
+		FD_CLR( socket, &poll->writeSet );
+		--poll->writers;
+	}
+	if ( socket == poll->max ) {
+		poll->max = 0;
+		for ( i = 0; i < poll->count; ++i ) {
+			if ( poll->sockets[i] > poll->max ) {
+				poll->max = poll->sockets[i];
+			}
+		}
+	}
+	return t_true;
+}
+
+
+/*
+====================
+SelectWatchWrite
+====================
+*/
+static t_bool SelectWatchWrite( t_poll_t *const poll, const SOCKET socket, const t_bool watch ) {
+#if !_WIN32
+	// Never added; see SelectAdd.
+	if ( socket >= FD_SETSIZE ) {
+		return t_false;
+	}
+#endif
+	if ( watch && !FD_ISSET( socket, &poll->writeSet ) ) {
+		FD_SET( socket, &poll->writeSet );
+		++poll->writers;
+	} else if ( !watch && FD_ISSET( socket, &poll->writeSet ) ) {
+		FD_CLR( socket, &poll->writeSet );
+		--poll->writers;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+SelectWait
+====================
+*/
+static t_int SelectWait( t_poll_t *const poll, const t_int usec, t_pollEvent_t *const events, const t_int maxEvents ) {
+	fd_set readSet = poll->readSet;
+	fd_set writeSet = poll->writeSet;
+	struct timeval tv;
+	t_int result;
+	t_int count = 0;
+	t_int i;
+
+	tv.tv_sec = usec / 1000000;
+	tv.tv_usec = usec % 1000000;
+
+	if ( ( result = select( ( int )poll->max + 1, &readSet, poll->writers > 0 ? &writeSet : 0, 0, usec < 0 ? NULL : &tv ) ) <= 0 ) {
+		return result;
+	}
+
+	for ( i = 0; i < poll->count && count < maxEvents; ++i ) {
+		const t_int flags = ( FD_ISSET( poll->sockets[i], &readSet ) ? T_POLL_READ : 0 ) |
+			( poll->writers > 0 && FD_ISSET( poll->sockets[i], &writeSet ) ? T_POLL_WRITE : 0 );
+
+		if ( flags ) {
+			events[count].socket = poll->sockets[i];
+			events[count].data = poll->data[i];
+			events[count].flags = flags;
+			++count;
+		}
+	}
+	return count;
+}
+
+
+/*
+====================
+SelectDestroy
+====================
+*/
+static void SelectDestroy( t_poll_t *const poll ) {
+	T_Free( poll->sockets );
+	T_Free( poll->data );
+}
+
+
+static const t_pollFuncs_t select_funcs = { SelectAdd, SelectRemove, SelectWatchWrite, SelectWait, SelectDestroy };
+
+
+/*
+====================
+SelectInit
+====================
+*/
+static t_bool SelectInit( t_poll_t *const poll ) {
+	if ( poll->maxSockets > FD_SETSIZE ) {
+		poll->maxSockets = FD_SETSIZE;
+	}
+
+	poll->sockets = ( SOCKET * )T_Malloc( sizeof( SOCKET ) * poll->maxSockets );
+	poll->data = ( t_uint64 * )T_Malloc( sizeof( t_uint64 ) * poll->maxSockets );
+	poll->max = 0;
+	FD_ZERO( &poll->readSet );
+	FD_ZERO( &poll->writeSet );
+	poll->writers = 0;
+	poll->funcs = &select_funcs;
+	return t_true;
+}
+
+
+#ifdef T_HAVE_EPOLL
+/*
+====================
+EpollAdd
+====================
+*/
+static t_bool EpollAdd( t_poll_t *const poll, const SOCKET socket, const t_uint64 data ) {
+	struct epoll_event event;
+
+	// Socket descriptors are small integers, so the user data is indexed by them directly.
+	if ( socket >= poll->fdDataSize ) {
+		t_int size = poll->fdDataSize;
+		t_uint64 *fdData;
+
+		while ( size <= socket ) {
+			size *= 2;
+		}
+
+		fdData = ( t_uint64 * )T_Malloc0( sizeof( t_uint64 ) * size );
+		memcpy( fdData, poll->fdData, sizeof( t_uint64 ) * poll->fdDataSize );
+		T_Free( poll->fdData );
+		poll->fdData = fdData;
+		poll->fdDataSize = size;
+	}
+
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN;
+	event.data.fd = socket;
+	if ( epoll_ctl( poll->epoll, EPOLL_CTL_ADD, socket, &event ) == SOCKET_ERROR ) {
+		T_Error( "EpollAdd: Unable to add socket.\n" );
+		return t_false;
+	}
+
+	poll->fdData[socket] = data;
+	++poll->count;
+	return t_true;
+}
+
+
+/*
+====================
+EpollRemove
+====================
+*/
+static t_bool EpollRemove( t_poll_t *const poll, const SOCKET socket ) {
+	struct epoll_event event;
+
+	if ( epoll_ctl( poll->epoll, EPOLL_CTL_DEL, socket, &event ) == SOCKET_ERROR ) {
+		return t_false;
+	}
+
+	poll->fdData[socket] = 0;
+	--poll->count;
+	return t_true;
+}
+
+
+/*
+====================
+EpollWatchWrite
+====================
+*/
+static t_bool EpollWatchWrite( t_poll_t *const poll, const SOCKET socket, const t_bool watch ) {
+	struct epoll_event event;
+
+	memset( &event, 0, sizeof( event ) );
+	event.events = watch ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	event.data.fd = socket;
+	return epoll_ctl( poll->epoll, EPOLL_CTL_MOD, socket, &event ) == SOCKET_ERROR ? t_false : t_true;
+}
+
+
+/*
+====================
+EpollWait
+====================
+*/
+static t_int EpollWait( t_poll_t *const poll, const t_int usec, t_pollEvent_t *const events, const t_int maxEvents ) {
+	// Round up so a sub-millisecond timeout does not turn into a busy loop.
+	const t_int timeout = usec < 0 ? -1 : ( usec + 999 ) / 1000;
+	const t_int max = maxEvents < poll->maxSockets ? maxEvents : poll->maxSockets;
+
+	t_int result;
+	t_int i;
+
+	if ( ( result = epoll_wait( poll->epoll, poll->epollEvents, max, timeout ) ) <= 0 ) {
+		return result;
+	}
+
+	for ( i = 0; i < result; ++i ) {
+		const SOCKET socket = poll->epollEvents[i].data.fd;
+
+		events[i].socket = socket;
+		events[i].data = poll->fdData[socket];
+		events[i].flags = ( poll->epollEvents[i].events & ~EPOLLOUT ? T_POLL_READ : 0 ) | ( poll->epollEvents[i].events & EPOLLOUT ? T_POLL_WRITE : 0 );
+	}
+	return result;
+}
+
+
+/*
+====================
+EpollDestroy
+====================
+*/
+static void EpollDestroy( t_poll_t *const poll ) {
+	closesocket( poll->epoll );
+	T_Free( poll->fdData );
+	T_Free( poll->epollEvents );
+}
+
+
+static const t_pollFuncs_t epoll_funcs = { EpollAdd, EpollRemove, EpollWatchWrite, EpollWait, EpollDestroy };
+
+
+/*
+====================
+EpollInit
+====================
+*/
+static t_bool EpollInit( t_poll_t *const poll ) {
+	if ( ( poll->epoll = epoll_create1( EPOLL_CLOEXEC ) ) == SOCKET_ERROR ) {
+		return t_false;
+	}
+
+	poll->fdDataSize = 1024;
+	poll->fdData = ( t_uint64 * )T_Malloc0( sizeof( t_uint64 ) * poll->fdDataSize );
+	poll->epollEvents = ( struct epoll_event * )T_Malloc( sizeof( struct epoll_event ) * poll->maxSockets );
+	poll->funcs = &epoll_funcs;
+	return t_true;
+}
+#endif
+
+
+/*
+====================
+T_CreatePoll
+
+maxSockets is a hard limit for select and the size of the ready list for epoll.
+====================
+*/
+t_poll_t *T_CreatePoll( const t_pollBackend_t backend, const t_int maxSockets ) {
+	t_poll_t *const poll = ( t_poll_t * )T_Malloc0( sizeof( t_poll_t ) );
+
+	poll->maxSockets = maxSockets;
+	poll->count = 0;
+
+#ifdef T_HAVE_EPOLL
+	if ( backend == T_POLL_DEFAULT || backend == T_POLL_EPOLL ) {
+		if ( EpollInit( poll ) ) {
+			poll->backend = T_POLL_EPOLL;
+			return poll;
+		}
+		T_Error( "T_CreatePoll: Unable to create epoll, falling back to select.\n" );
+	}
+#endif
+
+	SelectInit( poll );
+	poll->backend = T_POLL_SELECT;
+	return poll;
+}
+
+
+/*
+====================
+T_DestroyPoll
+====================
+*/
+void T_DestroyPoll( t_poll_t *const poll ) {
+	poll->funcs->destroy( poll );
+	T_Free( poll );
+}
+
+
+/*
+====================
+T_PollGetBackend
+====================
+*/
+t_pollBackend_t T_PollGetBackend( const t_poll_t *const poll ) {
+	return poll->backend;
+}
+
+
+/*
+====================
+T_PollAdd
+====================
+*/
+t_bool T_PollAdd( t_poll_t *const poll, const SOCKET socket, const t_uint64 data ) {
+	return poll->funcs->add( poll, socket, data );
+}
+
+
+/*
+====================
+T_PollRemove
+
+Must be called before the socket is closed.
+====================
+*/
+t_bool T_PollRemove( t_poll_t *const poll, const SOCKET socket ) {
+	return poll->funcs->remove( poll, socket );
+}
+
+
+/*
+====================
+T_PollWatchWrite
+
+Also reports the socket, with T_POLL_WRITE, while it can take more data.
+Watch only while there is something waiting to be sent.
+====================
+*/
+t_bool T_PollWatchWrite( t_poll_t *const poll, const SOCKET socket, const t_bool watch ) {
+	return poll->funcs->watchWrite( poll, socket, watch );
+}
+
+
+/*
+====================
+T_PollWait
+
+Waits up to usec microseconds, or forever when usec is negative.
+Returns the number of ready events, or SOCKET_ERROR.
+====================
+*/
+t_int T_PollWait( t_poll_t *const poll, const t_int usec, t_pollEvent_t *const events, const t_int maxEvents ) {
+	return poll->funcs->wait( poll, usec, events, maxEvents );
+}
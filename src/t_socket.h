@@ -25,6 +25,9 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
 THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifndef _T_SOCKET_H_
+#define _T_SOCKET_H_
+
 #include "t_common.h"
 
 #if _WIN32
@@ -34,13 +37,18 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #	pragma comment(lib, "ws2_32.lib")
 #else
 #	include <sys/socket.h>
+#	include <sys/uio.h>
+#	include <sys/un.h>
 #	include <sys/unistd.h>
 #	include <sys/fcntl.h>
 #	include <netdb.h>
 #	include <arpa/inet.h>
 #	include <netinet/in.h>
+#	include <netinet/tcp.h>
 #	include <stdlib.h>
+#	include <string.h>
 #	include <unistd.h>
+#	include <errno.h>
 
 typedef int SOCKET;
 #	define INVALID_SOCKET -1
@@ -50,10 +58,54 @@ typedef int SOCKET;
 
 #define ZERO_SOCKET 0
 
+typedef enum {
+	T_POLL_DEFAULT,
+	T_POLL_SELECT,
+	T_POLL_EPOLL
+} t_pollBackend_t;
+
+#define T_POLL_READ 1
+#define T_POLL_WRITE 2
+
+typedef struct {
+	SOCKET socket;
+	t_uint64 data;
+	t_int flags; // T_POLL_READ and/or T_POLL_WRITE.
+} t_pollEvent_t;
+
+#define T_MAX_SEND_BUFFERS 64
+#define T_MAX_DESCRIPTORS 4 // Passed along with one send on a local socket.
+
+typedef struct {
+	const t_byte *buffer;
+	t_int size;
+} t_sendBuffer_t;
+
+typedef struct t_poll_s t_poll_t;
+
 const struct addrinfo *T_FindAddrInfo( const t_int family, const struct addrinfo *const info );
 SOCKET T_CreateSocket( const t_int family, const struct addrinfo *const info );
 struct addrinfo T_CreateAddressInfo( void );
 int T_SocketReuseAddress( const SOCKET socket );
+int T_SocketReusePort( const SOCKET socket );
+int T_SocketNoDelay( const SOCKET socket );
 int T_SocketNonBlocking( const SOCKET socket );
+t_bool T_SocketWouldBlock( void );
+int T_SendMore( const SOCKET socket, const t_byte *const buffer, const t_int size );
+t_int T_SendFile( const SOCKET socket, const t_int file, t_int64 *const offset, const t_int size );
+t_int T_SendVector( const SOCKET socket, const t_sendBuffer_t *const buffers, const t_int count, const t_bool more );
+t_int T_SendDescriptors( const SOCKET socket, const t_byte *const buffer, const t_int size, const t_int *const descriptors, const t_int count );
+t_int T_ReceiveDescriptors( const SOCKET socket, t_byte *const buffer, const t_int size, t_int *const descriptors, t_int *const count );
+t_bool T_LocalAddress( const t_char *const path, struct sockaddr_storage *const address, t_int *const length );
 int T_Select( const SOCKET *const sockets, const t_int size, const t_int usec, SOCKET *const reads );
 struct addrinfo T_CreateHints( const t_int family, const t_int socketType, const t_int flags );
+
+t_poll_t *T_CreatePoll( const t_pollBackend_t backend, const t_int maxSockets );
+void T_DestroyPoll( t_poll_t *const poll );
+t_pollBackend_t T_PollGetBackend( const t_poll_t *const poll );
+t_bool T_PollAdd( t_poll_t *const poll, const SOCKET socket, const t_uint64 data );
+t_bool T_PollRemove( t_poll_t *const poll, const SOCKET socket );
+t_bool T_PollWatchWrite( t_poll_t *const poll, const SOCKET socket, const t_bool watch );
+t_int T_PollWait( t_poll_t *const poll, const t_int usec, t_pollEvent_t *const events, const t_int maxEvents );
+
+#endif // _T_SOCKET_H_
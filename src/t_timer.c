@@ -0,0 +1,362 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "t_timer.h"
+
+#include <string.h>
+
+/*
+============================================================================
+
+TIMER WHEEL
+
+Hierarchical timing wheel. Each level has 64 slots; a slot on level n spans
+64^n ticks. Timers sit in the slot of the level that matches how far away
+they are and cascade down a level as time gets closer, so arming, re-arming
+and removing a timer are all O(1).
+
+Timers are kept in a pool and referred to by index, so the pool can grow
+without invalidating anything the caller holds.
+
+============================================================================
+*/
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE ( 1 << WHEEL_BITS )
+#define WHEEL_MASK ( WHEEL_SIZE - 1 )
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX_DELTA ( ( 1ULL << ( WHEEL_BITS * WHEEL_LEVELS ) ) - 1 )
+#define WHEEL_INITIAL_TIMERS 64
+
+#define TIMER_UNARMED -1
+#define TIMER_FREE -2
+
+typedef struct {
+	t_uint64 expires; // In ticks.
+	t_uint64 data;
+	t_int prev;
+	t_int next;
+	t_int list; // Level * WHEEL_SIZE + slot, TIMER_UNARMED or TIMER_FREE.
+} t_timerNode_t;
+
+struct t_timerWheel_s {
+	t_uint resolution;
+	t_uint64 now; // Next tick to process.
+	t_bool firing;
+
+	t_int lists[WHEEL_LEVELS * WHEEL_SIZE];
+	t_uint64 occupied[WHEEL_LEVELS];
+
+	t_timerNode_t *timers;
+	t_int capacity;
+	t_int freeTimer;
+};
+
+
+/*
+====================
+Link
+====================
+*/
+static void Link( t_timerWheel_t *const wheel, const t_int timer ) {
+	// While a tick is firing, a timer re-armed into the past waits for the next one.
+	const t_uint64 earliest = wheel->firing ? wheel->now + 1 : wheel->now;
+
+	t_timerNode_t *const node = &wheel->timers[timer];
+	t_uint64 expires = node->expires;
+	t_uint64 delta;
+	t_int level;
+	t_int list;
+
+	// Already due, run on the next tick processed.
+	if ( expires < earliest ) {
+		expires = earliest;
+	}
+
+	delta = expires - wheel->now;
+	if ( delta > WHEEL_MAX_DELTA ) {
+		expires = wheel->now + WHEEL_MAX_DELTA;
+		delta = WHEEL_MAX_DELTA;
+	}
+
+	for ( level = 0; level < WHEEL_LEVELS - 1; ++level ) {
+		if ( delta < ( 1ULL << ( WHEEL_BITS * ( level + 1 ) ) ) ) {
+			break;
+		}
+	}
+
+	list = level * WHEEL_SIZE + ( t_int )( ( expires >> ( WHEEL_BITS * level ) ) & WHEEL_MASK );
+
+	node->list = list;
+	node->prev = -1;
+	node->next = wheel->lists[list];
+	if ( node->next != -1 ) {
+		wheel->timers[node->next].prev = timer;
+	}
+	wheel->lists[list] = timer;
+	wheel->occupied[level] |= 1ULL << ( list & WHEEL_MASK );
+}
+
+
+/*
+====================
+Unlink
+====================
+*/
+static void Unlink( t_timerWheel_t *const wheel, const t_int timer ) {
+	t_timerNode_t *const node = &wheel->timers[timer];
+	const t_int list = node->list;
+
+	if ( list < 0 ) {
+		return;
+	}
+
+	if ( node->prev != -1 ) {
+		wheel->timers[node->prev].next = node->next;
+	} else {
+		wheel->lists[list] = node->next;
+	}
+
+	if ( node->next != -1 ) {
+		wheel->timers[node->next].prev = node->prev;
+	}
+
+	if ( wheel->lists[list] == -1 ) {
+		wheel->occupied[list / WHEEL_SIZE] &= ~( 1ULL << ( list & WHEEL_MASK ) );
+	}
+	node->list = TIMER_UNARMED;
+}
+
+
+/*
+====================
+Cascade
+
+Moves every timer in a slot down to the level that now fits it.
+====================
+*/
+static void Cascade( t_timerWheel_t *const wheel, const t_int level ) {
+	const t_int list = level * WHEEL_SIZE + ( t_int )( ( wheel->now >> ( WHEEL_BITS * level ) ) & WHEEL_MASK );
+
+	t_int timer;
+
+	while ( ( timer = wheel->lists[list] ) != -1 ) {
+		Unlink( wheel, timer );
+		Link( wheel, timer );
+	}
+}
+
+
+/*
+====================
+T_CreateTimerWheel
+
+resolution is the length of a tick in the caller's time unit.
+====================
+*/
+t_timerWheel_t *T_CreateTimerWheel( const t_uint64 now, const t_uint resolution ) {
+	t_timerWheel_t *const wheel = ( t_timerWheel_t * )T_Malloc0( sizeof( t_timerWheel_t ) );
+
+	memset( wheel->lists, -1, sizeof( wheel->lists ) );
+	wheel->resolution = resolution > 0 ? resolution : 1;
+	wheel->now = now / wheel->resolution;
+	wheel->timers = NULL;
+	wheel->capacity = 0;
+	wheel->freeTimer = -1;
+	return wheel;
+}
+
+
+/*
+====================
+T_DestroyTimerWheel
+====================
+*/
+void T_DestroyTimerWheel( t_timerWheel_t *const wheel ) {
+	T_Free( wheel->timers );
+	T_Free( wheel );
+}
+
+
+/*
+====================
+T_TimerAdd
+
+Returns a timer that stays valid until T_TimerRemove, even after it fires.
+====================
+*/
+t_int T_TimerAdd( t_timerWheel_t *const wheel, const t_uint64 deadline, const t_uint64 data ) {
+	t_int timer;
+
+	if ( wheel->freeTimer == -1 ) {
+		const t_int capacity = wheel->capacity > 0 ? wheel->capacity * 2 : WHEEL_INITIAL_TIMERS;
+
+		t_timerNode_t *const timers = ( t_timerNode_t * )T_Malloc( sizeof( t_timerNode_t ) * capacity );
+		t_int i;
+
+		if ( wheel->timers ) {
+			memcpy( timers, wheel->timers, sizeof( t_timerNode_t ) * wheel->capacity );
+			T_Free( wheel->timers );
+		}
+
+		for ( i = wheel->capacity; i < capacity; ++i ) {
+			timers[i].list = TIMER_FREE;
+			timers[i].next = i + 1 < capacity ? i + 1 : -1;
+		}
+
+		wheel->freeTimer = wheel->capacity;
+		wheel->timers = timers;
+		wheel->capacity = capacity;
+	}
+
+	timer = wheel->freeTimer;
+	wheel->freeTimer = wheel->timers[timer].next;
+
+	wheel->timers[timer].data = data;
+	wheel->timers[timer].list = TIMER_UNARMED;
+	T_TimerSet( wheel, timer, deadline );
+	return timer;
+}
+
+
+/*
+====================
+T_TimerSet
+
+Arms or re-arms a timer. It never fires before the deadline.
+====================
+*/
+void T_TimerSet( t_timerWheel_t *const wheel, const t_int timer, const t_uint64 deadline ) {
+	Unlink( wheel, timer );
+	wheel->timers[timer].expires = ( deadline + wheel->resolution - 1 ) / wheel->resolution;
+	Link( wheel, timer );
+}
+
+
+/*
+====================
+T_TimerRemove
+====================
+*/
+void T_TimerRemove( t_timerWheel_t *const wheel, const t_int timer ) {
+	Unlink( wheel, timer );
+	wheel->timers[timer].list = TIMER_FREE;
+	wheel->timers[timer].next = wheel->freeTimer;
+	wheel->freeTimer = timer;
+}
+
+
+/*
+====================
+T_TimerAdvance
+
+Fires every timer due at or before now. A fired timer is disarmed before its
+callback runs, so the callback may re-arm or remove it.
+====================
+*/
+t_int T_TimerAdvance( t_timerWheel_t *const wheel, const t_uint64 now, void ( *expire )( void *, const t_uint64 ), void *const context ) {
+	const t_uint64 target = now / wheel->resolution;
+
+	t_int count = 0;
+
+	while ( wheel->now <= target ) {
+		t_int level;
+		t_int list;
+		t_int timer;
+
+		// Nothing armed anywhere, skip straight to the target.
+		if ( !( wheel->occupied[0] | wheel->occupied[1] | wheel->occupied[2] | wheel->occupied[3] ) ) {
+			wheel->now = target + 1;
+			break;
+		}
+
+		// Entering a new slot on a higher level brings its timers down.
+		for ( level = 1; level < WHEEL_LEVELS; ++level ) {
+			if ( ( wheel->now & ( ( 1ULL << ( WHEEL_BITS * level ) ) - 1 ) ) != 0 ) {
+				break;
+			}
+			Cascade( wheel, level );
+		}
+
+		list = ( t_int )( wheel->now & WHEEL_MASK );
+		wheel->firing = t_true;
+		while ( ( timer = wheel->lists[list] ) != -1 ) {
+			Unlink( wheel, timer );
+			expire( context, wheel->timers[timer].data );
+			++count;
+		}
+		wheel->firing = t_false;
+
+		++wheel->now;
+	}
+	return count;
+}
+
+
+/*
+====================
+T_TimerNextDeadline
+
+Earliest time the wheel needs attention: either a timer's deadline or the
+point where a higher level cascades. Returns T_TIMER_NONE when nothing is armed.
+====================
+*/
+t_uint64 T_TimerNextDeadline( const t_timerWheel_t *const wheel ) {
+	t_uint64 best = T_TIMER_NONE;
+	t_int level;
+
+	for ( level = 0; level < WHEEL_LEVELS; ++level ) {
+		const t_int shift = WHEEL_BITS * level;
+		const t_uint64 index = wheel->now >> shift;
+		const t_uint64 occupied = wheel->occupied[level];
+
+		t_int first;
+		t_int distance;
+
+		if ( !occupied ) {
+			continue;
+		}
+
+		// Level 0 slots fire on their own tick, starting with the current one.
+		// Higher level slots are handled when the wheel enters them, which for
+		// the current slot is still ahead only if the wheel sits on its boundary.
+		first = ( level == 0 || ( wheel->now & ( ( 1ULL << shift ) - 1 ) ) == 0 ) ? 0 : 1;
+
+		for ( distance = first; distance <= WHEEL_SIZE; ++distance ) {
+			if ( occupied & ( 1ULL << ( ( index + distance ) & WHEEL_MASK ) ) ) {
+				const t_uint64 tick = level == 0 ? wheel->now + distance : ( index + distance ) << shift;
+
+				if ( tick < best ) {
+					best = tick;
+				}
+				break;
+			}
+		}
+	}
+
+	return best == T_TIMER_NONE ? T_TIMER_NONE : best * wheel->resolution;
+}
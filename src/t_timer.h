@@ -0,0 +1,45 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _T_TIMER_H_
+#define _T_TIMER_H_
+
+#include "t_common.h"
+
+#define T_TIMER_NONE 0xffffffffffffffffULL
+
+typedef struct t_timerWheel_s t_timerWheel_t;
+
+t_timerWheel_t *T_CreateTimerWheel( const t_uint64 now, const t_uint resolution );
+void T_DestroyTimerWheel( t_timerWheel_t *const wheel );
+t_int T_TimerAdd( t_timerWheel_t *const wheel, const t_uint64 deadline, const t_uint64 data );
+void T_TimerSet( t_timerWheel_t *const wheel, const t_int timer, const t_uint64 deadline );
+void T_TimerRemove( t_timerWheel_t *const wheel, const t_int timer );
+t_int T_TimerAdvance( t_timerWheel_t *const wheel, const t_uint64 now, void ( *expire )( void *, const t_uint64 ), void *const context );
+t_uint64 T_TimerNextDeadline( const t_timerWheel_t *const wheel );
+
+#endif // _T_TIMER_H_
@@ -0,0 +1,391 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "t_uring.h"
+
+#if defined( T_USE_URING ) && defined( __linux__ )
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <time.h>
+
+struct t_uring_s {
+	int fd;
+
+	// Submission queue.
+	void *sqRing;
+	size_t sqRingSize;
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	unsigned sqEntries;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+	unsigned sqLocalTail;
+	unsigned pending;
+
+	// Completion queue.
+	void *cqRing;
+	size_t cqRingSize;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+};
+
+
+/*
+====================
+Enter
+====================
+*/
+static t_int Enter( t_uring_t *const uring, const unsigned submit, const unsigned wait, const unsigned flags, void *const arg, const size_t argSize ) {
+	return ( t_int )syscall( __NR_io_uring_enter, uring->fd, submit, wait, flags, arg, argSize );
+}
+
+
+/*
+====================
+Flush
+
+Publishes queued entries to the kernel's submission ring and submits them.
+====================
+*/
+static t_bool Flush( t_uring_t *const uring ) {
+	t_int result;
+
+	if ( uring->pending == 0 ) {
+		return t_true;
+	}
+
+	__atomic_store_n( uring->sqTail, uring->sqLocalTail, __ATOMIC_RELEASE );
+	do {
+		result = Enter( uring, uring->pending, 0, 0, NULL, 0 );
+	} while ( result == SOCKET_ERROR && errno == EINTR );
+
+	if ( result == SOCKET_ERROR ) {
+		T_Error( "T_URing: Unable to submit entries.\n" );
+		return t_false;
+	}
+
+	uring->pending -= result;
+	return t_true;
+}
+
+
+/*
+====================
+GetEntry
+====================
+*/
+static struct io_uring_sqe *GetEntry( t_uring_t *const uring ) {
+	struct io_uring_sqe *sqe;
+	unsigned index;
+
+	// The submission ring is full, hand what we have to the kernel first.
+	if ( uring->sqLocalTail - __atomic_load_n( uring->sqHead, __ATOMIC_ACQUIRE ) >= uring->sqEntries ) {
+		if ( !Flush( uring ) || uring->sqLocalTail - __atomic_load_n( uring->sqHead, __ATOMIC_ACQUIRE ) >= uring->sqEntries ) {
+			return NULL;
+		}
+	}
+
+	index = uring->sqLocalTail & *uring->sqMask;
+	uring->sqArray[index] = index;
+	++uring->sqLocalTail;
+	++uring->pending;
+
+	sqe = &uring->sqes[index];
+	memset( sqe, 0, sizeof( *sqe ) );
+	return sqe;
+}
+
+
+/*
+====================
+T_CreateURing
+
+Returns NULL when io_uring is unavailable, so callers can fall back to polling.
+====================
+*/
+t_uring_t *T_CreateURing( const t_uint entries ) {
+	struct io_uring_params params;
+	t_uring_t *const uring = ( t_uring_t * )T_Malloc0( sizeof( t_uring_t ) );
+
+	memset( &params, 0, sizeof( params ) );
+	if ( ( uring->fd = ( int )syscall( __NR_io_uring_setup, entries, &params ) ) == SOCKET_ERROR ) {
+		T_Free( uring );
+		return NULL;
+	}
+
+	// Timed waits need IORING_ENTER_EXT_ARG.
+	if ( !( params.features & IORING_FEAT_EXT_ARG ) || !( params.features & IORING_FEAT_SINGLE_MMAP ) ) {
+		close( uring->fd );
+		T_Free( uring );
+		return NULL;
+	}
+
+	uring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	uring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	if ( uring->cqRingSize > uring->sqRingSize ) {
+		uring->sqRingSize = uring->cqRingSize;
+	}
+
+	uring->sqRing = mmap( NULL, uring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING );
+	if ( uring->sqRing == MAP_FAILED ) {
+		close( uring->fd );
+		T_Free( uring );
+		return NULL;
+	}
+	uring->cqRing = uring->sqRing;
+
+	uring->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+	uring->sqes = ( struct io_uring_sqe * )mmap( NULL, uring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES );
+	if ( uring->sqes == MAP_FAILED ) {
+		munmap( uring->sqRing, uring->sqRingSize );
+		close( uring->fd );
+		T_Free( uring );
+		return NULL;
+	}
+
+	uring->sqHead = ( unsigned * )( ( t_byte * )uring->sqRing + params.sq_off.head );
+	uring->sqTail = ( unsigned * )( ( t_byte * )uring->sqRing + params.sq_off.tail );
+	uring->sqMask = ( unsigned * )( ( t_byte * )uring->sqRing + params.sq_off.ring_mask );
+	uring->sqArray = ( unsigned * )( ( t_byte * )uring->sqRing + params.sq_off.array );
+	uring->sqEntries = params.sq_entries;
+	uring->sqLocalTail = *uring->sqTail;
+	uring->pending = 0;
+
+	uring->cqHead = ( unsigned * )( ( t_byte * )uring->cqRing + params.cq_off.head );
+	uring->cqTail = ( unsigned * )( ( t_byte * )uring->cqRing + params.cq_off.tail );
+	uring->cqMask = ( unsigned * )( ( t_byte * )uring->cqRing + params.cq_off.ring_mask );
+	uring->cqes = ( struct io_uring_cqe * )( ( t_byte * )uring->cqRing + params.cq_off.cqes );
+	return uring;
+}
+
+
+/*
+====================
+T_DestroyURing
+====================
+*/
+void T_DestroyURing( t_uring_t *const uring ) {
+	munmap( uring->sqes, uring->sqesSize );
+	munmap( uring->sqRing, uring->sqRingSize );
+	close( uring->fd );
+	T_Free( uring );
+}
+
+
+/*
+====================
+T_URingAccept
+====================
+*/
+t_bool T_URingAccept( t_uring_t *const uring, const SOCKET socket, void *const data ) {
+	struct io_uring_sqe *const sqe = GetEntry( uring );
+
+	if ( !sqe ) {
+		return t_false;
+	}
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = socket;
+	// Non-blocking like the poll loop's sockets, so a send to a client that
+	// stopped reading comes back instead of stalling the reactor.
+	sqe->accept_flags = SOCK_CLOEXEC | SOCK_NONBLOCK;
+	sqe->user_data = ( t_uint64 )( size_t )data;
+	return t_true;
+}
+
+
+/*
+====================
+T_URingRecv
+====================
+*/
+t_bool T_URingRecv( t_uring_t *const uring, const SOCKET socket, t_byte *const buffer, const t_int size, void *const data ) {
+	struct io_uring_sqe *const sqe = GetEntry( uring );
+
+	if ( !sqe ) {
+		return t_false;
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = socket;
+	sqe->addr = ( t_uint64 )( size_t )buffer;
+	sqe->len = size;
+	sqe->user_data = ( t_uint64 )( size_t )data;
+	return t_true;
+}
+
+
+/*
+====================
+T_URingRead
+====================
+*/
+t_bool T_URingRead( t_uring_t *const uring, const t_int fd, t_byte *const buffer, const t_int size, const t_uint64 offset, void *const data ) {
+	struct io_uring_sqe *const sqe = GetEntry( uring );
+
+	if ( !sqe ) {
+		return t_false;
+	}
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = ( t_uint64 )( size_t )buffer;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->user_data = ( t_uint64 )( size_t )data;
+	return t_true;
+}
+
+
+/*
+====================
+T_URingPollWrite
+
+Completes once, when the socket can take more data.
+====================
+*/
+t_bool T_URingPollWrite( t_uring_t *const uring, const SOCKET socket, void *const data ) {
+	struct io_uring_sqe *const sqe = GetEntry( uring );
+
+	if ( !sqe ) {
+		return t_false;
+	}
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = socket;
+	sqe->poll32_events = POLLOUT;
+	sqe->user_data = ( t_uint64 )( size_t )data;
+	return t_true;
+}
+
+
+/*
+====================
+T_URingCancel
+
+Cancels every request tagged with data. Everything queued so far is submitted
+right away, so the caller may close the descriptor as soon as this returns.
+The cancelled requests still complete, with -ECANCELED, through T_URingWait.
+====================
+*/
+t_bool T_URingCancel( t_uring_t *const uring, void *const data ) {
+	struct io_uring_sqe *const sqe = GetEntry( uring );
+
+	if ( !sqe ) {
+		return t_false;
+	}
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = ( t_uint64 )( size_t )data;
+	sqe->user_data = 0;
+	return Flush( uring );
+}
+
+
+/*
+====================
+T_URingWait
+
+Submits everything queued and waits up to usec microseconds for completions.
+Completions of cancel requests are consumed here and never returned.
+====================
+*/
+t_int T_URingWait( t_uring_t *const uring, const t_int usec, t_uringCompletion_t *const completions, const t_int maxCompletions ) {
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	unsigned head;
+	unsigned tail;
+	t_int count = 0;
+
+	head = *uring->cqHead;
+	tail = __atomic_load_n( uring->cqTail, __ATOMIC_ACQUIRE );
+
+	// Only sleep when nothing is ready yet.
+	if ( head == tail || uring->pending > 0 ) {
+		__atomic_store_n( uring->sqTail, uring->sqLocalTail, __ATOMIC_RELEASE );
+
+		ts.tv_sec = usec / 1000000;
+		ts.tv_nsec = ( usec % 1000000 ) * 1000;
+		memset( &arg, 0, sizeof( arg ) );
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = ( t_uint64 )( size_t )&ts;
+
+		if ( Enter( uring, uring->pending, head == tail ? 1 : 0, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg ) ) == SOCKET_ERROR ) {
+			if ( errno != ETIME && errno != EINTR ) {
+				return SOCKET_ERROR;
+			}
+		}
+		uring->pending = uring->sqLocalTail - __atomic_load_n( uring->sqHead, __ATOMIC_ACQUIRE );
+		tail = __atomic_load_n( uring->cqTail, __ATOMIC_ACQUIRE );
+	}
+
+	while ( head != tail && count < maxCompletions ) {
+		const struct io_uring_cqe *const cqe = &uring->cqes[head & *uring->cqMask];
+
+		if ( cqe->user_data != 0 ) {
+			completions[count].data = ( void * )( size_t )cqe->user_data;
+			completions[count].result = cqe->res;
+			++count;
+		}
+		++head;
+	}
+
+	__atomic_store_n( uring->cqHead, head, __ATOMIC_RELEASE );
+	return count;
+}
+
+#else
+
+/*
+====================
+T_CreateURing
+
+Built without io_uring support.
+====================
+*/
+t_uring_t *T_CreateURing( const t_uint entries ) {
+	return NULL;
+}
+
+void T_DestroyURing( t_uring_t *const uring ) {}
+t_bool T_URingAccept( t_uring_t *const uring, const SOCKET socket, void *const data ) { return t_false; }
+t_bool T_URingRecv( t_uring_t *const uring, const SOCKET socket, t_byte *const buffer, const t_int size, void *const data ) { return t_false; }
+t_bool T_URingRead( t_uring_t *const uring, const t_int fd, t_byte *const buffer, const t_int size, const t_uint64 offset, void *const data ) { return t_false; }
+t_bool T_URingPollWrite( t_uring_t *const uring, const SOCKET socket, void *const data ) { return t_false; }
+t_bool T_URingCancel( t_uring_t *const uring, void *const data ) { return t_false; }
+t_int T_URingWait( t_uring_t *const uring, const t_int usec, t_uringCompletion_t *const completions, const t_int maxCompletions ) { return SOCKET_ERROR; }
+
+#endif
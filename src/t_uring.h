@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2013, William F. Smith (TIHan)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _T_URING_H_
+#define _T_URING_H_
+
+#include "t_socket.h"
+
+typedef struct {
+	void *data;
+	t_int result;
+} t_uringCompletion_t;
+
+typedef struct t_uring_s t_uring_t;
+
+t_uring_t *T_CreateURing( const t_uint entries );
+void T_DestroyURing( t_uring_t *const uring );
+t_bool T_URingAccept( t_uring_t *const uring, const SOCKET socket, void *const data );
+t_bool T_URingRecv( t_uring_t *const uring, const SOCKET socket, t_byte *const buffer, const t_int size, void *const data );
+t_bool T_URingRead( t_uring_t *const uring, const t_int fd, t_byte *const buffer, const t_int size, const t_uint64 offset, void *const data );
+t_bool T_URingPollWrite( t_uring_t *const uring, const SOCKET socket, void *const data );
+t_bool T_URingCancel( t_uring_t *const uring, void *const data );
+t_int T_URingWait( t_uring_t *const uring, const t_int usec, t_uringCompletion_t *const completions, const t_int maxCompletions );
+
+#endif // _T_URING_H_
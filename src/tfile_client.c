@@ -29,12 +29,31 @@ THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "tfile_shared.h"
 #include "t_pipe.h"
+#include "t_shmring.h"
+#include "t_timer.h"
 #include "tinycthread.h"
 
+#include <sys/stat.h>
+
+#if _WIN32
+#	include <io.h>
+#	include <fcntl.h>
+#elif defined( __linux__ )
+#	include <sys/syscall.h>
+#endif
+
+#define MAX_CLIENT_CONNECTIONS 16
+
 typedef struct {
-	SOCKET ip_socket;
+	SOCKET sockets[MAX_CLIENT_CONNECTIONS];
+	t_int count;
 } client_message_t;
 
+typedef struct {
+	t_char fileName[MAX_FILE_NAME_SIZE];
+	t_char destination[MAX_FILE_NAME_SIZE];
+} client_download_t;
+
 static cnd_t client_condition;
 static mtx_t client_mutex;
 static t_pipe_t *client_pipe;
@@ -49,17 +68,69 @@ CLIENT THREAD
 */
 
 #define HEARTBEAT_INTERVAL 1000 // 1 second.
-
-// Socket
-static SOCKET server;
+#define TIMER_RESOLUTION 10 // 10 milliseconds.
+#define CLIENT_RECEIVE_SIZE 65536
+#define CLIENT_OUTPUT_SIZE ( MAX_PACKET_SIZE + CHUNK_COMMAND_SIZE * MAX_DOWNLOAD_WINDOW )
+#define LOCAL_COPY_SIZE ( 64 * FILE_CHUNK_SIZE ) // Copied per pass of the loop, so heartbeats keep going.
+#define CONTROL_STREAM 0
+#define DOWNLOAD_STREAM 1
+
+typedef enum {
+	TIMER_HEARTBEAT
+} client_timer_t;
+
+// One TCP connection to the server. During a download each connection fetches
+// its own byte range of the file. A local connection is handed the open file
+// instead and copies it itself; a shared one reads its events from a ring.
+typedef struct {
+	SOCKET socket;
+	t_int descriptors[T_MAX_DESCRIPTORS]; // Passed by the server, until the event they came with is handled.
+	t_int descriptor_count;
+	t_shmRing_t *shared; // Events come through here once the server agrees.
+	t_byteStream_t *event; // The event being received, until it is whole.
+	t_byteStream_t *output; // Commands not sent yet.
+
+	// Range
+	t_int64 start;
+	t_int64 end;
+	t_int64 requested;
+	t_int64 received;
+	t_int outstanding;
+	t_int chunk_left; // Payload bytes still to come for the current chunk.
+	t_bool awaiting_start; // CMD_DOWNLOAD sent, no answer yet.
+	t_bool started;
+} client_connection_t;
+
+// Connections
+static client_connection_t connections[MAX_CLIENT_CONNECTIONS];
+static t_int connection_count;
+static t_poll_t *client_poll;
+static t_pollEvent_t client_events[MAX_CLIENT_CONNECTIONS * 2]; // Sockets, and shared ring wakeups.
 
 // Client Time
 static t_bool time_initialized;
 static t_uint64 base_time;
 static t_uint64 client_time;
 
-// Heartbeat Time
-static t_uint64 heartbeat_time;
+// Timers
+static t_timerWheel_t *client_timers;
+static t_int heartbeat_timer;
+
+static t_byte receive_buffer[CLIENT_RECEIVE_SIZE];
+
+// Download
+static t_bool download_active;
+static t_bool download_failed;
+static t_int download_file;
+static t_int download_source = -1; // The server's file, while a local download copies it.
+static t_int64 download_size; // Negative until the first connection hears back.
+static t_bool copy_range = t_true; // Until copy_file_range turns out not to work here.
+
+static t_bool client_local;
+static t_bool client_shared;
+static volatile t_bool client_running;
+static volatile t_bool client_downloading;
+static volatile t_int client_window = DEFAULT_DOWNLOAD_WINDOW;
 
 
 /*
@@ -74,55 +145,909 @@ static void ClientTime( void ) {
 
 /*
 ====================
-HeartbeatTime
+ClientTimeout
+
+How long the loop may wait for the server before a timer is due, in microseconds.
+====================
+*/
+static t_int ClientTimeout( void ) {
+	const t_uint64 deadline = T_TimerNextDeadline( client_timers );
+
+	t_uint64 timeout;
+
+	t_int i;
+
+	// A local copy in progress only checks in with the server between parts.
+	if ( download_source >= 0 ) {
+		return 0;
+	}
+
+	// Neither does a shared ring with events waiting.
+	for ( i = 0; i < connection_count; ++i ) {
+		if ( connections[i].shared && !T_ShmRingWaitData( connections[i].shared ) ) {
+			return 0;
+		}
+	}
+
+	if ( deadline == T_TIMER_NONE ) {
+		return RECEIVE_TIMEOUT;
+	}
+
+	// Still wake up regularly for requests from the pipe.
+	timeout = deadline > client_time ? ( deadline - client_time ) * 1000 : 0;
+	return timeout < RECEIVE_TIMEOUT ? ( t_int )timeout : RECEIVE_TIMEOUT;
+}
+
+
+/*
+====================
+Heartbeat
+====================
+*/
+static void Heartbeat( void ) {
+	t_int i;
+
+	for ( i = 0; i < connection_count; ++i ) {
+		TFile_WriteFrameHeader( connections[i].output, CMD_HEARTBEAT, CONTROL_STREAM, 0 );
+	}
+	T_TimerSet( client_timers, heartbeat_timer, client_time + HEARTBEAT_INTERVAL );
+}
+
+
+/*
+====================
+ClientTimer
+====================
+*/
+static void ClientTimer( void *const context, const t_uint64 timer ) {
+	switch ( timer ) {
+	case TIMER_HEARTBEAT:
+		Heartbeat();
+		break;
+	}
+}
+
+
+/*
+====================
+TryTimers
+====================
+*/
+static void TryTimers( void ) {
+	T_TimerAdvance( client_timers, client_time, ClientTimer, NULL );
+}
+
+
+/*
+====================
+OpenDestination
+====================
+*/
+static t_int OpenDestination( const t_char *const fileName ) {
+#if _WIN32
+	return _open( fileName, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+	return open( fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+#endif
+}
+
+
+/*
+====================
+SizeDestination
+
+Reserves the whole file up front, so ranges can land in any order.
+====================
+*/
+static t_bool SizeDestination( const t_int64 size ) {
+#if _WIN32
+	return _chsize_s( download_file, size ) == 0 ? t_true : t_false;
+#else
+	if ( ftruncate( download_file, ( off_t )size ) != 0 ) {
+		return t_false;
+	}
+#	if defined( __linux__ )
+	// Only a hint; filesystems without it still have the right size.
+	if ( size > 0 ) {
+		posix_fallocate( download_file, 0, ( off_t )size );
+	}
+#	endif
+	return t_true;
+#endif
+}
+
+
+/*
+====================
+WriteDestination
+====================
+*/
+static t_bool WriteDestination( const t_byte *const buffer, const t_int size, const t_int64 offset ) {
+#if _WIN32
+	if ( _lseeki64( download_file, offset, SEEK_SET ) < 0 ) {
+		return t_false;
+	}
+	return _write( download_file, buffer, size ) == size ? t_true : t_false;
+#else
+	return pwrite( download_file, buffer, size, ( off_t )offset ) == size ? t_true : t_false;
+#endif
+}
+
+
+/*
+====================
+CloseDestination
+====================
+*/
+static void CloseDestination( void ) {
+#if _WIN32
+	_close( download_file );
+#else
+	close( download_file );
+#endif
+}
+
+
+/*
+====================
+CloseDescriptor
+====================
+*/
+static void CloseDescriptor( const t_int descriptor ) {
+#if _WIN32
+	_close( descriptor );
+#else
+	close( descriptor );
+#endif
+}
+
+
+/*
+====================
+CloseDescriptors
+
+Closes descriptors the server passed that no event claimed.
 ====================
 */
-static void HeartbeatTime( void ) {
-	heartbeat_time = heartbeat_time == 0 ? client_time + HEARTBEAT_INTERVAL : heartbeat_time;
+static void CloseDescriptors( client_connection_t *const connection ) {
+	t_int i;
+
+	for ( i = 0; i < connection->descriptor_count; ++i ) {
+		CloseDescriptor( connection->descriptors[i] );
+	}
+	connection->descriptor_count = 0;
 }
 
 
 /*
 ====================
-TryHeartbeat
+CopySource
+
+Copies up to size bytes at offset from the server's file into the destination.
+Where copy_file_range works the kernel copies, without passing through here.
+Returns the number of bytes copied; zero or less is an error.
 ====================
 */
-static void TryHeartbeat( void ) {
-	if ( client_time >= heartbeat_time ) {
-		const command_t command = CMD_HEARTBEAT;
-		if ( send( server, ( char * )&command, 1, 0 ) <= 0 ) {
-			T_Error( "Unable to send heartbeat.\n" );
+static t_int CopySource( const t_int64 offset, const t_int size ) {
+	const t_int count = size < CLIENT_RECEIVE_SIZE ? size : CLIENT_RECEIVE_SIZE;
+
+	t_int read;
+
+#if defined( __linux__ ) && defined( __NR_copy_file_range )
+	if ( copy_range ) {
+		t_int64 in = offset;
+		t_int64 out = offset;
+		const long copied = syscall( __NR_copy_file_range, download_source, &in, download_file, &out, ( size_t )size, 0 );
+
+		if ( copied >= 0 ) {
+			return ( t_int )copied;
+		}
+		if ( errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP ) {
+			return SOCKET_ERROR;
 		}
-		heartbeat_time = 0;
+		copy_range = t_false;
+	}
+#endif
+
+#if _WIN32
+	if ( _lseeki64( download_source, offset, SEEK_SET ) < 0 ) {
+		return SOCKET_ERROR;
+	}
+	read = _read( download_source, receive_buffer, count );
+#else
+	read = ( t_int )pread( download_source, receive_buffer, count, ( off_t )offset );
+#endif
+	if ( read <= 0 || !WriteDestination( receive_buffer, read, offset ) ) {
+		return SOCKET_ERROR;
 	}
+	return read;
+}
+
+
+/*
+====================
+FailDownload
+
+Outstanding chunks still arrive and are dropped; the download ends once every
+connection has drained.
+====================
+*/
+static void FailDownload( void ) {
+	download_failed = t_true;
+}
+
+
+/*
+====================
+TryFinishDownload
+====================
+*/
+static void TryFinishDownload( void ) {
+	t_int64 received = 0;
+	t_int i;
+
+	if ( !download_active ) {
+		return;
+	}
+
+	for ( i = 0; i < connection_count; ++i ) {
+		const client_connection_t *const connection = &connections[i];
+
+		if ( connection->awaiting_start || connection->outstanding > 0 ) {
+			return;
+		}
+		received += connection->received;
+	}
+
+	if ( !download_failed && received != download_size ) {
+		return;
+	}
+
+	CloseDestination();
+	download_active = t_false;
+
+	if ( download_failed ) {
+		T_Error( "Download failed.\n" );
+	} else {
+		T_Print( "Download finished.\n" );
+	}
+	client_downloading = t_false;
+}
+
+
+/*
+====================
+SplitRanges
+
+Gives each connection a contiguous, disjoint share of the file.
+====================
+*/
+static void SplitRanges( void ) {
+	t_int i;
+
+	for ( i = 0; i < connection_count; ++i ) {
+		client_connection_t *const connection = &connections[i];
+
+		connection->start = download_size * i / connection_count;
+		connection->end = download_size * ( i + 1 ) / connection_count;
+		connection->requested = connection->start;
+		connection->received = 0;
+	}
+}
+
+
+/*
+====================
+RequestChunks
+
+Keeps the window of chunk requests full, so the server always has the next
+chunk to send while earlier ones are still on the wire.
+====================
+*/
+static void RequestChunks( client_connection_t *const connection ) {
+	const t_int window = client_window;
+
+	if ( !connection->started || download_failed ) {
+		return;
+	}
+
+	while ( connection->outstanding < window && connection->requested < connection->end ) {
+		const t_int64 left = connection->end - connection->requested;
+		const t_int size = left < FILE_CHUNK_SIZE ? ( t_int )left : FILE_CHUNK_SIZE;
+
+		TFile_WriteFrameHeader( connection->output, CMD_FILE_CHUNK, DOWNLOAD_STREAM, sizeof( t_int64 ) + sizeof( t_int ) );
+		T_BSWrite( connection->output, t_int64, connection->requested );
+		T_BSWrite( connection->output, t_int, size );
+
+		connection->requested += size;
+		++connection->outstanding;
+	}
+}
+
+
+/*
+====================
+EventSize
+
+Bytes of the event being gathered that are needed before it can be handled:
+its header, then for a chunk only the offset, otherwise the whole payload.
+Returns SOCKET_ERROR for a frame no event could fill.
+====================
+*/
+static t_int EventSize( const t_byteStream_t *const event ) {
+	frame_header_t frame;
+
+	if ( T_BSGetSize( event ) < ( t_int )FRAME_HEADER_SIZE ) {
+		return FRAME_HEADER_SIZE;
+	}
+
+	TFile_ReadFrameHeader( T_BSGetBuffer( event ), &frame );
+	if ( frame.type == EVT_FILE_CHUNK_READ ) {
+		return frame.length > sizeof( t_int64 ) ? ( t_int )( FRAME_HEADER_SIZE + sizeof( t_int64 ) ) : SOCKET_ERROR;
+	}
+	return frame.length <= MAX_EVENT_SIZE - FRAME_HEADER_SIZE ? ( t_int )( FRAME_HEADER_SIZE + frame.length ) : SOCKET_ERROR;
+}
+
+
+/*
+====================
+EVT_DownloadStarted
+====================
+*/
+static t_bool EVT_DownloadStarted( client_connection_t *const connection, const frame_header_t *const frame ) {
+	t_int64 size;
+
+	if ( frame->length != sizeof( t_int64 ) ) {
+		return t_false;
+	}
+	T_BSRead( connection->event, t_int64, size );
+
+	if ( !connection->awaiting_start ) {
+		return t_false;
+	}
+	connection->awaiting_start = t_false;
+
+	// The first answer sizes the file and splits it between the connections.
+	if ( download_size < 0 && !download_failed ) {
+		download_size = size;
+		SplitRanges();
+		if ( !SizeDestination( size ) ) {
+			T_Error( "EVT_DownloadStarted: Unable to size destination file.\n" );
+			FailDownload();
+		}
+	} else if ( size != download_size ) {
+		FailDownload();
+	}
+
+	connection->started = t_true;
+	RequestChunks( connection );
+
+	// Nothing to ask for when the file, or this connection's range, is empty.
+	TryFinishDownload();
+	return t_true;
+}
+
+
+/*
+====================
+EVT_FileChunkRead
+====================
+*/
+static t_bool EVT_FileChunkRead( client_connection_t *const connection, const frame_header_t *const frame ) {
+	const t_int size = ( t_int )( frame->length - sizeof( t_int64 ) );
+
+	t_int64 offset;
+
+	T_BSRead( connection->event, t_int64, offset );
+
+	// Chunks come back in the order they were asked for, none longer than
+	// asked for, so never past the end of the connection's range.
+	if ( connection->outstanding <= 0 || offset != connection->start + connection->received || size <= 0 ||
+		size > FILE_CHUNK_SIZE || size > connection->end - offset ) {
+		return t_false;
+	}
+	connection->chunk_left = size;
+	return t_true;
+}
+
+
+/*
+====================
+EVT_FileOpened
+
+The server handed over its open file. The copy counts as the connection's one
+outstanding chunk until TryCopy is done with it.
+====================
+*/
+static t_bool EVT_FileOpened( client_connection_t *const connection, const frame_header_t *const frame ) {
+	t_int64 size;
+
+	if ( frame->length != sizeof( t_int64 ) || !connection->awaiting_start || connection->descriptor_count != 1 ) {
+		return t_false;
+	}
+	T_BSRead( connection->event, t_int64, size );
+	connection->awaiting_start = t_false;
+
+	download_source = connection->descriptors[0];
+	connection->descriptor_count = 0;
+	download_size = size;
+	SplitRanges();
+	if ( !SizeDestination( size ) ) {
+		T_Error( "EVT_FileOpened: Unable to size destination file.\n" );
+		FailDownload();
+	}
+	connection->outstanding = 1;
+	return t_true;
+}
+
+
+/*
+====================
+EVT_Shared
+
+The server handed over a shared ring. Every event after this one is read from
+the ring; the socket only tells when the server has gone.
+====================
+*/
+static t_bool EVT_Shared( client_connection_t *const connection, const frame_header_t *const frame ) {
+	t_int64 size;
+
+	if ( frame->length != sizeof( t_int64 ) || connection->shared || connection->descriptor_count != T_SHMRING_DESCRIPTORS ) {
+		return t_false;
+	}
+	T_BSRead( connection->event, t_int64, size );
+
+	connection->descriptor_count = 0;
+	if ( !( connection->shared = T_AttachShmRing( connection->descriptors ) ) ) {
+		return t_false;
+	}
+	if ( T_ShmRingGetSize( connection->shared ) != size || !T_PollAdd( client_poll, T_ShmRingGetDataEvent( connection->shared ), connection - connections ) ) {
+		T_DestroyShmRing( connection->shared );
+		connection->shared = NULL;
+		return t_false;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+HandleControlEvent
+====================
+*/
+static t_bool HandleControlEvent( client_connection_t *const connection, const frame_header_t *const frame ) {
+	switch ( frame->type ) {
+	case EVT_SHARED:
+		return EVT_Shared( connection, frame );
+	case EVT_SHARE_FAILED:
+		T_Print( "File server has no shared ring; events stay on the socket.\n" );
+		return t_true;
+	default:
+		return t_false;
+	}
+}
+
+
+/*
+====================
+HandleEvent
+
+Returns false when the server sent something the client does not understand.
+====================
+*/
+static t_bool HandleEvent( client_connection_t *const connection ) {
+	t_byte header[FRAME_HEADER_SIZE];
+	frame_header_t frame;
+
+	T_BSReadBuffer( connection->event, header, FRAME_HEADER_SIZE );
+	TFile_ReadFrameHeader( header, &frame );
+
+	if ( frame.stream == CONTROL_STREAM ) {
+		return HandleControlEvent( connection, &frame );
+	}
+	if ( frame.stream != DOWNLOAD_STREAM ) {
+		return t_false;
+	}
+
+	switch ( frame.type ) {
+	case EVT_DOWNLOAD_STARTED:
+		return EVT_DownloadStarted( connection, &frame );
+	case EVT_DOWNLOAD_FAILED:
+		if ( !connection->awaiting_start ) {
+			return t_false;
+		}
+		connection->awaiting_start = t_false;
+		FailDownload();
+		TryFinishDownload();
+		return t_true;
+	case EVT_FILE_CHUNK_READ:
+		return EVT_FileChunkRead( connection, &frame );
+	case EVT_FILE_OPENED:
+		return EVT_FileOpened( connection, &frame );
+	case EVT_DOWNLOAD_FINISHED:
+		return t_true;
+	default:
+		return t_false;
+	}
+}
+
+
+/*
+====================
+HandleChunkData
+
+Writes straight into the connection's range of the destination file.
+====================
+*/
+static void HandleChunkData( client_connection_t *const connection, const t_byte *const buffer, const t_int size ) {
+	if ( !download_failed && !WriteDestination( buffer, size, connection->start + connection->received ) ) {
+		T_Error( "HandleChunkData: Unable to write file.\n" );
+		FailDownload();
+	}
+
+	connection->received += size;
+	connection->chunk_left -= size;
+	if ( connection->chunk_left > 0 ) {
+		return;
+	}
+
+	--connection->outstanding;
+	RequestChunks( connection );
+	TryFinishDownload();
+}
+
+
+/*
+====================
+HandlePacket
+
+Chunk payloads are written out as they arrive; only event headers are
+gathered in the connection's event stream.
+====================
+*/
+static t_bool HandlePacket( client_connection_t *const connection, const t_byte *const buffer, const t_int size ) {
+	t_byteStream_t *const event = connection->event;
+
+	t_int position = 0;
+	t_int need;
+	t_int count;
+
+	while ( t_true ) {
+		if ( connection->chunk_left > 0 ) {
+			if ( position == size ) {
+				break;
+			}
+			count = size - position < connection->chunk_left ? size - position : connection->chunk_left;
+			HandleChunkData( connection, buffer + position, count );
+			position += count;
+			continue;
+		}
+
+		if ( ( need = EventSize( event ) ) == SOCKET_ERROR ) {
+			return t_false;
+		}
+
+		if ( T_BSGetSize( event ) == need ) {
+			if ( !HandleEvent( connection ) ) {
+				return t_false;
+			}
+			T_BSReset( event );
+			continue;
+		}
+
+		if ( position == size ) {
+			break;
+		}
+		count = size - position < need - T_BSGetSize( event ) ? size - position : need - T_BSGetSize( event );
+		T_BSWriteBuffer( event, buffer + position, count );
+		position += count;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+ReceiveBytes
+
+A local connection may have descriptors come along with the bytes. Only one
+event that carries them is asked for at a time, so they are kept until it is
+handled.
+====================
+*/
+static t_int ReceiveBytes( client_connection_t *const connection ) {
+	t_int descriptors[T_MAX_DESCRIPTORS];
+	t_int count;
+	t_int bytes;
+
+	if ( !client_local ) {
+		return recv( connection->socket, ( char * )receive_buffer, CLIENT_RECEIVE_SIZE, 0 );
+	}
+
+	bytes = T_ReceiveDescriptors( connection->socket, receive_buffer, CLIENT_RECEIVE_SIZE, descriptors, &count );
+	if ( count > 0 ) {
+		CloseDescriptors( connection );
+		memcpy( connection->descriptors, descriptors, sizeof( t_int ) * count );
+		connection->descriptor_count = count;
+	}
+	return bytes;
+}
+
+
+/*
+====================
+ReceivePacket
+
+Returns false when the connection to the server is gone.
+====================
+*/
+static t_bool ReceivePacket( client_connection_t *const connection ) {
+	t_int bytes;
+
+	// Drain everything the socket has.
+	while ( ( bytes = ReceiveBytes( connection ) ) > 0 ) {
+		if ( !HandlePacket( connection, receive_buffer, bytes ) ) {
+			T_Error( "ReceivePacket: Bad event from server.\n" );
+			return t_false;
+		}
+	}
+	return bytes == SOCKET_ERROR && T_SocketWouldBlock() ? t_true : t_false;
+}
+
+
+/*
+====================
+ReceiveShared
+
+Hands events to HandlePacket straight from the shared ring, chunk payloads
+included, then frees their room for the server.
+Returns false when the server sent something the client does not understand.
+====================
+*/
+static t_bool ReceiveShared( client_connection_t *const connection ) {
+	const t_byte *data;
+	t_int size;
+
+	data = T_ShmRingPeek( connection->shared, &size );
+	while ( size > 0 ) {
+		if ( !HandlePacket( connection, data, size ) ) {
+			T_Error( "ReceiveShared: Bad event from server.\n" );
+			return t_false;
+		}
+		T_ShmRingConsume( connection->shared, size );
+		data = T_ShmRingPeek( connection->shared, &size );
+	}
+	return t_true;
 }
 
 
 /*
 ====================
 TryReceive
+
+Shared rings are read every pass, since the server only signals a client
+that was about to sleep.
 ====================
 */
 static void TryReceive( const int timeout ) {
-	SOCKET read_socket = ZERO_SOCKET;
+	t_int count;
+	t_int i;
+
+	if ( ( count = T_PollWait( client_poll, timeout, client_events, MAX_CLIENT_CONNECTIONS * 2 ) ) == SOCKET_ERROR ) {
+		T_Error( "TryReceive: Poll error.\n" );
+		return;
+	}
+
+	for ( i = 0; i < count; ++i ) {
+		client_connection_t *const connection = &connections[client_events[i].data];
+
+		if ( client_events[i].socket != connection->socket ) {
+			T_ShmRingDrainEvent( client_events[i].socket );
+		} else if ( !ReceivePacket( connection ) ) {
+			break;
+		}
+	}
+
+	if ( i == count ) {
+		for ( i = 0; i < connection_count; ++i ) {
+			if ( connections[i].shared && !ReceiveShared( &connections[i] ) ) {
+				break;
+			}
+		}
+		if ( i == connection_count ) {
+			return;
+		}
+	}
+
+	T_Print( "Lost connection to file server.\n" );
+	FailDownload();
+	client_running = t_false;
+}
+
+
+/*
+====================
+TryCopy
+
+Copies the next part of a file handed over by the server.
+====================
+*/
+static void TryCopy( void ) {
+	client_connection_t *const connection = &connections[0];
+
+	t_int64 left = LOCAL_COPY_SIZE;
+	t_int copied;
+
+	if ( download_source < 0 ) {
+		return;
+	}
+
+	while ( !download_failed && left > 0 && connection->received < download_size ) {
+		const t_int64 remaining = download_size - connection->received;
+
+		if ( ( copied = CopySource( connection->received, remaining < left ? ( t_int )remaining : ( t_int )left ) ) <= 0 ) {
+			T_Error( "TryCopy: Unable to copy file.\n" );
+			FailDownload();
+			break;
+		}
+		connection->received += copied;
+		left -= copied;
+	}
+
+	if ( download_failed || connection->received == download_size ) {
+		CloseDescriptor( download_source );
+		download_source = -1;
+		connection->outstanding = 0;
+		TryFinishDownload();
+	}
+}
+
+
+/*
+====================
+TrySend
+
+Sends as much of the queued commands as the sockets take.
+====================
+*/
+static void TrySend( void ) {
+	t_int sent;
+	t_int i;
+
+	for ( i = 0; i < connection_count; ++i ) {
+		t_byteStream_t *const output = connections[i].output;
+
+		if ( !T_BSCanRead( output ) ) {
+			continue;
+		}
+
+		sent = send( connections[i].socket, ( char * )T_BSGetReadBuffer( output ), T_BSGetReadSize( output ), 0 );
+		if ( sent == SOCKET_ERROR ) {
+			if ( !T_SocketWouldBlock() ) {
+				T_Error( "TrySend: Unable to send to file server.\n" );
+			}
+			continue;
+		}
 
-	if ( T_Select( &server, 1, timeout, &read_socket ) == SOCKET_ERROR ) {
-		T_Error( "TryReceive: Select error.\n" );
+		T_BSSkip( output, sent );
+		T_BSCompact( output );
 	}
+}
+
+
+/*
+====================
+StartDownload
+
+Every connection opens the file; each then asks for its own range. A local
+connection asks for the open file instead, unless its events are shared.
+====================
+*/
+static void StartDownload( void *const data ) {
+	client_download_t *const download = ( client_download_t * )data;
+
+	t_int i;
+
+	if ( download_active ) {
+		T_Error( "StartDownload: A download is already running.\n" );
+		T_Free( download );
+		return;
+	}
+
+	if ( ( download_file = OpenDestination( download->destination ) ) < 0 ) {
+		T_Error( "StartDownload: Unable to open %s.\n", download->destination );
+		T_Free( download );
+		client_downloading = t_false;
+		return;
+	}
+
+	download_active = t_true;
+	download_failed = t_false;
+	download_size = -1;
 
-	// TODO
+	for ( i = 0; i < connection_count; ++i ) {
+		client_connection_t *const connection = &connections[i];
+
+		connection->awaiting_start = t_true;
+		connection->started = t_false;
+		TFile_WriteFrameHeader( connection->output, client_local && !client_shared ? CMD_OPEN : CMD_DOWNLOAD, DOWNLOAD_STREAM, ( t_uint )strlen( download->fileName ) );
+		T_BSWriteBuffer( connection->output, ( const t_byte * )download->fileName, ( t_int )strlen( download->fileName ) );
+	}
+	T_Free( download );
 }
 
 
 /*
 ====================
 ClientInit
+
+A shared connection asks for its ring before anything else, so the reply is
+the first thing the server sends.
 ====================
 */
-static void ClientInit( const SOCKET socket ) {
-	heartbeat_time = 0;
+static void ClientInit( const client_message_t *const message ) {
+	const t_memoryTag_t tag = T_SetMemoryTag( T_TAG_CONNECTION );
+
+	t_int i;
+
 	time_initialized = t_false;
-	server = socket;
+	download_active = t_false;
+	connection_count = message->count;
+	client_poll = T_CreatePoll( T_POLL_DEFAULT, connection_count * 2 );
+
+	for ( i = 0; i < connection_count; ++i ) {
+		client_connection_t *const connection = &connections[i];
+
+		memset( connection, 0, sizeof( client_connection_t ) );
+		connection->socket = message->sockets[i];
+		connection->event = T_CreateByteStream( MAX_EVENT_SIZE );
+		connection->output = T_CreateGrowableByteStream( CLIENT_OUTPUT_SIZE );
+		if ( !T_PollAdd( client_poll, connection->socket, i ) ) {
+			T_FatalError( "ClientInit: Unable to poll connection." );
+		}
+		if ( client_shared ) {
+			TFile_WriteFrameHeader( connection->output, CMD_SHARE, CONTROL_STREAM, sizeof( t_int ) );
+			T_BSWrite( connection->output, t_int, SHARED_RING_SIZE );
+		}
+	}
+	T_SetMemoryTag( tag );
+
+	ClientTime();
+	client_timers = T_CreateTimerWheel( client_time, TIMER_RESOLUTION );
+	heartbeat_timer = T_TimerAdd( client_timers, client_time + HEARTBEAT_INTERVAL, TIMER_HEARTBEAT );
+}
+
+
+/*
+====================
+ClientShutdown
+====================
+*/
+static void ClientShutdown( void ) {
+	t_int i;
+
+	if ( download_active ) {
+		CloseDestination();
+		download_active = t_false;
+		client_downloading = t_false;
+	}
+	if ( download_source >= 0 ) {
+		CloseDescriptor( download_source );
+		download_source = -1;
+	}
+
+	for ( i = 0; i < connection_count; ++i ) {
+		CloseDescriptors( &connections[i] );
+		if ( connections[i].shared ) {
+			T_PollRemove( client_poll, T_ShmRingGetDataEvent( connections[i].shared ) );
+			T_DestroyShmRing( connections[i].shared );
+		}
+		T_PollRemove( client_poll, connections[i].socket );
+		T_DestroyByteStream( connections[i].event );
+		T_DestroyByteStream( connections[i].output );
+	}
+	T_DestroyPoll( client_poll );
+	T_DestroyTimerWheel( client_timers );
 }
 
 
@@ -132,10 +1057,10 @@ HandleMessage
 ====================
 */
 static void HandleMessage( const void *const arg ) {
-	const client_message_t message = *( client_message_t * )arg;
+	const client_message_t *const message = ( client_message_t * )arg;
 
 	// Initialize client.
-	ClientInit( message.ip_socket );
+	ClientInit( message );
 
 	mtx_lock( &client_mutex );
 	mtx_unlock( &client_mutex );
@@ -152,19 +1077,28 @@ static t_int ClientThread( void *arg ) {
 	// Handle the message sent by the calling thread.
 	HandleMessage( arg );
 
-	while ( 1 ) {
+	while ( client_running ) {
+		// Try to receive data from the server, waiting no longer than the next timer.
+		TryReceive( ClientTimeout() );
+
 		// Client's life time.
 		ClientTime();
 
-		// Time interval of when to send a heartbeat.
-		HeartbeatTime();
+		// Start downloads asked for by the calling thread.
+		T_PipeReceive( client_pipe, StartDownload );
 
-		// Try to receive data from the server.
-		TryReceive( RECEIVE_TIMEOUT );
+		// Send a heartbeat when it is due.
+		TryTimers();
 
-		// Try to send a heartbeat.
-		TryHeartbeat();
+		// Copy a file handed over on a local connection.
+		TryCopy();
+
+		// Send queued commands.
+		TrySend();
 	}
+
+	ClientShutdown();
+	T_FlushThreadCache();
 	return 0;
 }
 
@@ -178,25 +1112,62 @@ CLIENT
 */
 
 
-static SOCKET client_socket = INVALID_SOCKET;
+static SOCKET client_sockets[MAX_CLIENT_CONNECTIONS];
+static t_int client_socket_count = 0;
 static t_bool client_connected = t_false;
 static thrd_t client_thread;
 
 
+/*
+====================
+CreateLocalClient
+====================
+*/
+static t_bool CreateLocalClient( const t_char *const path, SOCKET *const client ) {
+	struct sockaddr_storage address;
+	t_int length;
+
+	if ( !T_LocalAddress( path, &address, &length ) ) {
+		T_Error( "CreateLocalClient: Local sockets are not available for %s.\n", path );
+		return t_false;
+	}
+
+	// Attempt to create a socket.
+	if ( ( *client = socket( AF_UNIX, SOCK_STREAM, 0 ) ) == INVALID_SOCKET ) {
+		T_Error( "CreateLocalClient: Unable to create socket.\n" );
+		return t_false;
+	}
+
+	// Connect to the server and set the socket to non-blocking.
+	if ( connect( *client, ( struct sockaddr * )&address, length ) == SOCKET_ERROR || T_SocketNonBlocking( *client ) == SOCKET_ERROR ) {
+		TFile_CleanupFailedSocket( "CreateLocalClient: Unable to connect to local socket.\n", *client, NULL );
+		*client = INVALID_SOCKET;
+		return t_false;
+	}
+	return t_true;
+}
+
+
 /*
 ====================
 CreateClient
 
+A local address connects over a local socket; the port is not used.
 TODO: Break out normal socket errors.
 ====================
 */
 static t_bool CreateClient( const t_char *const ip, const t_int port, SOCKET *const socket ) {
 	const struct addrinfo hints = T_CreateHints( AF_UNSPEC, SOCK_STREAM, 0 );
+	const t_char *const path = TFile_LocalPath( ip );
 
 	struct addrinfo defaultInfo = T_CreateAddressInfo();
 	struct addrinfo *result = &defaultInfo;
 	t_char portStr[MAX_PORT_SIZE];
 
+	if ( path ) {
+		return CreateLocalClient( path, socket );
+	}
+
 	T_itoa( port, portStr, MAX_PORT_SIZE );
 
 	// Get address info.
@@ -226,37 +1197,87 @@ static t_bool CreateClient( const t_char *const ip, const t_int port, SOCKET *co
 		return t_false;
 	}
 
+	// Requests are small and latency bound.
+	T_SocketNoDelay( *socket );
+
 	// Free up what was allocated from getaddrinfo.
 	freeaddrinfo( result );
 	return t_true;
 }
 
 
+/*
+====================
+CloseClientSockets
+====================
+*/
+static void CloseClientSockets( void ) {
+	t_int i;
+
+	for ( i = 0; i < client_socket_count; ++i ) {
+		TFile_TryCloseSocket( client_sockets[i] );
+	}
+	client_socket_count = 0;
+}
+
+
 /*
 ====================
 TFile_ClientConnect
 ====================
 */
 t_bool TFile_ClientConnect( const t_char *ip, const t_int port ) {
+	return TFile_ClientConnectParallel( ip, port, 1 );
+}
+
+
+/*
+====================
+TFile_ClientConnectParallel
+
+Opens several connections to the same server. Downloads are split into one
+byte range per connection, so a single large file travels over several TCP
+flows at once. A local or shared address gets one connection, since files are
+copied directly, or read from memory, rather than sent.
+====================
+*/
+t_bool TFile_ClientConnectParallel( const t_char *ip, const t_int port, const t_int connections ) {
+	const t_bool local = TFile_LocalPath( ip ) ? t_true : t_false;
+	const t_int count = connections < 1 || local ? 1 : ( connections > MAX_CLIENT_CONNECTIONS ? MAX_CLIENT_CONNECTIONS : connections );
+
 	client_message_t message;
+	t_int i;
 
-	client_pipe = T_CreatePipe();
-	if ( !CreateClient( ip, port, &client_socket ) ) {
-		T_Error( "TFile_Connect: Unable to connect to %s.\n", ip );
+	if ( client_connected ) {
 		return t_false;
 	}
+	client_local = local;
+	client_shared = TFile_SharedAddress( ip );
+
+	for ( i = 0; i < count; ++i ) {
+		if ( !CreateClient( ip, port, &client_sockets[i] ) ) {
+			T_Error( "TFile_Connect: Unable to connect to %s.\n", ip );
+			CloseClientSockets();
+			return t_false;
+		}
+		message.sockets[i] = client_sockets[i];
+		client_socket_count = i + 1;
+	}
+	message.count = count;
 
+	client_pipe = T_CreatePipe();
 	cnd_init( &client_condition );
 	mtx_init( &client_mutex, mtx_plain );
 	mtx_lock( &client_mutex );
 
-	message.ip_socket = client_socket;
+	client_running = t_true;
 	if ( thrd_create( &client_thread, ClientThread, &message ) != thrd_success ) {
 		T_FatalError( "TFile_ClientConnect: Unable to create thread" );
 	}
 
 	cnd_wait( &client_condition, &client_mutex );
 
+	mtx_unlock( &client_mutex );
 	mtx_destroy( &client_mutex );
 	cnd_destroy( &client_condition );
 
@@ -272,8 +1293,71 @@ TFile_ShutdownClient
 ====================
 */
 void TFile_ShutdownClient( void ) {
+	if ( !client_connected ) {
+		return;
+	}
+
 	client_connected = t_false;
+	client_running = t_false;
+	thrd_join( client_thread, NULL );
+
 	T_DestroyPipe( client_pipe );
-	TFile_TryCloseSocket( client_socket );
+	CloseClientSockets();
 	T_Print( "Disconnect from file server.\n" );
+}
+
+
+/*
+====================
+TFile_ClientDownload
+
+Downloads fileName from the server into destination. Progress is reported by
+TFile_ClientIsDownloading.
+====================
+*/
+t_bool TFile_ClientDownload( const t_char *const fileName, const t_char *const destination ) {
+	client_download_t *download;
+	t_memoryTag_t tag;
+
+	if ( !client_connected || client_downloading ) {
+		return t_false;
+	}
+
+	if ( strlen( fileName ) >= MAX_FILE_NAME_SIZE || strlen( destination ) >= MAX_FILE_NAME_SIZE ) {
+		T_Error( "TFile_ClientDownload: File name is too long.\n" );
+		return t_false;
+	}
+
+	tag = T_SetMemoryTag( T_TAG_TRANSFER );
+	download = ( client_download_t * )T_Malloc( sizeof( client_download_t ) );
+	T_SetMemoryTag( tag );
+	strcpy( download->fileName, fileName );
+	strcpy( download->destination, destination );
+
+	client_downloading = t_true;
+	T_PipeSend( client_pipe, download );
+	return t_true;
+}
+
+
+/*
+====================
+TFile_ClientIsDownloading
+====================
+*/
+t_bool TFile_ClientIsDownloading( void ) {
+	return client_downloading;
+}
+
+
+/*
+====================
+TFile_ClientSetWindow
+
+Number of chunk requests kept outstanding during a download. A wider window
+keeps long, fast links busy.
+====================
+*/
+void TFile_ClientSetWindow( const t_int chunks ) {
+	client_window = chunks < 1 ? 1 : ( chunks > MAX_DOWNLOAD_WINDOW ? MAX_DOWNLOAD_WINDOW : chunks );
 }
\ No newline at end of file
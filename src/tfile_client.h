@@ -28,4 +28,8 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #include "t_common.h"
 
 t_bool TFile_ClientConnect( const t_char *ip, const t_int port );
+t_bool TFile_ClientConnectParallel( const t_char *ip, const t_int port, const t_int connections );
 void TFile_ShutdownClient( void );
+t_bool TFile_ClientDownload( const t_char *const fileName, const t_char *const destination );
+t_bool TFile_ClientIsDownloading( void );
+void TFile_ClientSetWindow( const t_int chunks );
@@ -28,19 +28,49 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #include "tfile_server.h"
 
 #include "tfile_shared.h"
+#include "t_diskpool.h"
+#include "t_fdcache.h"
+#include "t_filecache.h"
 #include "t_pipe.h"
+#include "t_ring.h"
+#include "t_sendqueue.h"
+#include "t_shmring.h"
+#include "t_timer.h"
+#include "t_uring.h"
 #include "tinycthread.h"
 
 #include <stdio.h>
+#include <sys/stat.h>
+
+#if _WIN32
+#	include <io.h>
+#	include <fcntl.h>
+#	define ATOMIC_INCREMENT( target ) InterlockedIncrement( ( LONG volatile * )( target ) )
+#	define ATOMIC_DECREMENT( target ) InterlockedDecrement( ( LONG volatile * )( target ) )
+#else
+#	include <fcntl.h>
+#	include <signal.h>
+#	define ATOMIC_INCREMENT( target ) __atomic_add_fetch( ( target ), 1, __ATOMIC_ACQ_REL )
+#	define ATOMIC_DECREMENT( target ) __atomic_sub_fetch( ( target ), 1, __ATOMIC_ACQ_REL )
+#endif
+
+typedef struct server_reactor_s server_reactor_t;
 
 typedef struct {
-	SOCKET ip_socket;
-	SOCKET ip6_socket;
+	server_reactor_t *reactor;
 } server_message_t;
 
 static cnd_t server_condition;
 static mtx_t server_mutex;
 static t_pipe_t *server_pipe;
+static t_diskPool_t *server_disk; // NULL while file reads stay in the loops.
+static t_fileCache_t *server_cache; // NULL while every file is read from disk.
+static t_fdCache_t *server_descriptors; // NULL while every download opens its file.
+
+// Loop timing switches, written by any thread and picked up by each reactor
+// at the top of its next pass.
+static volatile t_bool server_stats_enabled = t_false;
+static volatile t_uint server_stats_generation = 0;
 
 
 /*
@@ -51,36 +81,617 @@ SERVER THREAD
 ============================================================================
 */
 
-#define MAX_CONNECTIONS 254
-#define MAX_SOCKETS MAX_CONNECTIONS + 2 // 2 represents IPv4 and IPv6 sockets.
+#define INITIAL_CONNECTIONS 64
+#define MAX_EVENTS 256
 #define CONNECTION_TIMEOUT 5000 // 5 seconds.
-#define CHECK_CONNECTIONS_INTERVAL 1000 // 1 second.
+#define TIMER_RESOLUTION 10 // 10 milliseconds.
+#define MAX_WAIT_TIMEOUT 1000 // 1 second, also bounds how long shutdown waits.
 #define MAX_EVENT_QUEUE_SIZE 8192
+#define URING_ENTRIES 256
+#define CONNECTION_RING_SIZE 4096 // Room for a partial command frame plus a packet.
+#define MEMORY_REPORT_INTERVAL 10000 // 10 seconds, when built with T_MALLOC_STATS.
+#define MAX_QUEUED_SEGMENTS ( ( MAX_DOWNLOAD_WINDOW + 2 ) * 2 ) // A header and a file range per chunk, plus the started and finished events.
+#define MAX_LISTENERS 3 // IPv4, IPv6 and the local socket.
+#define MAX_PENDING_REQUESTS ( MAX_DOWNLOAD_WINDOW + 1 ) // The chunk window, plus the open that starts it.
+#define DEFAULT_DISK_WORKERS 4
+#define DEFAULT_READ_AHEAD 2 // One chunk going out, the next ones already read.
+#define DEFAULT_CACHE_SIZE ( 64 * 1024 * 1024 )
+#define MAX_CACHED_FILE_SIZE ( 4 * 1024 * 1024 ) // Larger files are always sent from disk.
+#define DEFAULT_OPEN_FILES 256
+#define DEFAULT_STAT_TIMEOUT 1000 // 1 second.
+
+static t_int server_read_ahead = DEFAULT_READ_AHEAD; // Chunks read past the last one asked for.
+static t_int64 server_cache_size = DEFAULT_CACHE_SIZE; // Bytes of file contents kept in memory.
+
+// Shared by a connection, the disk reads in flight on it, and the chunks of it
+// queued from memory, which hold a reference each. Only the reactor that
+// opened the file counts them.
+typedef struct {
+	t_int fd; // -1 when the contents came from the cache.
+	t_int64 size;
+	t_cachedFile_t *cached; // The contents, when they are in memory.
+	t_cachedFd_t *descriptor; // Holds fd open, when it is shared through the descriptor cache.
+	t_fileKey_t key; // Tells reads of the same file apart from others.
+	t_int references;
+} t_file_t;
+
+
+/*
+====================
+ServerValidFileName
+
+Files are served from the working directory down; absolute paths and parent
+directories are refused.
+====================
+*/
+static t_bool ServerValidFileName( const t_char *const fileName ) {
+	const t_char *c;
+
+	if ( fileName[0] == '\0' || fileName[0] == '/' || fileName[0] == '\\' ) {
+		return t_false;
+	}
+
+	for ( c = fileName; *c != '\0'; ++c ) {
+		if ( *c == ':' ) {
+			return t_false;
+		}
+		if ( c[0] == '.' && c[1] == '.' && ( c == fileName || c[-1] == '/' || c[-1] == '\\' ) && ( c[2] == '\0' || c[2] == '/' || c[2] == '\\' ) ) {
+			return t_false;
+		}
+	}
+	return t_true;
+}
+
+
+/*
+====================
+ServerCloseDescriptor
+
+Lets go of the file's descriptor, which may stay open in the descriptor cache.
+====================
+*/
+static void ServerCloseDescriptor( t_file_t *const file ) {
+	if ( file->descriptor ) {
+		T_FdCacheRelease( file->descriptor );
+		file->descriptor = NULL;
+	} else {
+#if _WIN32
+		_close( file->fd );
+#else
+		close( file->fd );
+#endif
+	}
+	file->fd = -1;
+}
+
+
+/*
+====================
+ServerCloseFile
+====================
+*/
+static void ServerCloseFile( t_file_t *const file ) {
+	if ( file->cached ) {
+		T_FileCacheRelease( file->cached );
+		return;
+	}
+	ServerCloseDescriptor( file );
+}
+
+
+/*
+====================
+ServerShareFile
+
+Moves a file that was just opened to the heap, where reads in flight can keep
+it open after its connection is done with it.
+====================
+*/
+static t_file_t *ServerShareFile( const t_file_t *const opened ) {
+	t_file_t *const file = ( t_file_t * )T_Malloc( sizeof( t_file_t ) );
+
+	*file = *opened;
+	file->references = 1;
+	return file;
+}
+
+
+/*
+====================
+ServerReleaseFile
+====================
+*/
+static void ServerReleaseFile( t_file_t *const file ) {
+	if ( --file->references == 0 ) {
+		ServerCloseFile( file );
+		T_Free( file );
+	}
+}
+
+
+/*
+====================
+ServerReleaseSent
+
+The send queue is done with a chunk of a cached file.
+====================
+*/
+static void ServerReleaseSent( void *const context ) {
+	ServerReleaseFile( ( t_file_t * )context );
+}
+
+
+/*
+====================
+ServerAdviseFile
+
+Asks the kernel to start reading a range in the background, so it is cached
+by the time the range is sent.
+====================
+*/
+static void ServerAdviseFile( const t_file_t *const file, const t_int64 offset, const t_int64 size ) {
+#if defined( POSIX_FADV_WILLNEED )
+	posix_fadvise( file->fd, ( off_t )offset, ( off_t )size, POSIX_FADV_WILLNEED );
+#endif
+}
+
+
+/*
+====================
+ServerReadFile
+
+Reads at offset without moving a shared file position, so any number of
+workers may read one file at once.
+Returns the number of bytes read, short only at the end of the file, or -1.
+====================
+*/
+static t_int ServerReadFile( const t_file_t *const file, t_byte *const buffer, const t_int size, const t_int64 offset ) {
+#if _WIN32
+	OVERLAPPED overlapped;
+	DWORD read;
+
+	memset( &overlapped, 0, sizeof( overlapped ) );
+	overlapped.Offset = ( DWORD )offset;
+	overlapped.OffsetHigh = ( DWORD )( offset >> 32 );
+	return ReadFile( ( HANDLE )_get_osfhandle( file->fd ), buffer, size, &read, &overlapped ) ? ( t_int )read : -1;
+#else
+	t_int total = 0;
+	ssize_t bytes;
+
+	while ( total < size ) {
+		if ( ( bytes = pread( file->fd, buffer + total, size - total, ( off_t )( offset + total ) ) ) > 0 ) {
+			total += ( t_int )bytes;
+		} else if ( bytes == 0 ) {
+			break;
+		} else if ( errno != EINTR ) {
+			return -1;
+		}
+	}
+	return total;
+#endif
+}
+
+
+/*
+====================
+ServerFindCachedFile
+
+Looks for the file at fileName in the cache, without opening it.
+====================
+*/
+static t_bool ServerFindCachedFile( const char *const fileName, t_file_t *const file ) {
+	t_fileKey_t key;
+
+	if ( !T_FileKeyFromPath( fileName, &key ) || !( file->cached = T_FileCacheFind( server_cache, fileName, &key ) ) ) {
+		return t_false;
+	}
+	file->fd = -1;
+	file->size = key.size;
+	file->key = key;
+	return t_true;
+}
+
+
+/*
+====================
+ServerCacheFile
+
+Reads a file that was just opened into the cache, if it is small enough and
+fits, and lets go of its descriptor. Otherwise it stays open to be read as it
+goes out.
+====================
+*/
+static void ServerCacheFile( const char *const fileName, t_file_t *const file, const t_fileKey_t *const key ) {
+	t_memoryTag_t tag;
+	t_byte *data;
+
+	// No one file may push out most of the others.
+	if ( file->size <= 0 || file->size > MAX_CACHED_FILE_SIZE || file->size > server_cache_size / 4 ) {
+		return;
+	}
+
+	tag = T_SetMemoryTag( T_TAG_CACHE );
+	data = ( t_byte * )T_Malloc( ( t_uint )file->size );
+	T_SetMemoryTag( tag );
+
+	// A file that changed under the read is left to the next open.
+	if ( ServerReadFile( file, data, ( t_int )file->size, 0 ) != file->size ) {
+		T_Free( data );
+		return;
+	}
+
+	if ( ( file->cached = T_FileCacheInsert( server_cache, fileName, key, data ) ) ) {
+		ServerCloseDescriptor( file );
+	}
+}
+
+
+/*
+====================
+ServerOpenFile
+
+With cacheable set, the file may come from the caches: its contents from the
+file cache, or its descriptor, and what the path was last seen to be, from the
+descriptor cache. A file from the file cache has no descriptor.
+====================
+*/
+static t_bool ServerOpenFile( const char *const fileName, t_file_t *const file, const t_bool cacheable ) {
+	t_fileKey_t key;
+	t_int fd;
+
+	file->cached = NULL;
+	file->descriptor = NULL;
+
+	if ( cacheable && server_descriptors ) {
+		if ( !( file->descriptor = T_FdCacheOpen( server_descriptors, fileName ) ) ) {
+			return t_false;
+		}
+		fd = T_CachedFdGet( file->descriptor );
+		key = *T_CachedFdKey( file->descriptor );
+	} else {
+		if ( cacheable && server_cache && ServerFindCachedFile( fileName, file ) ) {
+			return t_true;
+		}
+
+#if _WIN32
+		fd = _open( fileName, _O_RDONLY | _O_BINARY );
+#else
+		fd = open( fileName, O_RDONLY );
+#endif
+		if ( fd < 0 ) {
+			return t_false;
+		}
+		if ( !T_FileKeyFromDescriptor( fd, &key ) ) {
+#if _WIN32
+			_close( fd );
+#else
+			close( fd );
+#endif
+			return t_false;
+		}
+#if defined( POSIX_FADV_SEQUENTIAL )
+		// Files are read front to back, so let the kernel read further ahead.
+		posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+	}
+
+	file->fd = fd;
+	file->size = key.size;
+	file->key = key;
+	if ( cacheable && server_cache ) {
+		// With the descriptor cache, the key is already known without a stat.
+		if ( file->descriptor && ( file->cached = T_FileCacheFind( server_cache, fileName, &key ) ) ) {
+			ServerCloseDescriptor( file );
+		} else {
+			ServerCacheFile( fileName, file, &key );
+		}
+	}
+	return t_true;
+}
+
+
+// Slot index in the low 32 bits, slot generation in the high 32 bits.
+// A handle goes stale as soon as its connection is removed.
+typedef t_uint64 connection_handle_t;
+
+#define INVALID_CONNECTION 0
+#define CONNECTION_HANDLE( slot, generation ) ( ( ( t_uint64 )( generation ) << 32 ) | ( t_uint )( slot ) )
+#define CONNECTION_SLOT( handle ) ( ( t_int )( ( handle ) & 0xffffffff ) )
+#define CONNECTION_GENERATION( handle ) ( ( t_uint )( ( handle ) >> 32 ) )
+
+// Outstanding io_uring accept, recv, or writable poll on a socket, or the
+// wait for disk completions.
+typedef struct {
+	SOCKET socket;
+	connection_handle_t handle;
+	t_bool listening;
+	t_bool writing;
+	t_bool disk;
+	t_bool pending;
+	t_bool closed;
+	t_byte buffer[MAX_PACKET_SIZE];
+} server_receive_t;
+
+typedef enum {
+	REQUEST_DOWNLOAD, // Open a file for the chunk requests that follow.
+	REQUEST_OPEN, // Open a file to hand over.
+	REQUEST_CHUNK // Read a chunk.
+} request_kind_t;
+
+// A chunk a disk worker read. Connections that asked for the same chunk at
+// the same time share one, each holding a reference until its send queue is
+// done with it, so references are counted from any reactor.
+typedef struct {
+	volatile t_int references;
+} server_chunk_t;
+
+#define CHUNK_DATA( chunk ) ( ( t_byte * )( ( chunk ) + 1 ) )
+
+// What reads of the same chunk have in common.
+typedef struct {
+	t_fileKey_t file;
+	t_int64 offset;
+	t_int64 size;
+} server_read_t;
+
+// A command waiting on a disk worker. Replies go out in the order commands
+// came in, so a request that is done still waits behind those before it.
+typedef struct server_request_s server_request_t;
+struct server_request_s {
+	request_kind_t kind;
+	server_reactor_t *reactor;
+	connection_handle_t handle;
+	t_ushort stream;
+	t_bool done;
+	t_bool ok;
+	t_bool ahead; // Read ahead, and not asked for yet.
+	t_bool dropped; // Read ahead for nothing; freed when it comes back.
+	t_char *fileName; // Opens
+	t_file_t opened; // Opens, until the reply takes it.
+	t_file_t *file; // Chunks, holding a reference.
+	t_int64 offset;
+	t_int size;
+	t_bool last; // The chunk that ends the file.
+	server_chunk_t *chunk; // Chunks, holding a reference until the reply takes it.
+	server_request_t *next;
+};
 
-// TODO: Use struct.
 typedef struct {
 	SOCKET socket;
-	t_uint64 time;
-	t_byteStream_t *stream;
+	t_int timer;
+	t_ring_t *input; // Received bytes, kept until they make whole frames.
+	server_receive_t *receive;
+
+	// Download
+	// Frames wait in the output queue until the socket takes them. Chunk
+	// payloads are queued as ranges of the open file and read as they go out,
+	// or, with disk workers, as buffers the workers already read.
+	t_file_t *file; // NULL while no file is open.
+	t_bool file_complete; // The chunk that ends the file has been queued.
+	t_uint64 chunks_end; // Output position just past the last chunk queued.
+	t_bool local; // Same host, over a local socket; files may be handed over whole.
+	t_shmRing_t *shared; // Once set up, output goes through this ring instead of the socket.
+	t_sendQueue_t *output;
+	t_byteStream_t *header; // Scratch for building frame headers.
+	t_bool writable_wait; // Waiting for the socket, or the shared ring, to take more.
+	server_receive_t *write;
+
+	// Disk requests, oldest first.
+	server_request_t *requests;
+	server_request_t *requests_last;
+	t_int request_count;
+
+	// Chunks read before they are asked for, oldest first. Without disk
+	// workers the kernel is only advised to read them.
+	server_request_t *ahead;
+	server_request_t *ahead_last;
+	t_int64 ahead_end; // File position just past the last chunk read or advised ahead.
+
+	t_uint generation;
+	t_bool used;
+	t_int live; // Position in the reactor's live list.
+	t_int next; // Next free slot, while unused.
 } connection_t;
 
-// Sockets
-static SOCKET server;
-static SOCKET server6;
+// Everything one server thread owns. Reactors share nothing, so each one runs
+// its own loop over its own listening sockets and connections.
+struct server_reactor_s {
+	thrd_t thread;
+	t_int id;
+
+	// Sockets
+	SOCKET server;
+	SOCKET server6;
+	SOCKET local; // Only the first reactor listens on the local socket.
+	t_poll_t *poll;
+	t_pollEvent_t events[MAX_EVENTS];
+
+	// io_uring, when available. Otherwise the poll above is used.
+	t_uring_t *uring;
+	t_uringCompletion_t completions[MAX_EVENTS];
+	server_receive_t accepts[MAX_LISTENERS];
+
+	// Connections
+	// Slots never move while in use; the live list packs the used slots
+	// so iteration only touches connections that exist.
+	connection_t *connections;
+	t_int *live;
+	t_int connection_count;
+	t_int connection_capacity;
+	t_int free_slot;
+
+	// Server Time
+	t_bool time_initialized;
+	t_uint64 base_time;
+	t_uint64 server_time;
+
+	// Connection timeouts
+	t_timerWheel_t *timers;
+
+	// Cancelled io_uring requests that have not completed yet.
+	t_int closing;
+
+	// Disk workers hand finished requests back here.
+	t_diskQueue_t *disk;
+	t_int disk_jobs; // Submitted and not back yet.
+	server_receive_t disk_wait;
+
+	// Loop timing, while stats are enabled.
+	t_histogram_t *stats[TFILE_STAT_COUNT];
+	t_bool timing;
+	t_uint stats_generation;
+	t_uint64 phase_start;
+	t_uint64 iteration_start;
+	t_uint64 wait_time;
+
+	// Memory reports
+	t_uint64 report_time;
+	t_uint64 report_iterations;
+	t_uint64 report_allocations;
+
+	volatile t_bool running;
+};
+
+
+/*
+====================
+GrowConnections
+====================
+*/
+static void GrowConnections( server_reactor_t *const reactor ) {
+	const t_int capacity = reactor->connection_capacity > 0 ? reactor->connection_capacity * 2 : INITIAL_CONNECTIONS;
+	const t_memoryTag_t tag = T_SetMemoryTag( T_TAG_CONNECTION );
+
+	connection_t *const connections = ( connection_t * )T_Malloc0( sizeof( connection_t ) * capacity );
+	t_int *const live = ( t_int * )T_Malloc( sizeof( t_int ) * capacity );
+	t_int i;
+
+	T_SetMemoryTag( tag );
+
+	if ( reactor->connections ) {
+		memcpy( connections, reactor->connections, sizeof( connection_t ) * reactor->connection_capacity );
+		memcpy( live, reactor->live, sizeof( t_int ) * reactor->connection_count );
+		T_Free( reactor->connections );
+		T_Free( reactor->live );
+	}
+
+	// Chain the new slots onto the free list.
+	for ( i = reactor->connection_capacity; i < capacity; ++i ) {
+		connections[i].generation = 1;
+		connections[i].next = i + 1 < capacity ? i + 1 : reactor->free_slot;
+	}
+
+	reactor->free_slot = reactor->connection_capacity;
+	reactor->connections = connections;
+	reactor->live = live;
+	reactor->connection_capacity = capacity;
+}
+
+
+/*
+====================
+GetConnection
+
+Returns NULL when the handle is stale.
+====================
+*/
+static connection_t *GetConnection( server_reactor_t *const reactor, const connection_handle_t handle ) {
+	const t_int slot = CONNECTION_SLOT( handle );
+
+	connection_t *connection;
+
+	if ( slot < 0 || slot >= reactor->connection_capacity ) {
+		return NULL;
+	}
+
+	connection = &reactor->connections[slot];
+	if ( !connection->used || connection->generation != CONNECTION_GENERATION( handle ) ) {
+		return NULL;
+	}
+	return connection;
+}
+
+
+/*
+====================
+PostReceive
+====================
+*/
+static void PostReceive( server_reactor_t *const reactor, server_receive_t *const receive ) {
+	if ( receive->listening ) {
+		receive->pending = T_URingAccept( reactor->uring, receive->socket, receive );
+	} else {
+		receive->pending = T_URingRecv( reactor->uring, receive->socket, receive->buffer, MAX_PACKET_SIZE, receive );
+	}
+
+	if ( !receive->pending ) {
+		T_Error( "PostReceive: Unable to queue request.\n" );
+	}
+}
+
+
+/*
+====================
+AddConnection
+====================
+*/
+static void AddConnection( server_reactor_t *const reactor, const SOCKET client, const t_bool local ) {
+	const t_memoryTag_t tag = T_SetMemoryTag( T_TAG_CONNECTION );
+
+	connection_t *connection;
+	connection_handle_t handle;
+	t_int slot;
 
-// Connections
-static SOCKET connections[MAX_CONNECTIONS];
-static t_uint64 connection_times[MAX_CONNECTIONS];
-static t_byteStream_t *connection_streams[MAX_CONNECTIONS];
-static t_int connection_count;
+	if ( reactor->free_slot == -1 ) {
+		GrowConnections( reactor );
+	}
 
-// Server Time
-static t_bool time_initialized;
-static t_uint64 base_time;
-static t_uint64 server_time;
+	slot = reactor->free_slot;
+	connection = &reactor->connections[slot];
+	handle = CONNECTION_HANDLE( slot, connection->generation );
+
+	if ( reactor->uring ) {
+		connection->receive = ( server_receive_t * )T_Malloc0( sizeof( server_receive_t ) );
+		connection->receive->socket = client;
+		connection->receive->handle = handle;
+		PostReceive( reactor, connection->receive );
+
+		connection->write = ( server_receive_t * )T_Malloc0( sizeof( server_receive_t ) );
+		connection->write->socket = client;
+		connection->write->handle = handle;
+		connection->write->writing = t_true;
+	} else if ( T_SocketNonBlocking( client ) == SOCKET_ERROR || !T_PollAdd( reactor->poll, client, handle ) ) {
+		T_Error( "AddConnection: Unable to register connection.\n" );
+		TFile_TryCloseSocket( client );
+		T_SetMemoryTag( tag );
+		return;
+	}
 
-// Check Connections
-static t_uint64 check_connections_time;
+	if ( !local ) {
+		T_SocketNoDelay( client );
+	}
+	reactor->free_slot = connection->next;
+
+	connection->socket = client;
+	connection->timer = T_TimerAdd( reactor->timers, reactor->server_time + CONNECTION_TIMEOUT, handle );
+	connection->input = T_CreateRing( CONNECTION_RING_SIZE );
+	connection->output = T_CreateSendQueue( MAX_QUEUED_SEGMENTS );
+	connection->header = T_CreateByteStream( MAX_EVENT_SIZE );
+	connection->file = NULL;
+	connection->file_complete = t_false;
+	connection->chunks_end = 0;
+	connection->requests = NULL;
+	connection->requests_last = NULL;
+	connection->request_count = 0;
+	connection->local = local;
+	connection->shared = NULL;
+	connection->writable_wait = t_false;
+	connection->used = t_true;
+	connection->live = reactor->connection_count;
+	reactor->live[reactor->connection_count++] = slot;
+	T_SetMemoryTag( tag );
+	T_Print( "Client connected.\n" );
+}
 
 
 /*
@@ -88,43 +699,161 @@ static t_uint64 check_connections_time;
 AcceptConnection
 ====================
 */
-static void AcceptConnection( const SOCKET socket ) {
-	static struct sockaddr_storage addr;
-	t_int len = sizeof( addr );
+static void AcceptConnection( server_reactor_t *const reactor, const SOCKET socket ) {
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof( addr );
+	SOCKET client;
 
-	if ( ( connections[connection_count] = accept( server, ( struct sockaddr * )&addr,  &len ) ) != SOCKET_ERROR ) {
-		connection_times[connection_count] = server_time + CONNECTION_TIMEOUT;
-		connection_streams[connection_count] = T_CreateByteStream( MAX_PACKET_SIZE );
-		++connection_count;
-		T_Print( "Client connected.\n" );
+	if ( ( client = accept( socket, ( struct sockaddr * )&addr, &len ) ) != INVALID_SOCKET ) {
+		AddConnection( reactor, client, socket == reactor->local ? t_true : t_false );
 	}
 }
 
 
 /*
 ====================
-RemoveConnection
+ReleaseRequest
+
+A request in flight still owns its record; it is freed when the cancel completes.
 ====================
 */
-static void RemoveConnection( const t_int connectionIndex ) {
-	const t_int last = MAX_CONNECTIONS - 1;
+static void ReleaseRequest( server_reactor_t *const reactor, server_receive_t *const request ) {
+	if ( request->pending ) {
+		request->closed = t_true;
+		++reactor->closing;
+		T_URingCancel( reactor->uring, request );
+	} else {
+		T_Free( request );
+	}
+}
 
-	t_int i;
 
-	TFile_TryCloseSocket( connections[connectionIndex] );
-	T_Free( connection_streams[connectionIndex] );
+/*
+====================
+ReleaseChunk
+
+Also the send queue's release callback for chunks.
+====================
+*/
+static void ReleaseChunk( void *const context ) {
+	server_chunk_t *const chunk = ( server_chunk_t * )context;
+
+	if ( ATOMIC_DECREMENT( &chunk->references ) == 0 ) {
+		T_Free( chunk );
+	}
+}
+
+
+/*
+====================
+FreeRequest
+
+Lets go of whatever the request still holds.
+====================
+*/
+static void FreeRequest( server_request_t *const request ) {
+	if ( request->opened.fd >= 0 || request->opened.cached ) {
+		ServerCloseFile( &request->opened );
+	}
+	if ( request->file ) {
+		ServerReleaseFile( request->file );
+	}
+	if ( request->chunk ) {
+		ReleaseChunk( request->chunk );
+	}
+	T_Free( request );
+}
+
+
+/*
+====================
+DropReadAhead
+
+Lets go of the chunks read ahead. Those still with a disk worker are freed
+when they come back.
+====================
+*/
+static void DropReadAhead( connection_t *const connection ) {
+	server_request_t *request;
+	server_request_t *next;
+
+	for ( request = connection->ahead; request; request = next ) {
+		next = request->next;
+		if ( request->done ) {
+			FreeRequest( request );
+		} else {
+			request->dropped = t_true;
+		}
+	}
+	connection->ahead = NULL;
+	connection->ahead_last = NULL;
+	connection->ahead_end = 0;
+}
+
+
+/*
+====================
+RemoveConnection
 
-	for ( i = connectionIndex; i < last; ++i ) {
-		connections[i] = connections[i + 1];
-		connection_times[i] = connection_times[i + 1];
-		connection_streams[i] = connection_streams[i + 1];
+Requests still with a disk worker are freed when they come back and find the
+connection gone.
+====================
+*/
+static void RemoveConnection( server_reactor_t *const reactor, connection_t *const connection ) {
+	const t_int slot = ( t_int )( connection - reactor->connections );
+	const t_int last = reactor->live[--reactor->connection_count];
+
+	server_request_t *request;
+	server_request_t *next;
+
+	if ( reactor->uring ) {
+		ReleaseRequest( reactor, connection->receive );
+		ReleaseRequest( reactor, connection->write );
+	} else {
+		if ( connection->shared ) {
+			T_PollRemove( reactor->poll, T_ShmRingGetSpaceEvent( connection->shared ) );
+		}
+		T_PollRemove( reactor->poll, connection->socket );
+	}
+	if ( connection->shared ) {
+		T_DestroyShmRing( connection->shared );
+	}
+	TFile_TryCloseSocket( connection->socket );
+	T_DestroyRing( connection->input );
+	T_DestroySendQueue( connection->output );
+	T_DestroyByteStream( connection->header );
+	T_TimerRemove( reactor->timers, connection->timer );
+	if ( connection->file ) {
+		ServerReleaseFile( connection->file );
+	}
+	DropReadAhead( connection );
+	for ( request = connection->requests; request; request = next ) {
+		next = request->next;
+		if ( request->done ) {
+			FreeRequest( request );
+		}
 	}
 
-	connections[last] = ZERO_SOCKET;
-	connection_times[last] = 0;
-	connection_streams[last] = NULL;
+	// Move the last live connection into the hole.
+	reactor->live[connection->live] = last;
+	reactor->connections[last].live = connection->live;
+
+	connection->socket = ZERO_SOCKET;
+	connection->input = NULL;
+	connection->output = NULL;
+	connection->header = NULL;
+	connection->shared = NULL;
+	connection->file = NULL;
+	connection->requests = NULL;
+	connection->requests_last = NULL;
+	connection->request_count = 0;
+	connection->receive = NULL;
+	connection->write = NULL;
+	connection->used = t_false;
+	++connection->generation;
+	connection->next = reactor->free_slot;
+	reactor->free_slot = slot;
 
-	--connection_count;
 	T_Print( "Client disconnected.\n" );
 }
 
@@ -134,8 +863,13 @@ static void RemoveConnection( const t_int connectionIndex ) {
 CMD_Heartbeat
 ====================
 */
-static void CMD_Heartbeat( const int connectionIndex ) {
-	connection_times[connectionIndex] = server_time + CONNECTION_TIMEOUT;
+static void CMD_Heartbeat( server_reactor_t *const reactor, connection_t *const connection ) {
+	const t_uint64 start = reactor->timing ? T_Nanoseconds() : 0;
+
+	T_TimerSet( reactor->timers, connection->timer, reactor->server_time + CONNECTION_TIMEOUT );
+	if ( reactor->timing ) {
+		T_HistogramRecord( reactor->stats[TFILE_STAT_HEARTBEAT], T_Nanoseconds() - start );
+	}
 }
 
 
@@ -144,96 +878,1160 @@ static void CMD_Heartbeat( const int connectionIndex ) {
 CMD_Disconnect
 ====================
 */
-static void CMD_Disconnect( const int connectionIndex ) {
-	RemoveConnection( connectionIndex );
+static void CMD_Disconnect( server_reactor_t *const reactor, connection_t *const connection ) {
+	RemoveConnection( reactor, connection );
+}
+
+
+/*
+====================
+QueueEvent
+
+Queues an event frame with no payload, or with a single t_int64 field.
+Returns false when the client has more requests outstanding than allowed.
+====================
+*/
+static t_bool QueueEvent( connection_t *const connection, const event_t event, const t_ushort stream, const t_int64 *const field ) {
+	t_byteStream_t *const header = connection->header;
+
+	T_BSReset( header );
+	TFile_WriteFrameHeader( header, ( t_byte )event, stream, field ? sizeof( t_int64 ) : 0 );
+	if ( field ) {
+		T_BSWrite( header, t_int64, *field );
+	}
+	return T_SendQueueBuffer( connection->output, T_BSGetBuffer( header ), T_BSGetSize( header ) );
+}
+
+
+/*
+====================
+QueueChunk
+
+Queues a chunk frame. The header is copied into the queue and the payload is
+either left in the file, is a chunk a disk worker read, whose reference the
+queue takes over, or is sent from the cached contents, which the queue holds
+the file open for. Either way the two go out back to back without a copy.
+Returns false when the client has more requests outstanding than allowed.
+====================
+*/
+static t_bool QueueChunk( connection_t *const connection, const t_ushort stream, const t_int64 offset, const t_int size, server_chunk_t *const chunk ) {
+	t_byteStream_t *const header = connection->header;
+	t_file_t *const file = connection->file;
+	t_bool queued;
+
+	T_BSReset( header );
+	TFile_WriteFrameHeader( header, EVT_FILE_CHUNK_READ, stream, sizeof( t_int64 ) + size );
+	T_BSWrite( header, t_int64, offset );
+
+	if ( !T_SendQueueBuffer( connection->output, T_BSGetBuffer( header ), T_BSGetSize( header ) ) ) {
+		if ( chunk ) {
+			ReleaseChunk( chunk );
+		}
+		return t_false;
+	}
+	if ( chunk ) {
+		queued = T_SendQueueShared( connection->output, CHUNK_DATA( chunk ), size, ReleaseChunk, chunk );
+	} else if ( file->cached ) {
+		++file->references;
+		queued = T_SendQueueShared( connection->output, T_CachedFileData( file->cached ) + offset, size, ServerReleaseSent, file );
+	} else {
+		queued = T_SendQueueFile( connection->output, file->fd, offset, size );
+	}
+	if ( !queued ) {
+		return t_false;
+	}
+
+	connection->chunks_end = T_SendQueueGetQueued( connection->output );
+	return t_true;
+}
+
+
+/*
+====================
+StartDownload
+
+Keeps the opened file for the chunk requests that follow.
+Returns false when the client has more requests outstanding than allowed.
+====================
+*/
+static t_bool StartDownload( connection_t *const connection, const t_ushort stream, const t_file_t *const opened ) {
+	connection->file = ServerShareFile( opened );
+	connection->file_complete = opened->size == 0 ? t_true : t_false;
+
+	if ( !QueueEvent( connection, EVT_DOWNLOAD_STARTED, stream, &opened->size ) ) {
+		return t_false;
+	}
+	return !connection->file_complete || QueueEvent( connection, EVT_DOWNLOAD_FINISHED, stream, NULL ) ? t_true : t_false;
+}
+
+
+/*
+====================
+HandOverFile
+
+Queues EVT_FILE_OPENED with the opened file attached. The send queue closes
+the server's copy once the client has its own.
+Returns false when the queue is full; the file is left to the caller.
+====================
+*/
+static t_bool HandOverFile( connection_t *const connection, const t_ushort stream, const t_file_t *const opened ) {
+	t_byteStream_t *const header = connection->header;
+
+	T_BSReset( header );
+	TFile_WriteFrameHeader( header, EVT_FILE_OPENED, stream, sizeof( t_int64 ) );
+	T_BSWrite( header, t_int64, opened->size );
+	return T_SendQueueDescriptor( connection->output, T_BSGetBuffer( header ), T_BSGetSize( header ), opened->fd );
+}
+
+
+/*
+====================
+CreateRequest
+====================
+*/
+static server_request_t *CreateRequest( const request_kind_t kind, const t_ushort stream, const t_char *const fileName ) {
+	const size_t nameSize = fileName ? strlen( fileName ) + 1 : 0;
+
+	server_request_t *const request = ( server_request_t * )T_Malloc0( sizeof( server_request_t ) + nameSize );
+
+	request->kind = kind;
+	request->stream = stream;
+	request->opened.fd = -1;
+	if ( fileName ) {
+		request->fileName = ( t_char * )( request + 1 );
+		memcpy( request->fileName, fileName, nameSize );
+	}
+	return request;
+}
+
+
+/*
+====================
+OpenWork
+
+Runs on a disk worker.
+====================
+*/
+static void OpenWork( void *const job ) {
+	server_request_t *const request = ( server_request_t * )job;
+
+	request->ok = ServerOpenFile( request->fileName, &request->opened, request->kind == REQUEST_DOWNLOAD ? t_true : t_false );
+}
+
+
+/*
+====================
+ReadWork
+
+Runs on a disk worker.
+====================
+*/
+static void ReadWork( void *const job ) {
+	server_request_t *const request = ( server_request_t * )job;
+
+	request->chunk = ( server_chunk_t * )T_Malloc( sizeof( server_chunk_t ) + request->size );
+	request->chunk->references = 1;
+	request->ok = ServerReadFile( request->file, CHUNK_DATA( request->chunk ), request->size, request->offset ) == request->size ? t_true : t_false;
+}
+
+
+/*
+====================
+ShareRead
+
+Runs on a disk worker, for a chunk request that waited on another's read.
+====================
+*/
+static void ShareRead( void *const job, void *const follower ) {
+	server_request_t *const request = ( server_request_t * )job;
+	server_request_t *const waiting = ( server_request_t * )follower;
+
+	waiting->ok = request->ok;
+	if ( request->ok ) {
+		ATOMIC_INCREMENT( &request->chunk->references );
+		waiting->chunk = request->chunk;
+	}
+}
+
+
+/*
+====================
+QueueRequest
+
+Queues a request on its connection, behind those waiting for a reply.
+====================
+*/
+static void QueueRequest( connection_t *const connection, server_request_t *const request ) {
+	request->next = NULL;
+	if ( connection->requests_last ) {
+		connection->requests_last->next = request;
+	} else {
+		connection->requests = request;
+	}
+	connection->requests_last = request;
+	++connection->request_count;
+}
+
+
+/*
+====================
+SubmitRequest
+
+Hands a request to the disk workers and queues it on the connection.
+Returns false when the connection was removed.
+====================
+*/
+static t_bool SubmitRequest( server_reactor_t *const reactor, connection_t *const connection, server_request_t *const request, const t_diskWork_t work ) {
+	server_read_t key;
+	t_bool submitted;
+
+	request->reactor = reactor;
+	request->handle = CONNECTION_HANDLE( connection - reactor->connections, connection->generation );
+
+	// Reads of the same chunk, from any connection, go to disk once. Without
+	// inode numbers, as on Windows, files cannot be told apart well enough.
+	if ( request->kind == REQUEST_CHUNK && request->file->key.inode != 0 ) {
+		memset( &key, 0, sizeof( key ) );
+		key.file = request->file->key;
+		key.offset = request->offset;
+		key.size = request->size;
+		submitted = T_DiskSubmitOnce( server_disk, reactor->disk, &key, ( t_int )sizeof( key ), work, ShareRead, request );
+	} else {
+		submitted = T_DiskSubmit( server_disk, reactor->disk, work, request );
+	}
+	if ( !submitted ) {
+		FreeRequest( request );
+		RemoveConnection( reactor, connection );
+		return t_false;
+	}
+	++reactor->disk_jobs;
+
+	if ( !request->ahead ) {
+		QueueRequest( connection, request );
+	} else if ( connection->ahead_last ) {
+		connection->ahead_last->next = request;
+		connection->ahead_last = request;
+	} else {
+		connection->ahead = request;
+		connection->ahead_last = request;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+ReplyRequest
+
+Queues the reply to a request the disk workers are done with, taking over
+what it opened or read.
+Returns false when the connection must be dropped.
+====================
+*/
+static t_bool ReplyRequest( connection_t *const connection, server_request_t *const request ) {
+	switch ( request->kind ) {
+	case REQUEST_DOWNLOAD:
+		if ( !request->ok ) {
+			return QueueEvent( connection, EVT_DOWNLOAD_FAILED, request->stream, NULL );
+		}
+		// The connection has the file now, even when the event did not fit.
+		if ( !StartDownload( connection, request->stream, &request->opened ) ) {
+			request->opened.fd = -1;
+			request->opened.cached = NULL;
+			return t_false;
+		}
+		request->opened.fd = -1;
+		request->opened.cached = NULL;
+		return t_true;
+	case REQUEST_OPEN:
+		if ( !request->ok ) {
+			return QueueEvent( connection, EVT_DOWNLOAD_FAILED, request->stream, NULL );
+		}
+		if ( !HandOverFile( connection, request->stream, &request->opened ) ) {
+			return t_false;
+		}
+		request->opened.fd = -1;
+		return t_true;
+	case REQUEST_CHUNK:
+		if ( !request->ok ) {
+			T_Error( "ReplyRequest: Unable to read file.\n" );
+			return t_false;
+		}
+		if ( !QueueChunk( connection, request->stream, request->offset, request->size, request->chunk ) ) {
+			request->chunk = NULL;
+			return t_false;
+		}
+		request->chunk = NULL;
+		return !request->last || QueueEvent( connection, EVT_DOWNLOAD_FINISHED, request->stream, NULL ) ? t_true : t_false;
+	default:
+		return t_false;
+	}
+}
+
+
+/*
+====================
+ReplyRequests
+
+Replies to every request at the front of the connection that is done by now.
+Returns false when the connection was removed.
+====================
+*/
+static t_bool ReplyRequests( server_reactor_t *const reactor, connection_t *const connection ) {
+	server_request_t *request;
+	t_bool replied;
+
+	while ( ( request = connection->requests ) && request->done ) {
+		if ( !( connection->requests = request->next ) ) {
+			connection->requests_last = NULL;
+		}
+		--connection->request_count;
+
+		replied = ReplyRequest( connection, request );
+		FreeRequest( request );
+		if ( !replied ) {
+			RemoveConnection( reactor, connection );
+			return t_false;
+		}
+	}
+	return t_true;
+}
+
+
+/*
+====================
+CompleteRequest
+
+A disk worker is done with a request. A chunk read ahead waits until it is
+asked for.
+====================
+*/
+static void CompleteRequest( void *const job ) {
+	server_request_t *const request = ( server_request_t * )job;
+	server_reactor_t *const reactor = request->reactor;
+	connection_t *const connection = GetConnection( reactor, request->handle );
+
+	--reactor->disk_jobs;
+	request->done = t_true;
+
+	// The connection went away, or moved on, while the disk was busy.
+	if ( !connection || request->dropped ) {
+		FreeRequest( request );
+		return;
+	}
+
+	if ( !request->ahead ) {
+		ReplyRequests( reactor, connection );
+	}
+}
+
+
+/*
+====================
+TryDiskCompletions
+====================
+*/
+static void TryDiskCompletions( server_reactor_t *const reactor ) {
+	if ( reactor->disk ) {
+		T_DiskQueueReceive( reactor->disk, CompleteRequest );
+	}
+}
+
+
+/*
+====================
+ReadFileName
+
+Copies the file name out of a command's payload.
+Returns false when the payload cannot be a file name.
+====================
+*/
+static t_bool ReadFileName( const frame_header_t *const frame, const t_byte *const payload, t_char *const fileName ) {
+	if ( frame->length >= MAX_FILE_NAME_SIZE || memchr( payload, '\0', frame->length ) ) {
+		return t_false;
+	}
+	memcpy( fileName, payload, frame->length );
+	fileName[frame->length] = '\0';
+	return t_true;
+}
+
+
+/*
+====================
+CMD_Download
+
+Opens the file for the chunk requests that follow. With disk workers the open
+happens on one of them, and EVT_DOWNLOAD_STARTED waits for it.
+====================
+*/
+static t_bool CMD_Download( server_reactor_t *const reactor, connection_t *const connection, const frame_header_t *const frame, const t_byte *const payload ) {
+	t_char fileName[MAX_FILE_NAME_SIZE];
+	t_file_t opened;
+	t_bool queued;
+
+	if ( !ReadFileName( frame, payload, fileName ) ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+
+	// A new download may not start while chunks of the last one are still being read or going out.
+	if ( connection->requests || T_SendQueueGetSent( connection->output ) < connection->chunks_end ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+
+	if ( connection->file ) {
+		ServerReleaseFile( connection->file );
+		connection->file = NULL;
+	}
+	DropReadAhead( connection );
+
+	if ( !ServerValidFileName( fileName ) ) {
+		queued = QueueEvent( connection, EVT_DOWNLOAD_FAILED, frame->stream, NULL );
+	} else if ( server_disk ) {
+		return SubmitRequest( reactor, connection, CreateRequest( REQUEST_DOWNLOAD, frame->stream, fileName ), OpenWork );
+	} else if ( !ServerOpenFile( fileName, &opened, t_true ) ) {
+		queued = QueueEvent( connection, EVT_DOWNLOAD_FAILED, frame->stream, NULL );
+	} else {
+		queued = StartDownload( connection, frame->stream, &opened );
+	}
+
+	if ( !queued ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+TakeReadAhead
+
+Returns the chunk read ahead at offset, taking it off the read-ahead list, or
+NULL. Asking for anything else means the client is not reading in order, and
+whatever was read ahead is dropped.
+====================
+*/
+static server_request_t *TakeReadAhead( connection_t *const connection, const t_ushort stream, const t_int64 offset, const t_int size ) {
+	server_request_t *const request = connection->ahead;
+
+	if ( !request ) {
+		return NULL;
+	}
+
+	if ( request->offset != offset || request->size != size ) {
+		DropReadAhead( connection );
+		return NULL;
+	}
+
+	if ( !( connection->ahead = request->next ) ) {
+		connection->ahead_last = NULL;
+	}
+	request->ahead = t_false;
+	request->stream = stream;
+	return request;
+}
+
+
+/*
+====================
+ReadAhead
+
+Keeps the chunks just past end being read while earlier ones go out, so a
+slow disk and the socket overlap instead of taking turns. Without disk
+workers the kernel is advised to read them instead.
+Returns false when the connection was removed.
+====================
+*/
+static t_bool ReadAhead( server_reactor_t *const reactor, connection_t *const connection, const t_ushort stream, const t_int64 end ) {
+	t_file_t *const file = connection->file;
+	const t_int64 window = ( t_int64 )server_read_ahead * FILE_CHUNK_SIZE;
+	const t_int64 limit = file->size - end < window ? file->size : end + window;
+
+	server_request_t *request;
+	t_int size;
+
+	// Nothing to wait on in memory.
+	if ( file->cached ) {
+		return t_true;
+	}
+
+	if ( connection->ahead_end < end ) {
+		connection->ahead_end = end;
+	}
+
+	if ( !server_disk ) {
+		if ( connection->ahead_end < limit ) {
+			ServerAdviseFile( file, connection->ahead_end, limit - connection->ahead_end );
+			connection->ahead_end = limit;
+		}
+		return t_true;
+	}
+
+	while ( connection->ahead_end < limit ) {
+		size = file->size - connection->ahead_end < FILE_CHUNK_SIZE ? ( t_int )( file->size - connection->ahead_end ) : FILE_CHUNK_SIZE;
+
+		request = CreateRequest( REQUEST_CHUNK, stream, NULL );
+		request->ahead = t_true;
+		request->file = file;
+		++file->references;
+		request->offset = connection->ahead_end;
+		request->size = size;
+		request->last = request->offset + size == file->size ? t_true : t_false;
+		if ( !SubmitRequest( reactor, connection, request, ReadWork ) ) {
+			return t_false;
+		}
+		connection->ahead_end += size;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+CMD_FileChunk
+
+Queues one chunk of the open file, or with disk workers has one of them read
+it first. The client keeps a window of these outstanding, so the connection
+never waits on a round trip.
+====================
+*/
+static t_bool CMD_FileChunk( server_reactor_t *const reactor, connection_t *const connection, const frame_header_t *const frame, const t_byte *const payload ) {
+	server_request_t *request;
+	t_int64 offset;
+	t_int size;
+	t_bool last;
+
+	if ( frame->length != sizeof( t_int64 ) + sizeof( t_int ) ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	memcpy( &offset, payload, sizeof( t_int64 ) );
+	memcpy( &size, payload + sizeof( t_int64 ), sizeof( t_int ) );
+
+	if ( !connection->file || offset < 0 || size <= 0 || size > FILE_CHUNK_SIZE || offset + size > connection->file->size ||
+		connection->request_count >= MAX_PENDING_REQUESTS ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	last = offset + size == connection->file->size ? t_true : t_false;
+	connection->file_complete = connection->file_complete || last ? t_true : t_false;
+
+	if ( server_disk ) {
+		if ( !( request = TakeReadAhead( connection, frame->stream, offset, size ) ) ) {
+			request = CreateRequest( REQUEST_CHUNK, frame->stream, NULL );
+			request->file = connection->file;
+			++request->file->references;
+			request->offset = offset;
+			request->size = size;
+			request->last = last;
+			if ( !connection->file->cached ) {
+				if ( !SubmitRequest( reactor, connection, request, ReadWork ) ) {
+					return t_false;
+				}
+				return ReadAhead( reactor, connection, frame->stream, offset + size );
+			}
+
+			// Already in memory; it only waits behind the replies before it.
+			request->done = t_true;
+			request->ok = t_true;
+		}
+		QueueRequest( connection, request );
+		if ( !ReplyRequests( reactor, connection ) ) {
+			return t_false;
+		}
+		return ReadAhead( reactor, connection, frame->stream, offset + size );
+	}
+
+	if ( !QueueChunk( connection, frame->stream, offset, size, NULL ) ||
+		( last && !QueueEvent( connection, EVT_DOWNLOAD_FINISHED, frame->stream, NULL ) ) ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	return ReadAhead( reactor, connection, frame->stream, offset + size );
+}
+
+
+/*
+====================
+CMD_Open
+
+Hands a local client the open file itself, so it reads the file directly
+instead of having it sent. Network connections are always refused.
+====================
+*/
+static t_bool CMD_Open( server_reactor_t *const reactor, connection_t *const connection, const frame_header_t *const frame, const t_byte *const payload ) {
+	t_char fileName[MAX_FILE_NAME_SIZE];
+	t_file_t opened;
+
+	if ( !ReadFileName( frame, payload, fileName ) || connection->requests ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+
+	if ( connection->local && ServerValidFileName( fileName ) && server_disk ) {
+		return SubmitRequest( reactor, connection, CreateRequest( REQUEST_OPEN, frame->stream, fileName ), OpenWork );
+	}
+
+	if ( !connection->local || !ServerValidFileName( fileName ) || !ServerOpenFile( fileName, &opened, t_false ) ) {
+		if ( !QueueEvent( connection, EVT_DOWNLOAD_FAILED, frame->stream, NULL ) ) {
+			CMD_Disconnect( reactor, connection );
+			return t_false;
+		}
+		return t_true;
+	}
+
+	if ( !HandOverFile( connection, frame->stream, &opened ) ) {
+		ServerCloseFile( &opened );
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+CMD_Share
+
+Moves a local connection's output onto a shared memory ring. The ring's
+descriptors go out right away with EVT_SHARED, while the socket is still
+empty, so nothing sent before it can end up behind it. Everything after goes
+through the ring.
+====================
+*/
+static t_bool CMD_Share( server_reactor_t *const reactor, connection_t *const connection, const frame_header_t *const frame, const t_byte *const payload ) {
+	t_byteStream_t *const header = connection->header;
+
+	t_int descriptors[T_SHMRING_DESCRIPTORS];
+	t_shmRing_t *ring = NULL;
+	t_int64 size;
+	t_int requested;
+
+	if ( frame->length != sizeof( t_int ) ) {
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	memcpy( &requested, payload, sizeof( t_int ) );
+	requested = requested < MAX_SHARED_RING_SIZE ? requested : MAX_SHARED_RING_SIZE;
+
+	if ( !connection->local || connection->shared || connection->requests || !T_SendQueueIsEmpty( connection->output ) ||
+		!( ring = T_CreateShmRing( requested ) ) ) {
+		if ( !QueueEvent( connection, EVT_SHARE_FAILED, frame->stream, NULL ) ) {
+			CMD_Disconnect( reactor, connection );
+			return t_false;
+		}
+		return t_true;
+	}
+
+	// A few bytes on an empty local socket go out whole, or not at all.
+	size = T_ShmRingGetSize( ring );
+	T_BSReset( header );
+	TFile_WriteFrameHeader( header, EVT_SHARED, frame->stream, sizeof( t_int64 ) );
+	T_BSWrite( header, t_int64, size );
+	T_ShmRingGetDescriptors( ring, descriptors );
+	if ( T_SendDescriptors( connection->socket, T_BSGetBuffer( header ), T_BSGetSize( header ), descriptors, T_SHMRING_DESCRIPTORS ) != T_BSGetSize( header ) ) {
+		T_DestroyShmRing( ring );
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+
+	// Without io_uring the space wakeup stays in the poll, under the connection's handle.
+	if ( !reactor->uring && !T_PollAdd( reactor->poll, T_ShmRingGetSpaceEvent( ring ), CONNECTION_HANDLE( connection - reactor->connections, connection->generation ) ) ) {
+		T_DestroyShmRing( ring );
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+	connection->shared = ring;
+	return t_true;
+}
+
+
+/*
+====================
+HandlePacket
+
+Returns false when the connection was removed.
+====================
+*/
+static t_bool HandlePacket( server_reactor_t *const reactor, connection_t *const connection, const t_byte *const buffer, const t_int size ) {
+	if ( !T_RingWrite( connection->input, buffer, size ) ) {
+		T_Error( "HandlePacket: Connection sent more than it can hold.\n" );
+		RemoveConnection( reactor, connection );
+		return t_false;
+	}
+	return t_true;
+}
+
+
+/*
+====================
+HandleClientCommand
+
+Returns false when the command removed the connection.
+====================
+*/
+static t_bool HandleClientCommand( server_reactor_t *const reactor, const frame_header_t *const frame, const t_byte *const payload, connection_t *const connection ) {
+	switch ( frame->type ) {
+	case CMD_HEARTBEAT:
+		CMD_Heartbeat( reactor, connection );
+		return t_true;
+	case CMD_DOWNLOAD:
+		return CMD_Download( reactor, connection, frame, payload );
+	case CMD_FILE_CHUNK:
+		return CMD_FileChunk( reactor, connection, frame, payload );
+	case CMD_OPEN:
+		return CMD_Open( reactor, connection, frame, payload );
+	case CMD_SHARE:
+		return CMD_Share( reactor, connection, frame, payload );
+	case CMD_DISCONNECT:
+	default:
+		CMD_Disconnect( reactor, connection );
+		return t_false;
+	}
+}
+
+
+/*
+====================
+WatchWritable
+
+Asks to hear when the socket can take more, or stops asking. An io_uring poll
+fires once, so it is only queued again after it completes. A shared connection
+hears from the ring's space wakeup instead, which the poll always watches.
+====================
+*/
+static void WatchWritable( server_reactor_t *const reactor, connection_t *const connection, const t_bool watch ) {
+	if ( reactor->uring ) {
+		if ( watch && !connection->write->pending ) {
+			if ( connection->shared ) {
+				connection->write->pending = T_URingRead( reactor->uring, T_ShmRingGetSpaceEvent( connection->shared ), connection->write->buffer, sizeof( t_uint64 ), 0, connection->write );
+			} else {
+				connection->write->pending = T_URingPollWrite( reactor->uring, connection->socket, connection->write );
+			}
+			if ( !connection->write->pending ) {
+				T_Error( "WatchWritable: Unable to queue request.\n" );
+			}
+		}
+	} else if ( !connection->shared ) {
+		T_PollWatchWrite( reactor->poll, connection->socket, watch );
+	}
+	connection->writable_wait = watch;
+}
+
+
+/*
+====================
+TrySend
+
+Flushes the output queue until the socket, or the shared ring, is full, then
+waits for it to drain instead of retrying.
+Returns false when the connection was removed.
+====================
+*/
+static t_bool TrySend( server_reactor_t *const reactor, connection_t *const connection ) {
+	t_bool empty;
+
+	while ( t_true ) {
+		if ( !( connection->shared ? T_SendQueueFlushShared( connection->output, connection->shared ) : T_SendQueueFlush( connection->output, connection->socket ) ) ) {
+			RemoveConnection( reactor, connection );
+			return t_false;
+		}
+
+		// A full ring is only waited on once the client has promised a wakeup.
+		if ( !connection->shared || T_SendQueueIsEmpty( connection->output ) || T_ShmRingWaitSpace( connection->shared ) ) {
+			break;
+		}
+	}
+
+	// Nothing past the end of the file can be asked for.
+	if ( connection->file && connection->file_complete && !connection->requests && T_SendQueueGetSent( connection->output ) >= connection->chunks_end ) {
+		ServerReleaseFile( connection->file );
+		connection->file = NULL;
+	}
+
+	empty = T_SendQueueIsEmpty( connection->output );
+	if ( empty == connection->writable_wait ) {
+		WatchWritable( reactor, connection, empty ? t_false : t_true );
+	}
+	return t_true;
+}
+
+
+/*
+====================
+ProcessClientCommands
+
+Frames are parsed in place from each connection's ring. A frame that has not
+fully arrived stays there for the next pass.
+====================
+*/
+static void ProcessClientCommands( server_reactor_t *const reactor ) {
+	t_byte scratch[FRAME_HEADER_SIZE + MAX_COMMAND_PAYLOAD];
+	frame_header_t frame;
+	const t_byte *payload;
+	t_int i;
+
+	// Walk backwards; a removal only moves an already visited connection into place.
+	for ( i = reactor->connection_count - 1; i >= 0; --i ) {
+		connection_t *const connection = &reactor->connections[reactor->live[i]];
+		t_ring_t *const input = connection->input;
+
+		while ( T_RingGetSize( input ) >= ( t_int )FRAME_HEADER_SIZE ) {
+			TFile_ReadFrameHeader( T_RingPeek( input, 0, FRAME_HEADER_SIZE, scratch ), &frame );
+
+			if ( frame.length > MAX_COMMAND_PAYLOAD ) {
+				CMD_Disconnect( reactor, connection );
+				break;
+			}
+
+			// Wait for the rest of a partial frame.
+			if ( T_RingGetSize( input ) < ( t_int )( FRAME_HEADER_SIZE + frame.length ) ) {
+				break;
+			}
+
+			payload = T_RingPeek( input, FRAME_HEADER_SIZE, frame.length, scratch );
+			T_RingSkip( input, FRAME_HEADER_SIZE + frame.length );
+
+			if ( !HandleClientCommand( reactor, &frame, payload, connection ) ) {
+				break;
+			}
+		}
+
+		if ( !connection->used ) {
+			continue;
+		}
+
+		// A connection waiting on its socket is flushed when the socket drains.
+		if ( !connection->writable_wait && !T_SendQueueIsEmpty( connection->output ) ) {
+			TrySend( reactor, connection );
+		}
+	}
+}
+
+/*
+====================
+ServerTime
+====================
+*/
+static void ServerTime( server_reactor_t *const reactor ) {
+	reactor->server_time = T_Milliseconds( &reactor->base_time, ( t_int * )&reactor->time_initialized );
+}
+
+
+/*
+====================
+ServerTimeout
+
+How long the loop may wait for sockets before a timer is due, in microseconds.
+====================
+*/
+static t_int ServerTimeout( server_reactor_t *const reactor ) {
+	const t_uint64 deadline = T_TimerNextDeadline( reactor->timers );
+
+	t_uint64 timeout = MAX_WAIT_TIMEOUT;
+
+	if ( deadline != T_TIMER_NONE ) {
+		timeout = deadline > reactor->server_time ? deadline - reactor->server_time : 0;
+		if ( timeout > MAX_WAIT_TIMEOUT ) {
+			timeout = MAX_WAIT_TIMEOUT;
+		}
+	}
+
+	// Without a completion event, check back on the disk workers regularly.
+	if ( reactor->disk_jobs > 0 && T_DiskQueueGetEvent( reactor->disk ) < 0 && timeout > TIMER_RESOLUTION ) {
+		timeout = TIMER_RESOLUTION;
+	}
+	return ( t_int )timeout * 1000;
+}
+
+
+/*
+====================
+BeginIteration
+
+Picks up the stats switches and starts timing the pass.
+====================
+*/
+static void BeginIteration( server_reactor_t *const reactor ) {
+	t_int i;
+
+	if ( reactor->stats_generation != server_stats_generation ) {
+		reactor->stats_generation = server_stats_generation;
+		for ( i = 0; i < TFILE_STAT_COUNT; ++i ) {
+			T_HistogramReset( reactor->stats[i] );
+		}
+	}
+
+	if ( ( reactor->timing = server_stats_enabled ) ) {
+		reactor->iteration_start = reactor->phase_start = T_Nanoseconds();
+		reactor->wait_time = 0;
+	}
+}
+
+
+/*
+====================
+EndPhase
+
+Records the time since the last phase ended.
+====================
+*/
+static void EndPhase( server_reactor_t *const reactor, const tfile_stat_t stat ) {
+	t_uint64 now;
+
+	if ( !reactor->timing ) {
+		return;
+	}
+
+	now = T_Nanoseconds();
+	T_HistogramRecord( reactor->stats[stat], now - reactor->phase_start );
+	if ( stat == TFILE_STAT_WAIT ) {
+		reactor->wait_time = now - reactor->phase_start;
+	}
+	reactor->phase_start = now;
+}
+
+
+/*
+====================
+EndWait
+
+Ends the wait phase and records how much it handed back.
+====================
+*/
+static void EndWait( server_reactor_t *const reactor, const t_int ready ) {
+	if ( reactor->timing ) {
+		EndPhase( reactor, TFILE_STAT_WAIT );
+		T_HistogramRecord( reactor->stats[TFILE_STAT_READY], ready > 0 ? ( t_uint64 )ready : 0 );
+	}
+}
+
+
+/*
+====================
+EndIteration
+====================
+*/
+static void EndIteration( server_reactor_t *const reactor ) {
+	if ( reactor->timing ) {
+		T_HistogramRecord( reactor->stats[TFILE_STAT_ITERATION], T_Nanoseconds() - reactor->iteration_start - reactor->wait_time );
+	}
+}
+
+
+/*
+====================
+TryReportMemory
+
+Prints the allocation counters every MEMORY_REPORT_INTERVAL. The first reactor
+reports for the process; every reactor reports its own allocations per pass
+of its loop.
+====================
+*/
+static void TryReportMemory( server_reactor_t *const reactor ) {
+	t_memoryStats_t stats;
+	t_uint64 allocations;
+	t_int i;
+
+	++reactor->report_iterations;
+	if ( reactor->server_time < reactor->report_time + MEMORY_REPORT_INTERVAL || !T_GetMemoryStats( &stats ) ) {
+		return;
+	}
+
+	if ( reactor->id == 0 ) {
+		T_Print( "Memory: %lld bytes live, %lld peak, %lld allocations, %lld frees.\n",
+			( long long )stats.liveBytes, ( long long )stats.peakBytes, ( long long )stats.allocations, ( long long )stats.frees );
+		for ( i = 0; i < T_TAG_COUNT; ++i ) {
+			T_Print( "  %s: %lld bytes live, %lld allocations.\n",
+				T_MemoryTagName( ( t_memoryTag_t )i ), ( long long )stats.tagLiveBytes[i], ( long long )stats.tagAllocations[i] );
+		}
+	}
+
+	allocations = T_ThreadAllocations();
+	T_Print( "Reactor %d: %.2f allocations per loop iteration.\n", reactor->id,
+		( double )( allocations - reactor->report_allocations ) / ( double )reactor->report_iterations );
+
+	reactor->report_time = reactor->server_time;
+	reactor->report_iterations = 0;
+	reactor->report_allocations = allocations;
 }
 
 
 /*
 ====================
-HandlePacket
+ExpireConnection
 ====================
 */
-static void HandlePacket( const t_int connectionIndex, const t_byte *const buffer, const t_int size ) {
-	if ( size <= 0 )
-		return;
+static void ExpireConnection( void *const context, const t_uint64 handle ) {
+	server_reactor_t *const reactor = ( server_reactor_t * )context;
+	connection_t *const connection = GetConnection( reactor, handle );
 
-	T_BSWriteBuffer( connection_streams[connectionIndex], buffer, size );
+	if ( connection ) {
+		RemoveConnection( reactor, connection );
+	}
 }
 
 
 /*
 ====================
-HandleClientCommand
+TryCheckConnectionTimes
+
+Only connections whose heartbeat timed out are visited.
 ====================
 */
-static void HandleClientCommand( const t_byte cmd, const t_int connectionIndex ) {
-	switch ( cmd ) {
-	case CMD_HEARTBEAT:
-		CMD_Heartbeat( connectionIndex );
-		break;
-	case CMD_DISCONNECT:
-	default:
-		CMD_Disconnect( connectionIndex );
-		break;
-	}
+static void TryCheckConnectionTimes( server_reactor_t *const reactor ) {
+	T_TimerAdvance( reactor->timers, reactor->server_time, ExpireConnection, reactor );
 }
 
 
 /*
 ====================
-ProcessClientCommands
+ReceivePacket
+
+A shared connection's space wakeup comes in under the same handle; it means
+the client made room in the ring.
 ====================
 */
-static void ProcessClientCommands( void ) {
-	t_int i;
+static void ReceivePacket( server_reactor_t *const reactor, const connection_handle_t handle, const SOCKET socket ) {
+	connection_t *const connection = GetConnection( reactor, handle );
 
-	for ( i = 0; i < connection_count; ++i ) {
-		t_byteStream_t *const byteStream = connection_streams[i];
+	t_byte *buffer;
+	t_int space;
+	t_int bytes;
 
-		while ( T_BSCanRead( byteStream ) ) {
-			HandleClientCommand( T_BSReadByte( byteStream ), i );
-		}
-		T_BSReset( byteStream );
+	// Removed earlier in this batch.
+	if ( !connection )
+		return;
+
+	if ( socket != connection->socket ) {
+		T_ShmRingDrainEvent( socket );
+		connection->writable_wait = t_false;
+		TrySend( reactor, connection );
+		return;
+	}
+
+	// Receive straight into the connection's ring.
+	buffer = T_RingGetWriteBuffer( connection->input, &space );
+	if ( space == 0 ) {
+		return;
 	}
+	bytes = recv( connection->socket, ( char * )buffer, space, 0 );
+
+	// An orderly shutdown from the client, or a hard error, ends the connection.
+	if ( bytes == 0 || ( bytes == SOCKET_ERROR && !T_SocketWouldBlock() ) ) {
+		RemoveConnection( reactor, connection );
+		return;
+	}
+
+	T_RingCommit( connection->input, bytes );
 }
 
+
 /*
 ====================
-ServerTime
+SendPacket
+
+The socket can take more of the connection's output.
 ====================
 */
-static void ServerTime( void ) {
-	server_time = T_Milliseconds( &base_time, ( t_int * )&time_initialized );
+static void SendPacket( server_reactor_t *const reactor, const connection_handle_t handle ) {
+	connection_t *const connection = GetConnection( reactor, handle );
+
+	// Removed earlier in this batch.
+	if ( !connection )
+		return;
+
+	TrySend( reactor, connection );
 }
 
 
 /*
 ====================
-ServerTime
+PostDiskWait
+
+Reads the disk completion event, so io_uring wakes the loop when it is set.
 ====================
 */
-static void CheckConnectionsTime( void ) {
-	check_connections_time = check_connections_time == 0 ? server_time + CHECK_CONNECTIONS_INTERVAL : check_connections_time;
+static void PostDiskWait( server_reactor_t *const reactor ) {
+	server_receive_t *const wait = &reactor->disk_wait;
+
+	if ( !( wait->pending = T_URingRead( reactor->uring, wait->socket, wait->buffer, sizeof( t_uint64 ), 0, wait ) ) ) {
+		T_Error( "PostDiskWait: Unable to queue request.\n" );
+	}
 }
 
 
 /*
 ====================
-TryCheckConnectionTimes
+TryReceiveURing
+
+Accepts and receives are kept queued on the ring. Completed ones are handled
+and re-queued here, and go to the kernel in one batch with the next wait.
 ====================
 */
-static void TryCheckConnectionTimes( void ) {
+static void TryReceiveURing( server_reactor_t *const reactor, const int timeout ) {
+	t_int count;
 	t_int i;
 
-	if ( server_time >= check_connections_time ) {
-		for( i = 0; i < connection_count; ++i ) {
-			if ( server_time >= connection_times[i] ) {
-				RemoveConnection( i );
-				--i;
+	count = T_URingWait( reactor->uring, timeout, reactor->completions, MAX_EVENTS );
+	EndWait( reactor, count );
+	if ( count == SOCKET_ERROR ) {
+		T_Error( "TryReceiveURing: Wait error.\n" );
+		return;
+	}
+
+	for ( i = 0; i < count; ++i ) {
+		server_receive_t *const receive = ( server_receive_t * )reactor->completions[i].data;
+		const t_int result = reactor->completions[i].result;
+
+		receive->pending = t_false;
+
+		if ( receive->closed ) {
+			if ( !receive->listening && !receive->disk ) {
+				T_Free( receive );
+			}
+			--reactor->closing;
+			continue;
+		}
+
+		// Disk completions are handed out after the wait; only wait again here.
+		if ( receive->disk ) {
+			PostDiskWait( reactor );
+			continue;
+		}
+
+		// Accept connections on IPv4, IPv6 and the local socket.
+		if ( receive->listening ) {
+			if ( result >= 0 ) {
+				AddConnection( reactor, result, receive->socket == reactor->local ? t_true : t_false );
 			}
+			PostReceive( reactor, receive );
+			continue;
+		}
+
+		// Flush connections whose sockets or shared rings drained.
+		if ( receive->writing ) {
+			connection_t *const connection = GetConnection( reactor, receive->handle );
+
+			if ( connection ) {
+				connection->writable_wait = t_false;
+				TrySend( reactor, connection );
+			}
+			continue;
+		}
+
+		// Handle packets from the accepted connections.
+		if ( result > 0 ) {
+			if ( HandlePacket( reactor, GetConnection( reactor, receive->handle ), receive->buffer, result ) ) {
+				PostReceive( reactor, receive );
+			}
+		} else if ( result == -EAGAIN || result == -EINTR ) {
+			PostReceive( reactor, receive );
+		} else {
+			RemoveConnection( reactor, GetConnection( reactor, receive->handle ) );
 		}
-		check_connections_time = 0;
 	}
 }
 
@@ -243,40 +2041,41 @@ static void TryCheckConnectionTimes( void ) {
 TryReceive
 ====================
 */
-static void TryReceive( const int timeout ) {
-	SOCKET sockets[MAX_SOCKETS] = { ZERO_SOCKET };
-	SOCKET reads[MAX_SOCKETS] = { ZERO_SOCKET };
+static void TryReceive( server_reactor_t *const reactor, const int timeout ) {
+	t_int count;
 	t_int i;
 
-	// Set up IPv4 and IPv6 sockets.
-	sockets[0] = server;
-	sockets[1] = server6;
-
-	for ( i = 2; i < MAX_SOCKETS; ++i ) {
-		sockets[i] = connections[i - 2];
+	if ( reactor->uring ) {
+		TryReceiveURing( reactor, timeout );
+		return;
 	}
 
 	// Synchronous event demultiplexer.
-	// It's ok that we are using select as its portable.
-	// It may not be the fastest, but it's definitely quick enough for what we are trying to accomplish.
-	if ( T_Select( sockets, MAX_SOCKETS, timeout, reads ) == SOCKET_ERROR ) {
-		T_Error( "TryReceive: Select error.\n" );
+	// Sockets stay registered with the poll, so only ready sockets are visited here.
+	count = T_PollWait( reactor->poll, timeout, reactor->events, MAX_EVENTS );
+	EndWait( reactor, count );
+	if ( count == SOCKET_ERROR ) {
+		T_Error( "TryReceive: Poll error.\n" );
+		return;
 	}
 
-	for( i = 0; i < MAX_SOCKETS; ++i ) {
-		if ( reads[i] == ZERO_SOCKET )
-			continue;
+	for ( i = 0; i < count; ++i ) {
+		const SOCKET socket = reactor->events[i].socket;
 
-		// Accept connections on IPv4 and IPv6.
-		if ( reads[i] == server ) {
-			AcceptConnection( server );
-		} else if ( reads[i] == server6 ) {
-			AcceptConnection( server6 );
+		// Accept connections on IPv4, IPv6 and the local socket.
+		if ( socket == reactor->server || socket == reactor->server6 || socket == reactor->local ) {
+			AcceptConnection( reactor, socket );
+		} else if ( reactor->disk && socket == T_DiskQueueGetEvent( reactor->disk ) ) {
+			// Disk completions are handed out after the wait.
+			continue;
 		} else {
-			static t_byte buffer[MAX_PACKET_SIZE];
-			// Handle packets from the accepted connections.
-			t_int bytes = recv( reads[i], ( char * )buffer, MAX_PACKET_SIZE, 0 );
-			HandlePacket( i - 2, buffer, bytes ); 
+			// Flush connections whose sockets drained, then handle their packets.
+			if ( reactor->events[i].flags & T_POLL_WRITE ) {
+				SendPacket( reactor, reactor->events[i].data );
+			}
+			if ( reactor->events[i].flags & T_POLL_READ ) {
+				ReceivePacket( reactor, reactor->events[i].data, socket );
+			}
 		}
 	}
 }
@@ -287,25 +2086,58 @@ static void TryReceive( const int timeout ) {
 ServerInit
 ====================
 */
-static void ServerInit( const SOCKET socket, const SOCKET socket6 ) {
+static void ServerInit( server_reactor_t *const reactor ) {
 	t_int i;
 
-	for ( i = 0; i < MAX_CONNECTIONS; ++i ) {
-		connections[i] = ZERO_SOCKET;
-		connection_times[i] = 0;
-	}
-
-	time_initialized = t_false;
-	check_connections_time = 0;
+	reactor->connections = NULL;
+	reactor->live = NULL;
+	reactor->connection_count = 0;
+	reactor->connection_capacity = 0;
+	reactor->free_slot = -1;
+	GrowConnections( reactor );
 
-	connection_count = 0;
+	reactor->time_initialized = t_false;
+	ServerTime( reactor );
+	reactor->timers = T_CreateTimerWheel( reactor->server_time, TIMER_RESOLUTION );
 
-	server = socket;
-	server6 = socket6;
+	reactor->report_time = reactor->server_time;
+	reactor->report_iterations = 0;
+	reactor->report_allocations = T_ThreadAllocations();
 
-	if ( listen( server, 8 ) == SOCKET_ERROR || listen( server6, 8 ) == SOCKET_ERROR ) {
+	if ( listen( reactor->server, SOMAXCONN ) == SOCKET_ERROR || listen( reactor->server6, SOMAXCONN ) == SOCKET_ERROR ||
+		( reactor->local != INVALID_SOCKET && listen( reactor->local, SOMAXCONN ) == SOCKET_ERROR ) ) {
 		T_FatalError( "ServerInit: Failed to listen on socket." );
 	}
+
+	reactor->disk = server_disk ? T_CreateDiskQueue() : NULL;
+	reactor->disk_jobs = 0;
+	reactor->disk_wait.socket = reactor->disk ? T_DiskQueueGetEvent( reactor->disk ) : INVALID_SOCKET;
+	reactor->disk_wait.disk = t_true;
+
+	// Prefer io_uring when it was built in and the kernel allows it.
+	if ( ( reactor->uring = T_CreateURing( URING_ENTRIES ) ) ) {
+		reactor->accepts[0].socket = reactor->server;
+		reactor->accepts[1].socket = reactor->server6;
+		reactor->accepts[2].socket = reactor->local;
+		for ( i = 0; i < MAX_LISTENERS; ++i ) {
+			reactor->accepts[i].listening = t_true;
+			if ( reactor->accepts[i].socket != INVALID_SOCKET ) {
+				PostReceive( reactor, &reactor->accepts[i] );
+			}
+		}
+		if ( reactor->disk_wait.socket != INVALID_SOCKET ) {
+			PostDiskWait( reactor );
+		}
+		T_Print( "File server using io_uring.\n" );
+		return;
+	}
+
+	reactor->poll = T_CreatePoll( T_POLL_DEFAULT, FD_SETSIZE );
+	if ( !T_PollAdd( reactor->poll, reactor->server, INVALID_CONNECTION ) || !T_PollAdd( reactor->poll, reactor->server6, INVALID_CONNECTION ) ||
+		( reactor->local != INVALID_SOCKET && !T_PollAdd( reactor->poll, reactor->local, INVALID_CONNECTION ) ) ||
+		( reactor->disk_wait.socket != INVALID_SOCKET && !T_PollAdd( reactor->poll, reactor->disk_wait.socket, INVALID_CONNECTION ) ) ) {
+		T_FatalError( "ServerInit: Failed to poll listening sockets." );
+	}
 }
 
 
@@ -314,53 +2146,68 @@ static void ServerInit( const SOCKET socket, const SOCKET socket6 ) {
 HandleMessage
 ====================
 */
-static void HandleMessage( const void *const arg ) {
+static server_reactor_t *HandleMessage( const void *const arg ) {
 	const server_message_t message = *( server_message_t * )arg;
 
-	ServerInit( message.ip_socket, message.ip6_socket );
+	ServerInit( message.reactor );
 
 	mtx_lock( &server_mutex );
 	mtx_unlock( &server_mutex );
 	cnd_signal( &server_condition );
+	return message.reactor;
 }
 
-typedef struct {
-	FILE *file;
-	size_t size;
-} t_file_t;
-
-
-// File calls not used yet.
 /*
 ====================
-ServerOpenFile
+ServerShutdown
 ====================
 */
-t_bool ServerOpenFile( const char *const fileName, t_file_t *const file ) {
-	FILE *const f = fopen( fileName, "rb" );
-	size_t size;
+static void ServerShutdown( server_reactor_t *const reactor ) {
+	struct timespec pause = { 0, 1000000 }; // 1 millisecond.
+	t_int i;
 
-	if ( !f ) {
-		return t_false;
+	while ( reactor->connection_count > 0 ) {
+		RemoveConnection( reactor, &reactor->connections[reactor->live[reactor->connection_count - 1]] );
 	}
 
-	fseek( f, 0L, SEEK_END );
-	size = ftell( f );
-	rewind( f );
-
-	file->file = f;
-	file->size = size;
-	return t_true;
-}
+	// Requests still with the disk workers come back to this reactor. The queue
+	// itself goes once the workers have stopped.
+	while ( reactor->disk_jobs > 0 ) {
+		TryDiskCompletions( reactor );
+		if ( reactor->disk_jobs > 0 ) {
+			thrd_sleep( &pause, NULL );
+		}
+	}
+	T_Free( reactor->connections );
+	T_Free( reactor->live );
+	T_DestroyTimerWheel( reactor->timers );
+
+	if ( reactor->uring ) {
+		for ( i = 0; i < MAX_LISTENERS; ++i ) {
+			if ( reactor->accepts[i].pending ) {
+				reactor->accepts[i].closed = t_true;
+				++reactor->closing;
+				T_URingCancel( reactor->uring, &reactor->accepts[i] );
+			}
+		}
+		if ( reactor->disk_wait.pending ) {
+			reactor->disk_wait.closed = t_true;
+			++reactor->closing;
+			T_URingCancel( reactor->uring, &reactor->disk_wait );
+		}
 
+		// Cancelled requests own their buffers until they complete.
+		while ( reactor->closing > 0 ) {
+			TryReceiveURing( reactor, RECEIVE_TIMEOUT );
+		}
+		T_DestroyURing( reactor->uring );
+	} else {
+		T_DestroyPoll( reactor->poll );
+	}
 
-/*
-====================
-ServerCloseFile
-====================
-*/
-void ServerCloseFile( t_file_t *const file ) {
-	fclose( file->file );
+	TFile_TryCloseSocket( reactor->server );
+	TFile_TryCloseSocket( reactor->server6 );
+	TFile_TryCloseSocket( reactor->local );
 }
 
 
@@ -371,24 +2218,36 @@ ServerThread
 */
 static t_int ServerThread( void *arg ) {
 	// Handle the message sent by the calling thread.
-	HandleMessage( arg );
+	server_reactor_t *const reactor = HandleMessage( arg );
 
-	while( 1 ) {
-		// Server's life time.
-		ServerTime();
+	while( reactor->running ) {
+		// Time each phase of the pass while stats are enabled.
+		BeginIteration( reactor );
 
-		// Time interval to check connections.
-		CheckConnectionsTime();
+		// Try to receive data from clients, waiting no longer than the next timer.
+		TryReceive( reactor, ServerTimeout( reactor ) );
+		EndPhase( reactor, TFILE_STAT_RECEIVE );
 
-		// Try to receive data from clients.
-		TryReceive( RECEIVE_TIMEOUT );
+		// Server's life time.
+		ServerTime( reactor );
+		EndPhase( reactor, TFILE_STAT_TIME );
 
-		// Process client commands.
-		ProcessClientCommands();
+		// Reply to requests the disk workers are done with, then process client commands.
+		TryDiskCompletions( reactor );
+		ProcessClientCommands( reactor );
+		EndPhase( reactor, TFILE_STAT_COMMANDS );
 
 		// Check to see if any of our accepted connections were dropped.
-		TryCheckConnectionTimes();
+		TryCheckConnectionTimes( reactor );
+		EndPhase( reactor, TFILE_STAT_TIMERS );
+
+		// Report memory use when it is due.
+		TryReportMemory( reactor );
+		EndIteration( reactor );
 	}
+
+	ServerShutdown( reactor );
+	T_FlushThreadCache();
 	return 0;
 }
 
@@ -401,12 +2260,16 @@ SERVER
 ============================================================================
 */
 
+#define MAX_REACTORS 64
 
 static t_bool server_initialized = t_false;
 static t_bool server_running = t_false;
-static SOCKET server_socket = INVALID_SOCKET;
-static SOCKET server_socket6 = INVALID_SOCKET;
-static thrd_t server_thread;
+static server_reactor_t *server_reactors;
+static t_int server_reactor_count;
+static t_char server_local_path[MAX_FILE_NAME_SIZE];
+static t_int server_disk_workers = DEFAULT_DISK_WORKERS;
+static t_int server_open_files = DEFAULT_OPEN_FILES;
+static t_int server_stat_timeout = DEFAULT_STAT_TIMEOUT;
 
 
 /*
@@ -431,7 +2294,7 @@ CreateServer
 TODO: Break out normal socket errors.
 ====================
 */
-static t_bool CreateServer( const t_int family, const t_int port, SOCKET *const socket ) {
+static t_bool CreateServer( const t_int family, const t_int port, const t_bool reusePort, SOCKET *const socket ) {
 	const struct addrinfo hints = CreateServerHints( family, SOCK_STREAM, AI_PASSIVE );
 
 	struct addrinfo defaultInfo = T_CreateAddressInfo();
@@ -461,6 +2324,13 @@ static t_bool CreateServer( const t_int family, const t_int port, SOCKET *const
 		return t_false;
 	}
 
+	// Let every reactor bind the same port; the kernel spreads accepts between them.
+	if ( reusePort && T_SocketReusePort( *socket ) == SOCKET_ERROR ) {
+		TFile_CleanupFailedSocket( "CreateServer: Unable to set socket to reuse port.\n", *socket, result );
+		*socket = INVALID_SOCKET;
+		return t_false;
+	}
+
 	// Bind socket.
 	found = T_FindAddrInfo( family, result );
 	if ( bind( *socket, found->ai_addr, found->ai_addrlen ) == SOCKET_ERROR ) {
@@ -482,17 +2352,115 @@ static t_bool CreateServer( const t_int family, const t_int port, SOCKET *const
 }
 
 
+/*
+====================
+CreateLocalServer
+
+A socket file left behind by an earlier server is replaced; anything else at
+path is not.
+====================
+*/
+static t_bool CreateLocalServer( const t_char *const path, SOCKET *const server ) {
+	struct sockaddr_storage address;
+	t_int length;
+#if !_WIN32
+	struct stat info;
+#endif
+
+	if ( !T_LocalAddress( path, &address, &length ) ) {
+		T_Error( "CreateLocalServer: Local sockets are not available for %s.\n", path );
+		return t_false;
+	}
+
+#if !_WIN32
+	if ( lstat( path, &info ) == 0 && S_ISSOCK( info.st_mode ) ) {
+		remove( path );
+	}
+#endif
+
+	// Attempt to create a socket.
+	if ( ( *server = socket( AF_UNIX, SOCK_STREAM, 0 ) ) == INVALID_SOCKET ) {
+		T_Error( "CreateLocalServer: Unable to create socket.\n" );
+		return t_false;
+	}
+
+	// Bind socket and set it to non-blocking.
+	if ( bind( *server, ( struct sockaddr * )&address, length ) == SOCKET_ERROR || T_SocketNonBlocking( *server ) == SOCKET_ERROR ) {
+		TFile_CleanupFailedSocket( "CreateLocalServer: Unable to bind socket.\n", *server, NULL );
+		*server = INVALID_SOCKET;
+		return t_false;
+	}
+	return t_true;
+}
+
+
 /*
 ====================
 TFile_ShutdownServer
 ====================
 */
 void TFile_ShutdownServer( void ) {
+	t_int i;
+
+	for ( i = 0; i < server_reactor_count; ++i ) {
+		server_reactor_t *const reactor = &server_reactors[i];
+
+		t_int j;
+
+		// A reactor that was started closes its own sockets on the way out.
+		if ( server_running ) {
+			reactor->running = t_false;
+			thrd_join( reactor->thread, NULL );
+		} else {
+			TFile_TryCloseSocket( reactor->server );
+			TFile_TryCloseSocket( reactor->server6 );
+			TFile_TryCloseSocket( reactor->local );
+		}
+
+		for ( j = 0; j < TFILE_STAT_COUNT; ++j ) {
+			T_DestroyHistogram( reactor->stats[j] );
+		}
+	}
+
+	// Every reactor has had its requests back by now.
+	if ( server_disk ) {
+		T_DestroyDiskPool( server_disk );
+		server_disk = NULL;
+	}
+	server_disk_workers = DEFAULT_DISK_WORKERS;
+	server_read_ahead = DEFAULT_READ_AHEAD;
+
+	for ( i = 0; i < server_reactor_count; ++i ) {
+		if ( server_reactors[i].disk ) {
+			T_DestroyDiskQueue( server_reactors[i].disk );
+		}
+	}
+
+	// Nothing is read or sent from the caches once the connections are gone.
+	if ( server_descriptors ) {
+		T_DestroyFdCache( server_descriptors );
+		server_descriptors = NULL;
+	}
+	server_open_files = DEFAULT_OPEN_FILES;
+	server_stat_timeout = DEFAULT_STAT_TIMEOUT;
+
+	if ( server_cache ) {
+		T_DestroyFileCache( server_cache );
+		server_cache = NULL;
+	}
+	server_cache_size = DEFAULT_CACHE_SIZE;
+	T_Free( server_reactors );
+	server_reactors = NULL;
+	server_reactor_count = 0;
+
+	if ( server_local_path[0] != '\0' ) {
+		remove( server_local_path );
+		server_local_path[0] = '\0';
+	}
+
 	server_initialized = t_false;
 	server_running = t_false;
 	T_DestroyPipe( server_pipe );
-	TFile_TryCloseSocket( server_socket );
-	TFile_TryCloseSocket( server_socket6 );
 	T_Print( "File server shutdown.\n" );
 }
 
@@ -503,15 +2471,59 @@ TFile_InitServer
 ====================
 */
 t_bool TFile_InitServer( const t_int port ) {
+	return TFile_InitServerReactors( port, 1 );
+}
+
+
+/*
+====================
+TFile_InitServerReactors
+
+Each reactor is a server thread with its own listening sockets and connections.
+A count of zero or less starts one reactor per processor.
+====================
+*/
+t_bool TFile_InitServerReactors( const t_int port, const t_int reactors ) {
+	t_int count = reactors > 0 ? reactors : T_ProcessorCount();
+	t_int i;
+
 	if ( server_initialized ) {
 		T_FatalError( "TFile_InitServer: Server is already initialized" );
 	}
 
+	if ( count > MAX_REACTORS ) {
+		count = MAX_REACTORS;
+	}
+
+#if !_WIN32
+	// A client that resets mid-send is an error on the socket, not a signal.
+	signal( SIGPIPE, SIG_IGN );
+#endif
+
 	server_pipe = T_CreatePipe();
-	if ( !CreateServer( AF_INET, port, &server_socket ) || !CreateServer( AF_INET6, port, &server_socket6 ) ) {
-		TFile_CleanupFailedSocket( NULL, server_socket, NULL ); // Clean up IPv4 socket in case only the IPv6 socket failed.
-		T_Error( "TFile_InitServer: Unable to initialize server.\n" );
-		return t_false;
+	server_reactors = ( server_reactor_t * )T_Malloc0( sizeof( server_reactor_t ) * count );
+	server_reactor_count = count;
+
+	for ( i = 0; i < count; ++i ) {
+		server_reactor_t *const reactor = &server_reactors[i];
+		const t_bool reusePort = count > 1 ? t_true : t_false;
+
+		t_int j;
+
+		for ( j = 0; j < TFILE_STAT_COUNT; ++j ) {
+			reactor->stats[j] = T_CreateHistogram();
+		}
+
+		reactor->id = i;
+		reactor->server = INVALID_SOCKET;
+		reactor->server6 = INVALID_SOCKET;
+		reactor->local = INVALID_SOCKET;
+		if ( !CreateServer( AF_INET, port, reusePort, &reactor->server ) || !CreateServer( AF_INET6, port, reusePort, &reactor->server6 ) ) {
+			server_reactor_count = i + 1;
+			TFile_ShutdownServer();
+			T_Error( "TFile_InitServer: Unable to initialize server.\n" );
+			return t_false;
+		}
 	}
 
 	server_initialized = t_true;
@@ -520,6 +2532,111 @@ t_bool TFile_InitServer( const t_int port ) {
 }
 
 
+/*
+====================
+TFile_ServerListenLocal
+
+Also listens on a local (Unix domain) socket at path, for clients on the same
+host. They connect with LOCAL_ADDRESS_PREFIX and the path, skip the network
+stack, and may be handed open files with CMD_OPEN. Call between
+TFile_InitServer and TFile_StartServer; the first reactor takes these
+connections. The socket file is removed on shutdown.
+====================
+*/
+t_bool TFile_ServerListenLocal( const t_char *const path ) {
+	if ( !server_initialized || server_running ) {
+		T_FatalError( "TFile_ServerListenLocal: Server must be initialized and not running" );
+	}
+
+	if ( server_local_path[0] != '\0' || strlen( path ) >= MAX_FILE_NAME_SIZE ) {
+		return t_false;
+	}
+
+	if ( !CreateLocalServer( path, &server_reactors[0].local ) ) {
+		return t_false;
+	}
+	strcpy( server_local_path, path );
+	T_Print( "File server listening on %s%s.\n", LOCAL_ADDRESS_PREFIX, path );
+	return t_true;
+}
+
+
+/*
+====================
+TFile_ServerSetDiskWorkers
+
+Sets how many threads open and read files for the reactors, so a slow disk
+holds up only the connections waiting on it. Zero keeps file reads in the
+reactor loops, sent straight from the file. Call between TFile_InitServer and
+TFile_StartServer.
+====================
+*/
+void TFile_ServerSetDiskWorkers( const t_int workers ) {
+	if ( !server_initialized || server_running ) {
+		T_FatalError( "TFile_ServerSetDiskWorkers: Server must be initialized and not running" );
+	}
+	server_disk_workers = workers > 0 ? workers : 0;
+}
+
+
+/*
+====================
+TFile_ServerSetReadAhead
+
+Sets how many chunks past the last one a client asked for are read while
+earlier ones are still going out, up to MAX_DOWNLOAD_WINDOW. Worth raising
+when each read waits on a slow or remote disk; zero reads only what is asked
+for. Call between TFile_InitServer and TFile_StartServer.
+====================
+*/
+void TFile_ServerSetReadAhead( const t_int chunks ) {
+	if ( !server_initialized || server_running ) {
+		T_FatalError( "TFile_ServerSetReadAhead: Server must be initialized and not running" );
+	}
+	server_read_ahead = chunks < 0 ? 0 : ( chunks > MAX_DOWNLOAD_WINDOW ? MAX_DOWNLOAD_WINDOW : chunks );
+}
+
+
+/*
+====================
+TFile_ServerSetCacheSize
+
+Sets how many bytes of file contents, shared by all reactors, are kept in
+memory. Small files are read into the cache whole when first downloaded and
+served from it for as long as they do not change; the least recently used
+make room for new ones. Zero reads every file from disk. Call between
+TFile_InitServer and TFile_StartServer.
+====================
+*/
+void TFile_ServerSetCacheSize( const t_int64 bytes ) {
+	if ( !server_initialized || server_running ) {
+		T_FatalError( "TFile_ServerSetCacheSize: Server must be initialized and not running" );
+	}
+	server_cache_size = bytes > 0 ? bytes : 0;
+}
+
+
+/*
+====================
+TFile_ServerSetDescriptorCache
+
+Keeps up to files recently downloaded files open, shared by every download of
+them, along with what a stat of their paths said. For statTimeout
+milliseconds a download trusts that instead of asking the filesystem again,
+so a file that changes may still be served as it was for that long. Zero
+files opens the file for every download. Call between TFile_InitServer and
+TFile_StartServer.
+====================
+*/
+void TFile_ServerSetDescriptorCache( const t_int files, const t_int statTimeout ) {
+	if ( !server_initialized || server_running ) {
+		T_FatalError( "TFile_ServerSetDescriptorCache: Server must be initialized and not running" );
+	}
+	server_open_files = files > 0 ? files : 0;
+	server_stat_timeout = statTimeout > 0 ? statTimeout : 0;
+}
+
+
 /*
 ====================
 TFile_StartServer
@@ -527,6 +2644,7 @@ TFile_StartServer
 */
 void TFile_StartServer( void ) {
 	server_message_t message;
+	t_int i;
 
 	if ( !server_initialized ) {
 		T_FatalError( "TFile_StartServer: Server is not initialized" );
@@ -536,20 +2654,83 @@ void TFile_StartServer( void ) {
 		T_FatalError( "TFile_StartServer: Server is already running" );
 	}
 
-	cnd_init( &server_condition );
-	mtx_init( &server_mutex, mtx_plain );
-	mtx_lock( &server_mutex );
+	if ( server_disk_workers > 0 && !( server_disk = T_CreateDiskPool( server_disk_workers ) ) ) {
+		T_Error( "TFile_StartServer: Unable to start disk workers; files are read in the server loop.\n" );
+	}
+
+	if ( server_cache_size > 0 && !( server_cache = T_CreateFileCache( server_cache_size ) ) ) {
+		T_Error( "TFile_StartServer: Unable to create the file cache; files are read from disk.\n" );
+	}
 
-	message.ip_socket = server_socket;
-	message.ip6_socket = server_socket6;
-	if ( thrd_create( &server_thread, ServerThread, &message ) != thrd_success ) {
-		T_FatalError( "TFile_StartServer: Unable to create thread" );
+	if ( server_open_files > 0 && !( server_descriptors = T_CreateFdCache( server_open_files, server_stat_timeout ) ) ) {
+		T_Error( "TFile_StartServer: Unable to create the descriptor cache; files are opened for each download.\n" );
 	}
 
-	cnd_wait( &server_condition, &server_mutex );
+	for ( i = 0; i < server_reactor_count; ++i ) {
+		cnd_init( &server_condition );
+		mtx_init( &server_mutex, mtx_plain );
+		mtx_lock( &server_mutex );
+
+		message.reactor = &server_reactors[i];
+		message.reactor->running = t_true;
+		if ( thrd_create( &message.reactor->thread, ServerThread, &message ) != thrd_success ) {
+			T_FatalError( "TFile_StartServer: Unable to create thread" );
+		}
+
+		cnd_wait( &server_condition, &server_mutex );
 
-	mtx_destroy( &server_mutex );
-	cnd_destroy( &server_condition );
+		mtx_unlock( &server_mutex );
+		mtx_destroy( &server_mutex );
+		cnd_destroy( &server_condition );
+	}
 
 	server_running = t_true;
 }
+
+
+/*
+====================
+TFile_ServerEnableStats
+
+Starts or stops timing the phases of every reactor's loop. Takes effect at
+the top of each reactor's next pass.
+====================
+*/
+void TFile_ServerEnableStats( const t_bool enable ) {
+	server_stats_enabled = enable;
+}
+
+
+/*
+====================
+TFile_ServerResetStats
+
+Each reactor clears its histograms at the top of its next pass.
+====================
+*/
+void TFile_ServerResetStats( void ) {
+	++server_stats_generation;
+}
+
+
+/*
+====================
+TFile_ServerGetStats
+
+Fills histogram with one stat summed over all reactors. Safe to call from any
+thread while the server runs; a pass in progress may be partly counted.
+====================
+*/
+t_bool TFile_ServerGetStats( const tfile_stat_t stat, t_histogram_t *const histogram ) {
+	t_int i;
+
+	T_HistogramReset( histogram );
+	if ( !server_initialized || stat < 0 || stat >= TFILE_STAT_COUNT ) {
+		return t_false;
+	}
+
+	for ( i = 0; i < server_reactor_count; ++i ) {
+		T_HistogramAdd( histogram, server_reactors[i].stats[stat] );
+	}
+	return t_true;
+}
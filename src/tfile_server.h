@@ -26,7 +26,33 @@ THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "t_common.h"
+#include "t_histogram.h"
+
+// What the server loop can time. Phases are in nanoseconds; the iteration is
+// the busy part of one pass, without the wait. Ready counts sockets or
+// completions handed back by each wakeup. Heartbeat is the handling of a
+// single CMD_HEARTBEAT.
+typedef enum {
+	TFILE_STAT_WAIT,
+	TFILE_STAT_RECEIVE,
+	TFILE_STAT_TIME,
+	TFILE_STAT_COMMANDS,
+	TFILE_STAT_TIMERS,
+	TFILE_STAT_ITERATION,
+	TFILE_STAT_READY,
+	TFILE_STAT_HEARTBEAT,
+	TFILE_STAT_COUNT
+} tfile_stat_t;
 
 void TFile_ShutdownServer( void );
 t_bool TFile_InitServer( const t_int port );
+t_bool TFile_InitServerReactors( const t_int port, const t_int reactors );
+t_bool TFile_ServerListenLocal( const t_char *const path );
+void TFile_ServerSetDiskWorkers( const t_int workers );
+void TFile_ServerSetReadAhead( const t_int chunks );
+void TFile_ServerSetCacheSize( const t_int64 bytes );
+void TFile_ServerSetDescriptorCache( const t_int files, const t_int statTimeout );
 void TFile_StartServer( void );
+void TFile_ServerEnableStats( const t_bool enable );
+void TFile_ServerResetStats( void );
+t_bool TFile_ServerGetStats( const tfile_stat_t stat, t_histogram_t *const histogram );
@@ -28,6 +28,61 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #include "tfile_shared.h"
 
 
+/*
+====================
+TFile_WriteFrameHeader
+====================
+*/
+void TFile_WriteFrameHeader( t_byteStream_t *const byteStream, const t_byte type, const t_ushort stream, const t_uint length ) {
+	T_BSWrite( byteStream, t_uint, length );
+	T_BSWriteByte( byteStream, type );
+	T_BSWrite( byteStream, t_ushort, stream );
+}
+
+
+/*
+====================
+TFile_ReadFrameHeader
+
+buffer holds FRAME_HEADER_SIZE bytes, laid out by TFile_WriteFrameHeader.
+====================
+*/
+void TFile_ReadFrameHeader( const t_byte *const buffer, frame_header_t *const header ) {
+	memcpy( &header->length, buffer, sizeof( t_uint ) );
+	header->type = buffer[sizeof( t_uint )];
+	memcpy( &header->stream, buffer + sizeof( t_uint ) + 1, sizeof( t_ushort ) );
+}
+
+
+/*
+====================
+TFile_LocalPath
+
+Returns the socket path of a local or shared address, or NULL for a network
+address.
+====================
+*/
+const t_char *TFile_LocalPath( const t_char *const address ) {
+	if ( strncmp( address, LOCAL_ADDRESS_PREFIX, strlen( LOCAL_ADDRESS_PREFIX ) ) == 0 ) {
+		return address + strlen( LOCAL_ADDRESS_PREFIX );
+	}
+	if ( TFile_SharedAddress( address ) ) {
+		return address + strlen( SHARED_ADDRESS_PREFIX );
+	}
+	return NULL;
+}
+
+
+/*
+====================
+TFile_SharedAddress
+====================
+*/
+t_bool TFile_SharedAddress( const t_char *const address ) {
+	return strncmp( address, SHARED_ADDRESS_PREFIX, strlen( SHARED_ADDRESS_PREFIX ) ) == 0 ? t_true : t_false;
+}
+
+
 /*
 ====================
 TFile_CleanupFailedSocket
@@ -31,16 +31,74 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_PACKET_SIZE 1024
 #define RECEIVE_TIMEOUT 100000 // 100 milliseconds.
 
+#define MAX_FILE_NAME_SIZE 256
+#define FILE_CHUNK_SIZE 65536
+#define DEFAULT_DOWNLOAD_WINDOW 16
+#define MAX_DOWNLOAD_WINDOW 64
+
+// Addresses starting with these name a local (Unix domain) socket path, for
+// clients on the same host as the server. A local client is handed open files;
+// a shared one has its events, chunks included, come through a shared memory
+// ring instead of the socket.
+#define LOCAL_ADDRESS_PREFIX "unix:"
+#define SHARED_ADDRESS_PREFIX "shm:"
+#define SHARED_RING_SIZE ( 4 * 1024 * 1024 )
+#define MAX_SHARED_RING_SIZE ( 64 * 1024 * 1024 )
+
+// Every message travels as a frame: a header of
+//   t_uint    payload length
+//   t_byte    command_t or event_t
+//   t_ushort  stream id, echoed back on replies
+// followed by the payload.
+#define FRAME_HEADER_SIZE ( sizeof( t_uint ) + 1 + sizeof( t_ushort ) )
+
+// Command payloads:
+//   CMD_DOWNLOAD    file name, without a terminator
+//   CMD_FILE_CHUNK  t_int64 offset, t_int size
+//   CMD_OPEN        file name, without a terminator; local connections only
+//   CMD_SHARE       t_int ring size; local connections only, before any other
+//                   command that has a reply
 typedef enum {
 	CMD_HEARTBEAT,
-	CMD_DISCONNECT
+	CMD_DISCONNECT,
+	CMD_DOWNLOAD,
+	CMD_FILE_CHUNK,
+	CMD_OPEN,
+	CMD_SHARE
 } command_t;
 
+// Event payloads:
+//   EVT_FILE_CHUNK_READ    t_int64 offset, then the bytes of the file
+//   EVT_DOWNLOAD_STARTED   t_int64 file size
+//   EVT_FILE_OPENED        t_int64 file size, with the open file attached as
+//                          a descriptor; CMD_OPEN fails with EVT_DOWNLOAD_FAILED
+//   EVT_SHARED             t_int64 ring size, with the ring's descriptors
+//                          attached; every later event comes through the ring.
+//                          A refused CMD_SHARE gets EVT_SHARE_FAILED
 typedef enum {
 	EVT_DISCONNECTED,
 	EVT_FILE_CHUNK_READ,
-	EVT_DOWNLOAD_FINISHED
+	EVT_DOWNLOAD_FINISHED,
+	EVT_DOWNLOAD_STARTED,
+	EVT_DOWNLOAD_FAILED,
+	EVT_FILE_OPENED,
+	EVT_SHARED,
+	EVT_SHARE_FAILED
 } event_t;
 
+#define CHUNK_COMMAND_SIZE ( FRAME_HEADER_SIZE + sizeof( t_int64 ) + sizeof( t_int ) )
+#define MAX_COMMAND_PAYLOAD MAX_FILE_NAME_SIZE
+#define MAX_EVENT_SIZE ( FRAME_HEADER_SIZE + sizeof( t_int64 ) )
+
+typedef struct {
+	t_uint length;
+	t_byte type;
+	t_ushort stream;
+} frame_header_t;
+
+void TFile_WriteFrameHeader( t_byteStream_t *const byteStream, const t_byte type, const t_ushort stream, const t_uint length );
+void TFile_ReadFrameHeader( const t_byte *const buffer, frame_header_t *const header );
+const t_char *TFile_LocalPath( const t_char *const address );
+t_bool TFile_SharedAddress( const t_char *const address );
 void TFile_CleanupFailedSocket( const t_char *const error, const SOCKET socket, struct addrinfo *const info );
 t_bool TFile_TryCloseSocket( const SOCKET socket );
\ No newline at end of file